@@ -0,0 +1,234 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "adaptive.h"
+#include "profile.h"
+#include "scheduler.h"
+
+static uint64_t pointKey(int32_t iu, int32_t iv) {
+	return (uint64_t)(uint32_t)iu << 32 | (uint32_t)iv;
+}
+
+uint32_t AdaptivePlane::point(int32_t iu, int32_t iv, std::vector<Vec3>& pending) {
+	auto it = index.find(pointKey(iu, iv));
+	if (it != index.end()) {
+		return it->second;
+	}
+	uint32_t id = values[0].size() + pending.size();
+	index[pointKey(iu, iv)] = id;
+	Vec3 p;
+	p[axis] = coordinate;
+	p[axis1] = u0 + iu * h;
+	p[axis2] = v0 + iv * h;
+	pending.push_back(p);
+	return id;
+}
+
+void AdaptivePlane::evaluate(const FieldSources& sources, const std::vector<Vec3>& pending,
+	TaskPool& pool) {
+	size_t n = pending.size();
+	std::vector<float> p[3];
+	for (int c = 0; c < 3; c++) {
+		p[c].resize(n);
+		for (size_t k = 0; k < n; k++) {
+			p[c][k] = pending[k][c];
+		}
+	}
+	size_t offset = values[0].size();
+	float* out[6];
+	for (int c = 0; c < 6; c++) {
+		values[c].resize(offset + n, 0);
+		out[c] = values[c].data() + offset;
+	}
+	evaluateSourcesAt(sources, p[0].data(), p[1].data(), p[2].data(), n,
+		electric ? out : nullptr, magnetic ? out + 3 : nullptr, pool);
+}
+
+float AdaptivePlane::cellError(const Cell& cell, const float* floor) const {
+	int32_t s = 1 << (depth - cell.level);
+	uint32_t corners[4] = {
+		index.at(pointKey(cell.iu, cell.iv)), index.at(pointKey(cell.iu + s, cell.iv)),
+		index.at(pointKey(cell.iu, cell.iv + s)), index.at(pointKey(cell.iu + s, cell.iv + s))
+	};
+	uint32_t center = index.at(pointKey(cell.iu + s / 2, cell.iv + s / 2));
+	float error = 0;
+	for (int f = 0; f < 2; f++) {
+		float diff = 0, norm = 0;
+		for (int c = 3 * f; c < 3 * f + 3; c++) {
+			const std::vector<float>& F = values[c];
+			float mean = (F[corners[0]] + F[corners[1]] + F[corners[2]] + F[corners[3]]) / 4;
+			diff += (F[center] - mean) * (F[center] - mean);
+			norm += F[center] * F[center];
+		}
+		float scale = std::max(sqrtf(norm), floor[f]);
+		if (scale > 0) {
+			error = std::max(error, sqrtf(diff) / scale);
+		}
+	}
+	return error;
+}
+
+// Fraction of the median field strength below which the error is measured
+// in absolute terms, so cells around field nulls aren't refined forever
+#define ADAPTIVE_FLOOR 1e-3f
+
+void AdaptivePlane::build(const FieldSources& sources, const PlaneGrid& grid, bool electric,
+	bool magnetic, const AdaptiveOptions& options, TaskPool& pool) {
+	ProfileScope stage("adaptive");
+	axis = grid.axis;
+	axis1 = grid.axis1;
+	axis2 = grid.axis2;
+	coordinate = grid.coordinate;
+	this->electric = electric;
+	this->magnetic = magnetic;
+	depth = std::max(0, std::min(options.maxDepth, 20));
+	leaves.clear();
+	index.clear();
+	for (std::vector<float>& F : values) {
+		F.clear();
+	}
+	if (grid.width() == 0 || grid.height() == 0) {
+		return;
+	}
+	u0 = grid.u.front();
+	v0 = grid.v.front();
+	float extentU = grid.u.back() - u0;
+	float extentV = grid.v.back() - v0;
+	float root = std::max(extentU, extentV) / ADAPTIVE_ROOT_CELLS;
+	if (root <= 0) {
+		root = 1;
+	}
+	// Cells smaller than the spacing of the plot grid can't add detail to it
+	float spacing = std::max(extentU / std::max<size_t>(grid.width() - 1, 1),
+		extentV / std::max<size_t>(grid.height() - 1, 1));
+	while (depth > 0 && root / (1 << depth) < spacing) {
+		depth--;
+	}
+	int nu = std::max(1, (int)ceilf(extentU / root));
+	int nv = std::max(1, (int)ceilf(extentV / root));
+	int32_t size = 1 << depth;
+	h = root / size;
+
+	std::vector<Cell> cells;
+	for (int j = 0; j < nv; j++) {
+		for (int i = 0; i < nu; i++) {
+			cells.push_back({i * size, j * size, 0});
+		}
+	}
+	float floor[2] = {0, 0};
+	std::vector<Vec3> pending;
+	for (bool first = true; !cells.empty(); first = false) {
+		pending.clear();
+		for (const Cell& cell : cells) {
+			int32_t s = size >> cell.level;
+			point(cell.iu, cell.iv, pending);
+			point(cell.iu + s, cell.iv, pending);
+			point(cell.iu, cell.iv + s, pending);
+			point(cell.iu + s, cell.iv + s, pending);
+			if (cell.level < depth) {
+				point(cell.iu + s / 2, cell.iv + s / 2, pending);
+			}
+		}
+		evaluate(sources, pending, pool);
+		if (first) {
+			for (int f = 0; f < 2; f++) {
+				std::vector<float> magnitude(values[0].size());
+				for (size_t k = 0; k < magnitude.size(); k++) {
+					float x = values[3 * f][k], y = values[3 * f + 1][k], z = values[3 * f + 2][k];
+					magnitude[k] = sqrtf(x * x + y * y + z * z);
+				}
+				std::nth_element(magnitude.begin(), magnitude.begin() + magnitude.size() / 2, magnitude.end());
+				floor[f] = ADAPTIVE_FLOOR * magnitude[magnitude.size() / 2];
+			}
+		}
+		std::vector<Cell> next;
+		for (const Cell& cell : cells) {
+			if (cell.level == depth || cellError(cell, floor) <= options.tolerance) {
+				leaves.push_back(cell);
+				continue;
+			}
+			int32_t s = (size >> cell.level) / 2;
+			int level = cell.level + 1;
+			next.push_back({cell.iu, cell.iv, level});
+			next.push_back({cell.iu + s, cell.iv, level});
+			next.push_back({cell.iu, cell.iv + s, level});
+			next.push_back({cell.iu + s, cell.iv + s, level});
+		}
+		cells.swap(next);
+	}
+	profiler.count("evaluations", (double)evaluations());
+	profiler.count("leaves", (double)leaves.size());
+}
+
+// Range of samples in [a, b), extended to the last sample for cells on the
+// far edge of the grid
+static void sampleRange(const std::vector<float>& axis, float a, float b, size_t& i0, size_t& i1) {
+	i0 = std::lower_bound(axis.begin(), axis.end(), a) - axis.begin();
+	i1 = b > axis.back() ? axis.size() : std::lower_bound(axis.begin(), axis.end(), b) - axis.begin();
+}
+
+void AdaptivePlane::resample(const PlaneGrid& grid, FieldBuffer* efield, FieldBuffer* bfield,
+	TaskPool& pool) const {
+	ProfileScope stage("adaptive-resample");
+	profiler.count("points", (double)grid.size());
+	FieldBuffer* fields[2] = {efield, bfield};
+	for (FieldBuffer* field : fields) {
+		if (field) {
+			field->resize(grid.width(), grid.height());
+		}
+	}
+	const size_t block = 256;
+	pool.run((leaves.size() + block - 1) / block, [&](size_t t) {
+		size_t end = std::min(leaves.size(), (t + 1) * block);
+		for (size_t l = t * block; l < end; l++) {
+			const Cell& cell = leaves[l];
+			int32_t s = 1 << (depth - cell.level);
+			float ua = u0 + cell.iu * h, va = v0 + cell.iv * h, size = s * h;
+			size_t i0, i1, j0, j1;
+			sampleRange(grid.u, ua, ua + size, i0, i1);
+			sampleRange(grid.v, va, va + size, j0, j1);
+			if (i0 >= i1 || j0 >= j1) {
+				continue;
+			}
+			uint32_t corners[4] = {
+				index.at(pointKey(cell.iu, cell.iv)), index.at(pointKey(cell.iu + s, cell.iv)),
+				index.at(pointKey(cell.iu, cell.iv + s)), index.at(pointKey(cell.iu + s, cell.iv + s))
+			};
+			for (size_t j = j0; j < j1; j++) {
+				float b = (grid.v[j] - va) / size;
+				for (size_t i = i0; i < i1; i++) {
+					float a = (grid.u[i] - ua) / size;
+					float w[4] = {(1 - a) * (1 - b), a * (1 - b), (1 - a) * b, a * b};
+					size_t idx = j * grid.width() + i;
+					for (int f = 0; f < 2; f++) {
+						if (!fields[f]) {
+							continue;
+						}
+						std::vector<float>* out[3] = {&fields[f]->x, &fields[f]->y, &fields[f]->z};
+						for (int c = 0; c < 3; c++) {
+							const std::vector<float>& F = values[3 * f + c];
+							(*out[c])[idx] = w[0] * F[corners[0]] + w[1] * F[corners[1]]
+								+ w[2] * F[corners[2]] + w[3] * F[corners[3]];
+						}
+					}
+				}
+			}
+		}
+	});
+}
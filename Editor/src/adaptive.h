@@ -0,0 +1,71 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <stdint.h>
+
+#include <unordered_map>
+
+#include "engine.h"
+
+// Number of root cells along the longer side of the plane
+#define ADAPTIVE_ROOT_CELLS 8
+
+struct AdaptiveOptions {
+	// Largest relative error of the bilinear interpolation of a cell
+	float tolerance = 0.01f;
+	// Number of times a root cell can be split
+	int maxDepth = 8;
+};
+
+// Quadtree sampling of the plane of interest. Every cell is judged by
+// comparing the field at its center with the bilinear interpolation of its
+// corners; cells whose relative error exceeds the tolerance are split into
+// four. Sample points lie on a lattice at the finest level so corners shared
+// by neighboring cells (and the centers reused as corners of the children)
+// are evaluated once. Each refinement level is evaluated as one parallel
+// batch.
+class AdaptivePlane {
+	struct Cell {
+		int32_t iu, iv, level;
+	};
+	int axis = 2, axis1 = 0, axis2 = 1;
+	float coordinate = 0;
+	float u0 = 0, v0 = 0, h = 1;
+	int depth = 0;
+	bool electric = true, magnetic = true;
+	std::vector<Cell> leaves;
+	std::unordered_map<uint64_t, uint32_t> index;
+	// Field components at each sample point: Ex, Ey, Ez, Bx, By, Bz
+	std::vector<float> values[6];
+
+	uint32_t point(int32_t iu, int32_t iv, std::vector<Vec3>& pending);
+	void evaluate(const FieldSources& sources, const std::vector<Vec3>& pending, TaskPool& pool);
+	float cellError(const Cell& cell, const float* floor) const;
+public:
+	// Refines the extents of the plane grid; the fields not requested are
+	// left at zero
+	void build(const FieldSources& sources, const PlaneGrid& grid, bool electric, bool magnetic,
+		const AdaptiveOptions& options, TaskPool& pool);
+	// Interpolates the sampled fields onto the points of a uniform grid
+	void resample(const PlaneGrid& grid, FieldBuffer* efield, FieldBuffer* bfield, TaskPool& pool) const;
+
+	size_t evaluations() const { return values[0].size(); }
+	size_t leafCount() const { return leaves.size(); }
+};
+
+#endif
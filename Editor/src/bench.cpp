@@ -0,0 +1,282 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "json.hpp"
+
+#include "configio.h"
+#include "engine.h"
+#include "profile.h"
+#include "scheduler.h"
+
+// Benchmark suite for the native engine, see Visualizer/benchmark.py for the
+// visualizer's counterpart. Scenes are generated with splitmix64 from fixed
+// seeds so both produce the same charges. Results are written as JSON.
+
+struct Random {
+	uint64_t state;
+
+	explicit Random(uint64_t seed) : state(seed) {}
+
+	uint64_t next() {
+		uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	// Uniform in [lo, hi)
+	float uniform(float lo, float hi) {
+		return lo + (hi - lo) * (float)((next() >> 11) * (1.0 / 9007199254740992.0));
+	}
+};
+
+struct Scene {
+	std::string name;
+	std::vector<Vec4> charges;
+	std::vector<ChargeDensityFunc> densities;
+	Vec3 min = {{-5, -5, -1}};
+	Vec3 max = {{5, 5, 1}};
+};
+
+// N charges of random sign and magnitude up to 1 in [-5, 5]^2 x [-1, 1]
+static Scene randomCharges(size_t count) {
+	Scene scene;
+	scene.name = "random-" + std::to_string(count);
+	Random random(count);
+	for (size_t i = 0; i < count; i++) {
+		float q = random.uniform(-1, 1);
+		float x = random.uniform(-5, 5);
+		float y = random.uniform(-5, 5);
+		float z = random.uniform(-1, 1);
+		scene.charges.push_back({{q, x, y, z}});
+	}
+	return scene;
+}
+
+// k x k dipoles along x with spacing 1 in the z = 0 plane
+static Scene dipoleArray(int k) {
+	Scene scene;
+	scene.name = "dipoles-" + std::to_string(k) + "x" + std::to_string(k);
+	for (int j = 0; j < k; j++) {
+		for (int i = 0; i < k; i++) {
+			float x = i - (k - 1) / 2.0f, y = j - (k - 1) / 2.0f;
+			scene.charges.push_back({{1, x - 0.25f, y, 0}});
+			scene.charges.push_back({{-1, x + 0.25f, y, 0}});
+		}
+	}
+	inferBounds(scene.charges, scene.min, scene.max);
+	return scene;
+}
+
+static Scene presetDensity(const char* name, const char* var, int preset, float value) {
+	Scene scene;
+	scene.name = std::string("preset-") + name;
+	ChargeDensityFunc rho;
+	rho.isPreset = true;
+	rho.preset = preset;
+	strcpy(rho.var, var);
+	rho.value = value;
+	scene.densities.push_back(rho);
+	return scene;
+}
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static const char* kernelName() {
+	#if defined(__AVX2__)
+	return "avx2";
+	#elif defined(__ARM_NEON) && defined(__aarch64__)
+	return "neon";
+	#else
+	return "scalar";
+	#endif
+}
+
+static nlohmann::json fieldCase(const Scene& scene, int resolution, int solver, int precision,
+	int repeat) {
+	FieldJob job;
+	job.charges = &scene.charges;
+	job.densities = &scene.densities;
+	job.min = scene.min;
+	job.max = scene.max;
+	job.margins = {{1, 1, 1}};
+	job.resolution = resolution;
+	job.solver = solver;
+	job.precision = precision;
+	PlaneGrid grid;
+	buildGrid(job, grid);
+	FieldBuffer field;
+	double best = INFINITY, setup = INFINITY;
+	for (int r = 0; r < repeat; r++) {
+		auto start = std::chrono::steady_clock::now();
+		FieldSources sources;
+		sources.build(job, true, false);
+		setup = std::min(setup, seconds(start));
+		start = std::chrono::steady_clock::now();
+		evaluateSources(sources, grid, &field, nullptr, TaskPool::shared());
+		best = std::min(best, seconds(start));
+	}
+	nlohmann::json result = {
+		{"scene", scene.name},
+		{"solver", solverNames[solver]},
+		{"precision", precisionNames[precision]},
+		{"resolution", resolution},
+		{"charges", scene.charges.size()},
+		{"densities", scene.densities.size()},
+		{"points", grid.size()},
+		{"setup_seconds", setup},
+		{"seconds", best},
+		{"points_per_second", grid.size() / best},
+		{"process_peak_rss_bytes", (long long)peakMemory()}
+	};
+	if (!scene.charges.empty()) {
+		result["seconds_per_1k_charges"] = best / (scene.charges.size() / 1000.0);
+	}
+	if (solver == SOLVER_DIRECT && !scene.charges.empty()) {
+		FieldSources sources;
+		sources.build(job, true, false);
+		result["max_relative_error"] = chargeFieldError(sources.charges, grid, PRECISION_SAMPLES);
+	}
+	return result;
+}
+
+static nlohmann::json configCase(const Scene& scene, bool binary, int repeat) {
+	std::string path = std::string("emfield-bench") + (binary ? ".cbor" : ".json");
+	nlohmann::json params = {{"resolution", 10}, {"plot-margins", {1, 1, 1}}};
+	double write = INFINITY, read = INFINITY;
+	long bytes = 0;
+	bool ok = true;
+	for (int r = 0; r < repeat && ok; r++) {
+		auto start = std::chrono::steady_clock::now();
+		FILE* file = fopen(path.c_str(), "wb");
+		ok = file && writeConfig(file, binary, params, scene.charges);
+		if (file) {
+			ok = fclose(file) == 0 && ok;
+		}
+		write = std::min(write, seconds(start));
+
+		start = std::chrono::steady_clock::now();
+		file = fopen(path.c_str(), "rb");
+		nlohmann::json loaded;
+		std::vector<Vec4> charges;
+		std::string error;
+		ok = ok && file && readConfig(file, binary, loaded, charges, error);
+		if (file) {
+			fseek(file, 0, SEEK_END);
+			bytes = ftell(file);
+			fclose(file);
+		}
+		read = std::min(read, seconds(start));
+		ok = ok && charges.size() == scene.charges.size();
+	}
+	remove(path.c_str());
+	if (!ok) {
+		return {{"format", binary ? "cbor" : "json"}, {"error", "Failed to write or read " + path}};
+	}
+	return {
+		{"format", binary ? "cbor" : "json"},
+		{"charges", scene.charges.size()},
+		{"bytes", bytes},
+		{"write_seconds", write},
+		{"read_seconds", read},
+		{"write_mb_per_second", bytes / write / 1e6},
+		{"read_mb_per_second", bytes / read / 1e6},
+		{"read_charges_per_second", scene.charges.size() / read}
+	};
+}
+
+int main(int argc, char** argv) {
+	bool quick = false;
+	int repeat = 3;
+	const char* out = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--quick")) {
+			quick = true;
+		} else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+			repeat = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+			out = argv[++i];
+		} else {
+			fprintf(stderr, "Usage: %s [--quick] [--repeat n] [--out results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	std::vector<int> resolutions = quick ? std::vector<int>{10} : std::vector<int>{10, 20, 40};
+	std::vector<Scene> scenes = {
+		randomCharges(1000), randomCharges(quick ? 4000 : 10000), dipoleArray(10),
+		presetDensity("ball", "r", PRESET_REVERSE_HEAVISIDE, 2),
+		presetDensity("shell", "r", PRESET_DELTA, 2),
+		presetDensity("outside-sphere", "r", PRESET_HEAVISIDE, 2),
+		presetDensity("cylinder", "rc", PRESET_REVERSE_HEAVISIDE, 1),
+		presetDensity("slab", "z", PRESET_DELTA, 0)
+	};
+
+	nlohmann::json results = nlohmann::json::array();
+	for (const Scene& scene : scenes) {
+		for (int resolution : resolutions) {
+			int solvers = scene.charges.size() >= 1000 ? SOLVER_COUNT : 1;
+			for (int solver = 0; solver < solvers; solver++) {
+				// Large direct sums are timed with every precision
+				int precisions = solvers > 1 && solver == SOLVER_DIRECT ? PRECISION_COUNT : 1;
+				for (int precision = 0; precision < precisions; precision++) {
+					results.push_back(fieldCase(scene, resolution, solver, precision, repeat));
+					const nlohmann::json& r = results.back();
+					fprintf(stderr, "%-24s %-10s %-11s res %3d: %.4f s, %.3g points/s\n", scene.name.c_str(),
+						solverNames[solver], precisionNames[precision], resolution,
+						r["seconds"].get<double>(), r["points_per_second"].get<double>());
+				}
+			}
+		}
+	}
+	nlohmann::json io = nlohmann::json::array();
+	Scene large = randomCharges(quick ? 20000 : 200000);
+	for (bool binary : {false, true}) {
+		io.push_back(configCase(large, binary, repeat));
+		fprintf(stderr, "config %s: %s\n", binary ? "cbor" : "json", io.back().dump().c_str());
+	}
+	nlohmann::json report = {
+		{"version", 1},
+		{"tool", "emfield-bench"},
+		{"kernel", kernelName()},
+		{"threads", TaskPool::shared().size()},
+		{"repeat", repeat},
+		{"fields", results},
+		{"config_io", io}
+	};
+	std::string text = report.dump(4);
+	if (out) {
+		FILE* file = fopen(out, "w");
+		if (!file) {
+			fprintf(stderr, "Failed to open %s for writing\n", out);
+			return 1;
+		}
+		fprintf(file, "%s\n", text.c_str());
+		fclose(file);
+	} else {
+		printf("%s\n", text.c_str());
+	}
+	return 0;
+}
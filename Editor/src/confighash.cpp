@@ -0,0 +1,178 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "confighash.h"
+
+static const char* physicsKeys[] = {
+	"b-field", "charge-densities", "charges", "current-densities", "current-loops", "currents",
+	"density-method", "e-field", "error-budget", "max-depth", "opening-angle", "plane", "plot-bounds",
+	"plot-margins", "precision", "resolution", "sampling", "solver", "symmetry", "voxel-resolution"
+};
+
+static void canonicalValue(const nlohmann::json& value, std::string& out) {
+	char buf[32];
+	switch (value.type()) {
+		case nlohmann::json::value_t::object: {
+			out += '{';
+			bool first = true;
+			// Object keys are kept sorted
+			for (auto it = value.begin(); it != value.end(); ++it) {
+				if (!first) {
+					out += ',';
+				}
+				first = false;
+				canonicalValue(it.key(), out);
+				out += ':';
+				canonicalValue(it.value(), out);
+			}
+			out += '}';
+			break;
+		}
+		case nlohmann::json::value_t::array:
+			out += '[';
+			for (size_t i = 0; i < value.size(); i++) {
+				if (i > 0) {
+					out += ',';
+				}
+				canonicalValue(value[i], out);
+			}
+			out += ']';
+			break;
+		case nlohmann::json::value_t::string:
+			out += '"';
+			for (char c : value.get<std::string>()) {
+				if (c == '"' || c == '\\') {
+					out += '\\';
+				}
+				out += c;
+			}
+			out += '"';
+			break;
+		case nlohmann::json::value_t::boolean:
+			out += value.get<bool>() ? "true" : "false";
+			break;
+		case nlohmann::json::value_t::number_integer:
+		case nlohmann::json::value_t::number_unsigned:
+		case nlohmann::json::value_t::number_float:
+			snprintf(buf, sizeof(buf), "%.9g", (double)value.get<float>());
+			out += buf;
+			break;
+		default:
+			out += "null";
+			break;
+	}
+}
+
+static nlohmann::json canonicalDensity(const nlohmann::json& density) {
+	nlohmann::json canonical;
+	if (!density.value("preset", false)) {
+		canonical = {{"preset", false}, {"func", density["func"]}};
+	} else {
+		nlohmann::json offset = density.value("offset", nlohmann::json(0));
+		if (!offset.is_array()) {
+			offset = {0, 0, 0};
+		}
+		canonical = {
+			{"preset", true},
+			{"func", density["func"]},
+			{"var", density["var"]},
+			{"value", density["value"]},
+			{"scale", density.value("scale", nlohmann::json(1))},
+			{"offset", offset}
+		};
+	}
+	if (density.contains("support")) {
+		canonical["support"] = density["support"];
+	}
+	return canonical;
+}
+
+static void canonicalCharges(const std::vector<Vec4>& charges, std::string& out) {
+	char buf[32];
+	out += '[';
+	for (size_t i = 0; i < charges.size(); i++) {
+		out += i > 0 ? ",[" : "[";
+		for (int c = 0; c < 4; c++) {
+			snprintf(buf, sizeof(buf), c > 0 ? ",%.9g" : "%.9g", (double)charges[i][c]);
+			out += buf;
+		}
+		out += ']';
+	}
+	out += ']';
+}
+
+std::string canonicalConfig(const nlohmann::json& params, const std::vector<Vec4>* charges) {
+	nlohmann::json physics = nlohmann::json::object();
+	for (const char* key : physicsKeys) {
+		if (!params.contains(key)) {
+			continue;
+		}
+		if (!strcmp(key, "charge-densities") || !strcmp(key, "current-densities")) {
+			nlohmann::json densities = nlohmann::json::array();
+			for (const nlohmann::json& density : params[key]) {
+				nlohmann::json canonical = canonicalDensity(density);
+				if (!strcmp(key, "current-densities")) {
+					canonical["direction"] = density.value("direction", nlohmann::json({0, 0, 1}));
+				}
+				densities.push_back(canonical);
+			}
+			physics[key] = densities;
+		} else if (!strcmp(key, "e-field") || !strcmp(key, "b-field")) {
+			// Only the fields that are plotted are computed
+			physics[key] = {{"plot", params[key].value("plot", true)}};
+		} else {
+			physics[key] = params[key];
+		}
+	}
+	std::string out;
+	if (!charges || charges->empty()) {
+		canonicalValue(physics, out);
+		return out;
+	}
+	// The physics keys are listed in sorted order, so the charges can be
+	// spliced in at their place among the other keys
+	physics.erase("charges");
+	out += '{';
+	for (const char* key : physicsKeys) {
+		if (!strcmp(key, "charges")) {
+			out += out.size() > 1 ? ",\"charges\":" : "\"charges\":";
+			canonicalCharges(*charges, out);
+		} else if (physics.contains(key)) {
+			if (out.size() > 1) {
+				out += ',';
+			}
+			canonicalValue(key, out);
+			out += ':';
+			canonicalValue(physics[key], out);
+		}
+	}
+	out += '}';
+	return out;
+}
+
+std::string configHash(const nlohmann::json& params, const std::vector<Vec4>* charges) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : canonicalConfig(params, charges)) {
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)hash);
+	return buf;
+}
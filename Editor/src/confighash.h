@@ -0,0 +1,40 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef CONFIGHASH_H
+#define CONFIGHASH_H
+
+#include <string>
+
+#include "json.hpp"
+
+#include "field.h"
+
+// Canonical form of the configuration parameters that determine the computed
+// fields, shared with the visualizer's result cache (Visualizer/confighash.py).
+// Keys are sorted, preset densities always carry their scale and offset
+// (and current densities their direction),
+// and every number is written as the shortest round trip of its single
+// precision value with %.9g so that both tools produce the same text
+// regardless of how the numbers were parsed. Plot bounds must already be
+// inferred if the configuration doesn't specify them. If `charges` is
+// nonempty it is used in place of the "charges" entry of the parameters, so
+// large charge lists don't have to be copied into the DOM.
+std::string canonicalConfig(const nlohmann::json& params, const std::vector<Vec4>* charges = nullptr);
+
+// 64-bit FNV-1a hash of the canonical form as 16 hex digits
+std::string configHash(const nlohmann::json& params, const std::vector<Vec4>* charges = nullptr);
+
+#endif
@@ -0,0 +1,224 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <string.h>
+
+#include "configio.h"
+
+// Builds the configuration from the parse events, except those inside the
+// top-level "charges" list, which go straight into the charge vector. Only
+// the public SAX interface is used, so the value tree is built here.
+class ConfigReader : public nlohmann::json_sax<nlohmann::json> {
+	nlohmann::json& root;
+	std::vector<Vec4>& charges;
+	// Objects and arrays being built, innermost last
+	std::vector<nlohmann::json*> open;
+	// Member of the innermost object the next value goes into
+	nlohmann::json* member = nullptr;
+	int depth = 0;
+	// The next value is the charge list
+	bool chargeKey = false;
+	// 1 inside the charge list, 2 inside a charge
+	int chargeDepth = 0;
+	size_t component = 0;
+
+	// Places a value in the innermost open object or array, or at the root
+	nlohmann::json* place(nlohmann::json&& value) {
+		if (open.empty()) {
+			root = std::move(value);
+			return &root;
+		}
+		nlohmann::json& parent = *open.back();
+		if (parent.is_array()) {
+			parent.push_back(std::move(value));
+			return &parent.back();
+		}
+		*member = std::move(value);
+		return member;
+	}
+	bool add(nlohmann::json&& value) {
+		place(std::move(value));
+		return true;
+	}
+public:
+	std::string error;
+
+	ConfigReader(nlohmann::json& params, std::vector<Vec4>& charges) : root(params), charges(charges) {}
+
+	bool fail(const char* message) {
+		error = message;
+		return false;
+	}
+
+	bool number(float value) {
+		if (chargeDepth != 2) {
+			return fail("Charges must be lists of 4 numbers");
+		}
+		if (component < 4) {
+			charges.back()[component] = value;
+		}
+		component++;
+		return true;
+	}
+
+	bool inCharges() const { return chargeKey || chargeDepth > 0; }
+
+	bool null() override {
+		return inCharges() ? fail("Charges must be lists of 4 numbers") : add(nullptr);
+	}
+	bool boolean(bool val) override {
+		return inCharges() ? fail("Charges must be lists of 4 numbers") : add(val);
+	}
+	bool number_integer(number_integer_t val) override {
+		return inCharges() ? number(val) : add(val);
+	}
+	bool number_unsigned(number_unsigned_t val) override {
+		return inCharges() ? number(val) : add(val);
+	}
+	bool number_float(number_float_t val, const string_t&) override {
+		return inCharges() ? number(val) : add(val);
+	}
+	bool string(string_t& val) override {
+		return inCharges() ? fail("Charges must be lists of 4 numbers") : add(std::move(val));
+	}
+	bool binary(binary_t& val) override {
+		if (chargeKey) {
+			// Packed float32 charges; both supported platforms are little-endian
+			chargeKey = false;
+			if (val.size() % sizeof(Vec4) != 0) {
+				return fail("Packed charges must hold 4 floats per charge");
+			}
+			charges.resize(val.size() / sizeof(Vec4));
+			if (!charges.empty()) {
+				memcpy(charges.data(), val.data(), val.size());
+			}
+			return true;
+		}
+		return inCharges() ? fail("Charges must be lists of 4 numbers") : add(std::move(val));
+	}
+	bool start_object(std::size_t) override {
+		if (inCharges()) {
+			return fail("Charges must be lists of 4 numbers");
+		}
+		depth++;
+		open.push_back(place(nlohmann::json::object()));
+		return true;
+	}
+	bool key(string_t& val) override {
+		if (depth == 1 && val == "charges") {
+			chargeKey = true;
+			return true;
+		}
+		member = &(*open.back())[val];
+		return true;
+	}
+	bool end_object() override {
+		depth--;
+		open.pop_back();
+		return true;
+	}
+	bool start_array(std::size_t elements) override {
+		if (chargeKey) {
+			chargeKey = false;
+			chargeDepth = 1;
+			// Binary formats give the length up front
+			if (elements != std::size_t(-1)) {
+				charges.reserve(elements);
+			}
+			return true;
+		}
+		if (chargeDepth == 1) {
+			chargeDepth = 2;
+			component = 0;
+			charges.push_back({{0, 0, 0, 0}});
+			return true;
+		}
+		if (chargeDepth == 2) {
+			return fail("Charges must be lists of 4 numbers");
+		}
+		open.push_back(place(nlohmann::json::array()));
+		return true;
+	}
+	bool end_array() override {
+		if (chargeDepth == 2) {
+			chargeDepth = 1;
+			return component == 4 || fail("Charges must be lists of 4 numbers");
+		}
+		if (chargeDepth == 1) {
+			chargeDepth = 0;
+			return true;
+		}
+		open.pop_back();
+		return true;
+	}
+	bool parse_error(std::size_t, const std::string&,
+		const nlohmann::detail::exception& ex) override {
+		error = ex.what();
+		return false;
+	}
+};
+
+bool isBinaryConfig(const char* filename) {
+	const char* ext = strrchr(filename, '.');
+	return ext && !strcmp(ext, ".cbor");
+}
+
+bool readConfig(FILE* file, bool binary, nlohmann::json& params, std::vector<Vec4>& charges,
+	std::string& error) {
+	std::vector<Vec4> parsed;
+	ConfigReader reader(params, parsed);
+	bool ok = nlohmann::json::sax_parse(file, &reader,
+		binary ? nlohmann::json::input_format_t::cbor : nlohmann::json::input_format_t::json);
+	if (!ok || !params.is_object()) {
+		error = reader.error.empty() ? "Configuration must be a JSON object" : reader.error;
+		params = nlohmann::json();
+		return false;
+	}
+	charges.swap(parsed);
+	return true;
+}
+
+bool writeConfig(FILE* file, bool binary, const nlohmann::json& params, const std::vector<Vec4>& charges) {
+	if (binary) {
+		nlohmann::json packed = params;
+		if (!charges.empty()) {
+			std::vector<uint8_t> bytes(charges.size() * sizeof(Vec4));
+			memcpy(bytes.data(), charges.data(), bytes.size());
+			packed["charges"] = nlohmann::json::binary(std::move(bytes));
+		}
+		std::vector<uint8_t> data = nlohmann::json::to_cbor(packed);
+		return fwrite(data.data(), 1, data.size(), file) == data.size();
+	}
+	std::string text = params.dump(4);
+	if (charges.empty()) {
+		fputs(text.c_str(), file);
+		return !ferror(file);
+	}
+	// Reopen the object to append the charges after the other keys
+	text.resize(text.size() - 1);
+	while (!text.empty() && (text.back() == '\n' || text.back() == ' ')) {
+		text.pop_back();
+	}
+	fputs(text.c_str(), file);
+	fputs(text.size() > 1 ? ",\n    \"charges\": [\n" : "\n    \"charges\": [\n", file);
+	for (size_t i = 0; i < charges.size(); i++) {
+		const Vec4& c = charges[i];
+		// %.9g round-trips single precision values
+		fprintf(file, "        [%.9g, %.9g, %.9g, %.9g]%s\n", c[0], c[1], c[2], c[3],
+			i + 1 < charges.size() ? "," : "");
+	}
+	fputs("    ]\n}", file);
+	return !ferror(file);
+}
@@ -0,0 +1,45 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef CONFIGIO_H
+#define CONFIGIO_H
+
+#include <stdio.h>
+
+#include <string>
+
+#include "json.hpp"
+
+#include "field.h"
+
+// Configurations are JSON text, or CBOR (the same structure in binary) for
+// files with the .cbor extension. In CBOR files the charges are stored as a
+// single byte string of little-endian float32 (q, x, y, z) values rather
+// than a list of lists; lists are accepted when reading.
+bool isBinaryConfig(const char* filename);
+
+// Reads a configuration without building a DOM for the point charges:
+// the top-level "charges" list is parsed directly into `charges` while all
+// other keys (which are small) go into `params` as usual. On failure
+// `error` describes the problem and `charges` is left unchanged.
+bool readConfig(FILE* file, bool binary, nlohmann::json& params, std::vector<Vec4>& charges,
+	std::string& error);
+
+// Writes the parameters followed by the charges (if any). JSON is written
+// in the format of dump(4) with the charges formatted directly from the
+// vector, one charge per line.
+bool writeConfig(FILE* file, bool binary, const nlohmann::json& params, const std::vector<Vec4>& charges);
+
+#endif
@@ -0,0 +1,321 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "density.h"
+#include "profile.h"
+
+static float variable(const char* var, float x, float y, float z) {
+	if (!strcmp(var, "x")) {
+		return x;
+	} else if (!strcmp(var, "y")) {
+		return y;
+	} else if (!strcmp(var, "z")) {
+		return z;
+	} else if (!strcmp(var, "r")) {
+		return sqrtf(x * x + y * y + z * z);
+	} else if (!strcmp(var, "rc")) {
+		return sqrtf(x * x + y * y);
+	} else if (!strcmp(var, "theta")) {
+		return acosf(z / sqrtf(x * x + y * y + z * z));
+	} else if (!strcmp(var, "phi")) {
+		return acosf(x / sqrtf(x * x + y * y));
+	}
+	return NAN;
+}
+
+static float presetValue(const ChargeDensityFunc& rho, float x, float y, float z) {
+	// The presets compare the variable at X + offset
+	float v = variable(rho.var, x + rho.offset[0], y + rho.offset[1], z + rho.offset[2]);
+	bool inside = false;
+	switch (rho.preset) {
+	case PRESET_DELTA:
+		inside = fabsf(v - rho.value) < DELTA_TOLERANCE;
+		break;
+	case PRESET_HEAVISIDE:
+		inside = v > rho.value;
+		break;
+	case PRESET_REVERSE_HEAVISIDE:
+		inside = v < rho.value;
+		break;
+	}
+	return inside ? rho.scale : 0;
+}
+
+void evaluateDensity(const ChargeDensityFunc& rho, const float* x, const float* y,
+	const float* z, size_t count, float* out) {
+	if (!rho.isPreset) {
+		rho.expr.evaluate(x, y, z, count, out);
+	} else {
+		for (size_t k = 0; k < count; k++) {
+			out[k] = presetValue(rho, x[k], y[k], z[k]);
+		}
+	}
+	// The density is zero outside the user's box
+	if (rho.bounded) {
+		for (size_t k = 0; k < count; k++) {
+			if (x[k] < rho.supportMin[0] || x[k] > rho.supportMax[0]
+				|| y[k] < rho.supportMin[1] || y[k] > rho.supportMax[1]
+				|| z[k] < rho.supportMin[2] || z[k] > rho.supportMax[2]) {
+				out[k] = 0;
+			}
+		}
+	}
+}
+
+static void presetInterval(const ChargeDensityFunc& rho, float& lo, float& hi) {
+	switch (rho.preset) {
+	case PRESET_DELTA:
+		lo = rho.value - DELTA_TOLERANCE;
+		hi = rho.value + DELTA_TOLERANCE;
+		break;
+	case PRESET_HEAVISIDE:
+		lo = rho.value;
+		hi = INFINITY;
+		break;
+	default:
+		lo = -INFINITY;
+		hi = rho.value;
+	}
+}
+
+bool densitySupport(const ChargeDensityFunc& rho, Vec3& lo, Vec3& hi) {
+	for (int c = 0; c < 3; c++) {
+		lo[c] = -INFINITY;
+		hi[c] = INFINITY;
+	}
+	if (rho.isPreset) {
+		if (rho.scale == 0) {
+			return false;
+		}
+		float a, b;
+		presetInterval(rho, a, b);
+		// The presets compare the variable at X + offset, so they are
+		// centered on -offset
+		const char* names[] = {"x", "y", "z"};
+		for (int c = 0; c < 3; c++) {
+			if (!strcmp(rho.var, names[c])) {
+				lo[c] = a - rho.offset[c];
+				hi[c] = b - rho.offset[c];
+			}
+		}
+		bool radial = !strcmp(rho.var, "r"), cylindrical = !strcmp(rho.var, "rc");
+		if ((radial || cylindrical) && isfinite(b)) {
+			if (b <= 0) {
+				return false;
+			}
+			for (int c = 0; c < (radial ? 3 : 2); c++) {
+				lo[c] = -rho.offset[c] - b;
+				hi[c] = -rho.offset[c] + b;
+			}
+		}
+	}
+	if (rho.bounded) {
+		for (int c = 0; c < 3; c++) {
+			lo[c] = std::max(lo[c], rho.supportMin[c]);
+			hi[c] = std::min(hi[c], rho.supportMax[c]);
+		}
+	}
+	for (int c = 0; c < 3; c++) {
+		if (!(lo[c] <= hi[c])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool hasPresetField(const ChargeDensityFunc& rho) {
+	if (!rho.isPreset) {
+		return false;
+	}
+	// A box given by the user that cuts into the preset's own support breaks
+	// the symmetry the closed forms rely on
+	if (rho.bounded) {
+		ChargeDensityFunc shape;
+		shape.isPreset = true;
+		shape.scale = rho.scale;
+		shape.preset = rho.preset;
+		memcpy(shape.var, rho.var, sizeof(shape.var));
+		shape.value = rho.value;
+		shape.offset = rho.offset;
+		Vec3 lo, hi;
+		if (densitySupport(shape, lo, hi)) {
+			for (int c = 0; c < 3; c++) {
+				if (lo[c] < rho.supportMin[c] || hi[c] > rho.supportMax[c]) {
+					return false;
+				}
+			}
+		}
+	}
+	if (!strcmp(rho.var, "r") || !strcmp(rho.var, "rc")) {
+		return true;
+	}
+	// Only finite slabs have a finite field
+	return rho.preset == PRESET_DELTA
+		&& (!strcmp(rho.var, "x") || !strcmp(rho.var, "y") || !strcmp(rho.var, "z"));
+}
+
+Vec3 presetField(const ChargeDensityFunc& rho, const Vec3& point) {
+	float lo, hi;
+	presetInterval(rho, lo, hi);
+	Vec3 s;
+	for (int i = 0; i < 3; i++) {
+		s[i] = point[i] + rho.offset[i];
+	}
+	Vec3 E = {{0, 0, 0}};
+	bool cylinder = !strcmp(rho.var, "rc");
+	if (cylinder || !strcmp(rho.var, "r")) {
+		// Field of the charge enclosed by a Gaussian sphere or cylinder
+		lo = std::max(lo, 0.0f);
+		if (cylinder) {
+			s[2] = 0;
+		}
+		float r = sqrtf(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+		if (r == 0) {
+			return E;
+		}
+		float w = std::min(std::max(r, lo), hi);
+		float enclosed, magnitude;
+		if (cylinder) {
+			enclosed = rho.scale * 2 * (float)M_PI * (w * w - lo * lo);
+			magnitude = enclosed / r;
+		} else {
+			enclosed = rho.scale * 4.0f / 3 * (float)M_PI * (w * w * w - lo * lo * lo);
+			magnitude = enclosed / (r * r);
+		}
+		for (int i = 0; i < 3; i++) {
+			E[i] = magnitude * s[i] / r;
+		}
+	} else {
+		int axis = rho.var[0] - 'x';
+		float w = std::min(std::max(s[axis], lo), hi);
+		E[axis] = rho.scale * 2 * (float)M_PI * ((w - lo) - (hi - w));
+	}
+	return E;
+}
+
+// Calls emit(value, x, y, z) for the center of every voxel where the
+// density is nonzero
+template <typename F>
+static void sampleVoxels(const ChargeDensityFunc& rho, const Vec3& lo, const Vec3& hi,
+	int voxelsPerUnit, Vec3& h, F emit) {
+	int n[3];
+	for (int i = 0; i < 3; i++) {
+		n[i] = std::max(1, (int)(voxelsPerUnit * (hi[i] - lo[i])));
+		h[i] = (hi[i] - lo[i]) / n[i];
+	}
+	// Range of voxels whose centers lie in the support, widened by one voxel
+	// on each side so rounding can't drop a nonzero voxel at its edge
+	Vec3 slo, shi;
+	if (!densitySupport(rho, slo, shi)) {
+		return;
+	}
+	int first[3], last[3];
+	for (int i = 0; i < 3; i++) {
+		double a = std::max((slo[i] - lo[i]) / h[i] - 0.5, -1.0);
+		double b = std::min((shi[i] - lo[i]) / h[i] - 0.5, (double)n[i]);
+		first[i] = std::max(0, (int)ceil(a) - 1);
+		last[i] = std::min(n[i] - 1, (int)floor(b) + 1);
+		if (first[i] > last[i]) {
+			return;
+		}
+	}
+	int count = last[0] - first[0] + 1;
+	profiler.count("density-evaluations", (double)count * (last[1] - first[1] + 1) * (last[2] - first[2] + 1));
+	std::vector<float> x(count), y(count), z(count), value(count);
+	for (int i = 0; i < count; i++) {
+		x[i] = lo[0] + (first[0] + i + 0.5f) * h[0];
+	}
+	for (int k = first[2]; k <= last[2]; k++) {
+		for (int j = first[1]; j <= last[1]; j++) {
+			std::fill(y.begin(), y.end(), lo[1] + (j + 0.5f) * h[1]);
+			std::fill(z.begin(), z.end(), lo[2] + (k + 0.5f) * h[2]);
+			evaluateDensity(rho, x.data(), y.data(), z.data(), count, value.data());
+			for (int i = 0; i < count; i++) {
+				if (value[i] != 0 && !isnan(value[i])) {
+					emit(value[i], x[i], y[i], z[i]);
+				}
+			}
+		}
+	}
+}
+
+void rasterizeDensity(const ChargeDensityFunc& rho, const Vec3& lo, const Vec3& hi,
+	int voxelsPerUnit, std::vector<Vec4>& charges) {
+	Vec3 h;
+	sampleVoxels(rho, lo, hi, voxelsPerUnit, h, [&](float value, float x, float y, float z) {
+		Vec4 charge = {{value * h[0] * h[1] * h[2], x, y, z}};
+		charges.push_back(charge);
+	});
+}
+
+void rasterizeCurrentDensity(const CurrentDensityFunc& J, const Vec3& lo, const Vec3& hi,
+	int voxelsPerUnit, std::vector<Segment>& segments) {
+	const Vec3& d = J.direction;
+	float norm = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+	if (norm == 0) {
+		return;
+	}
+	Vec3 h;
+	sampleVoxels(J, lo, hi, voxelsPerUnit, h, [&](float value, float x, float y, float z) {
+		// Segment of length L through the voxel center with I * L = |J| dV
+		float L = std::min(h[0], std::min(h[1], h[2]));
+		float I = value * norm * h[0] * h[1] * h[2] / L;
+		float s = L / (2 * norm);
+		Segment segment = {{I, x - s * d[0], y - s * d[1], z - s * d[2], x + s * d[0], y + s * d[1], z + s * d[2]}};
+		segments.push_back(segment);
+	});
+}
+
+void appendLoopSegments(const Loop& loop, std::vector<Segment>& segments) {
+	Vec3 n = {{loop[4], loop[5], loop[6]}};
+	float norm = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	if (norm == 0 || loop[7] <= 0) {
+		return;
+	}
+	for (int i = 0; i < 3; i++) {
+		n[i] /= norm;
+	}
+	// e1 = n x (x or y axis), e2 = n x e1 so that (e1, e2, n) is right-handed
+	Vec3 e1;
+	if (fabsf(n[0]) < 0.9f) {
+		e1 = {{0, n[2], -n[1]}};
+	} else {
+		e1 = {{-n[2], 0, n[0]}};
+	}
+	float l = sqrtf(e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2]);
+	for (int i = 0; i < 3; i++) {
+		e1[i] /= l;
+	}
+	Vec3 e2 = {{n[1] * e1[2] - n[2] * e1[1], n[2] * e1[0] - n[0] * e1[2], n[0] * e1[1] - n[1] * e1[0]}};
+	float R = loop[7];
+	Vec3 prev = {{0, 0, 0}};
+	for (int k = 0; k <= LOOP_SEGMENTS; k++) {
+		float t = 2 * (float)M_PI * k / LOOP_SEGMENTS;
+		Vec3 p;
+		for (int i = 0; i < 3; i++) {
+			p[i] = loop[1 + i] + R * (cosf(t) * e1[i] + sinf(t) * e2[i]);
+		}
+		if (k > 0) {
+			Segment segment = {{loop[0], prev[0], prev[1], prev[2], p[0], p[1], p[2]}};
+			segments.push_back(segment);
+		}
+		prev = p;
+	}
+}
@@ -0,0 +1,88 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef DENSITY_H
+#define DENSITY_H
+
+#include "expression.h"
+#include "field.h"
+
+#define PRESET_DELTA 0
+#define PRESET_HEAVISIDE 1
+#define PRESET_REVERSE_HEAVISIDE 2
+
+// Half width of the region where the delta preset is nonzero
+#define DELTA_TOLERANCE 0.01f
+
+struct ChargeDensityFunc {
+	bool isPreset = true;
+	float scale = 1;
+	union {
+		int preset = 0;
+		char func[100];
+	};
+	char var[5] = "r";
+	float value = 1;
+	Vec3 offset = {{0, 0, 0}};
+	// Optional box given by the user outside of which the density is zero
+	bool bounded = false;
+	Vec3 supportMin = {{0, 0, 0}};
+	Vec3 supportMax = {{0, 0, 0}};
+	// Compiled custom function
+	Expression expr;
+};
+
+// Current density J = rho * direction, where rho is a charge density
+// function as above
+struct CurrentDensityFunc : ChargeDensityFunc {
+	Vec3 direction = {{0, 0, 1}};
+};
+
+// Circular current loop (I, x, y, z, nx, ny, nz, radius) around the center
+// (x, y, z); the current circulates counterclockwise about the normal
+using Loop = std::array<float, 8>;
+
+// Number of straight segments approximating a current loop
+#define LOOP_SEGMENTS 64
+
+// Density at each of the given points, as evaluated by the visualizer
+void evaluateDensity(const ChargeDensityFunc& rho, const float* x, const float* y,
+	const float* z, size_t count, float* out);
+
+// Box outside of which the density is zero, from the shape of a preset and
+// the user's box; unbounded sides are infinite. Returns false if the density
+// is zero everywhere.
+bool densitySupport(const ChargeDensityFunc& rho, Vec3& lo, Vec3& hi);
+
+// Closed-form field of a preset density (see Visualizer/analytic.py).
+// Returns false if the preset has none, or if the user's box cuts into the
+// preset's own support.
+bool hasPresetField(const ChargeDensityFunc& rho);
+Vec3 presetField(const ChargeDensityFunc& rho, const Vec3& point);
+
+// Samples the density at the centers of a voxel lattice spanning [lo, hi]
+// and appends a point charge rho * dV for every nonzero voxel. Only the
+// voxels within the density's support are evaluated.
+void rasterizeDensity(const ChargeDensityFunc& rho, const Vec3& lo, const Vec3& hi,
+	int voxelsPerUnit, std::vector<Vec4>& charges);
+
+// Same for a current density, appending a short segment along the current
+// direction carrying J * dV for every nonzero voxel
+void rasterizeCurrentDensity(const CurrentDensityFunc& J, const Vec3& lo, const Vec3& hi,
+	int voxelsPerUnit, std::vector<Segment>& segments);
+
+void appendLoopSegments(const Loop& loop, std::vector<Segment>& segments);
+
+#endif
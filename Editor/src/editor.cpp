@@ -19,19 +19,126 @@ void glfwErrorCallback(int error, const char* description) {
 	fprintf(stderr, "GLFW error %d: %s\n", error, description);
 }
 
-void readParameters(const char* filename) {
+bool readDensity(const nlohmann::json& rho, ChargeDensityFunc& density) {
+	density.isPreset = rho["preset"];
+	if (density.isPreset) {
+		density.scale = rho["scale"];
+		density.value = rho["value"];
+		density.preset = rho["func"];
+		const std::string& var = rho["var"].get_ref<const std::string&>();
+		if (var.length() < 5) {
+			std::copy(var.begin(), var.end(), density.var);
+			density.var[var.length()] = 0;
+		} else {
+			return false;
+		}
+		if (rho.contains("offset")) {
+			density.offset = rho["offset"].get<Vec3>();
+		}
+	} else {
+		const std::string& func = rho["func"].get_ref<const std::string&>();
+		if (func.length() < 100) {
+			std::copy(func.begin(), func.end(), density.func);
+			density.func[func.length()] = 0;
+			density.expr.compile(density.func);
+		} else {
+			return false;
+		}
+	}
+	density.bounded = rho.contains("support");
+	if (density.bounded) {
+		density.supportMin = rho["support"]["min"].get<Vec3>();
+		density.supportMax = rho["support"]["max"].get<Vec3>();
+	}
+	return true;
+}
+
+nlohmann::json writeDensity(const ChargeDensityFunc& rho) {
+	nlohmann::json density;
+	density["preset"] = rho.isPreset;
+	if (rho.isPreset) {
+		density["scale"] = rho.scale;
+		density["func"] = rho.preset;
+		density["var"] = rho.var;
+		density["value"] = rho.value;
+		if (rho.offset[0] != 0 || rho.offset[1] != 0 || rho.offset[2] != 0) {
+			density["offset"] = rho.offset;
+		}
+	} else {
+		density["func"] = rho.func;
+	}
+	if (rho.bounded) {
+		density["support"] = {{"min", rho.supportMin}, {"max", rho.supportMax}};
+	}
+	return density;
+}
+
+// Bounds of the charges, current segments and loop centers, as inferred by
+// the visualizer
+void inferSceneBounds(Vec3& min, Vec3& max) {
+	ProfileScope stage("infer-bounds");
+	inferBounds(charges, min, max);
+	// Called every frame by the preview, so the other points are added in
+	// place instead of being copied into one list
+	bool any = !charges.empty();
+	auto add = [&](const float* p) {
+		for (int i = 0; i < 3; i++) {
+			min[i] = any ? std::min(min[i], p[i]) : p[i];
+			max[i] = any ? std::max(max[i], p[i]) : p[i];
+		}
+		any = true;
+	};
+	for (const Segment& segment : currents) {
+		add(segment.data() + 1);
+		add(segment.data() + 4);
+	}
+	for (const Loop& loop : currentLoops) {
+		add(loop.data() + 1);
+	}
+}
+
+// Reads a list of fixed length rows of numbers (e.g. the line currents)
+template <typename T>
+void readRows(const nlohmann::json& params, const char* key, std::vector<T>& rows) {
+	rows.clear();
+	if (!params.contains(key)) {
+		return;
+	}
+	const nlohmann::json& list = params[key];
+	rows.reserve(list.size());
+	for (const nlohmann::json& row : list) {
+		rows.emplace_back();
+		T& item = rows.back();
+		for (size_t i = 0; i < item.size() && i < row.size(); i++) {
+			item[i] = row[i].get<float>();
+		}
+	}
+}
+
+bool readParameters(const char* filename) {
+	ProfileScope stage("read-config");
 	nlohmann::json params;
-	std::ifstream ifs(filename);
-	if (!ifs.is_open()) {
+	FILE* file = fopen(filename, "rb");
+	if (!file) {
 		sprintf(ioMessage, "Failed to open %s for reading", filename);
-		return;
+		return false;
 	}
-	ifs >> params;
-	ifs.close();
+	std::string error;
+	bool ok = readConfig(file, isBinaryConfig(filename), params, charges, error);
+	fclose(file);
+	if (!ok) {
+		snprintf(ioMessage, sizeof(ioMessage), "Failed to parse %s: %s", filename, error.c_str());
+		return false;
+	}
+	profiler.count("charges", (double)charges.size());
+	chargeView.reset();
+	densityView.reset();
+	currentView.reset();
+	loopView.reset();
+	currentDensityView.reset();
 
 	if (params.contains("plot-margins")) {
-		std::vector<float> margins = params["plot-margins"].get<std::vector<float>>();
-		std::copy_n(margins.begin(), 3, plotMargins.begin());
+		plotMargins = params["plot-margins"].get<Vec3>();
 	}
 	if (params.contains("e-field") && params["e-field"].contains("plot")) {
 		plotEField = params["e-field"]["plot"];
@@ -43,73 +150,126 @@ void readParameters(const char* filename) {
 		planeAxis = params["plane"]["axis"];
 		planeCoordinate = params["plane"]["coordinate"];
 	}
+	if (params.contains("volume")) {
+		volumeMode = true;
+		volumeSlices = params["volume"].value("slices", 10);
+		volumeSpacing = params["volume"].value("spacing", 0.0f);
+	} else {
+		volumeMode = false;
+	}
 	if (params.contains("show")) {
 		showPlots = params["show"];
 	}
+	sweepParams = params.value("sweep", nlohmann::json());
 	if (params.contains("plot-bounds")) {
-		std::vector<float> minBounds = params["plot-bounds"]["min"].get<std::vector<float>>();
-		std::copy_n(minBounds.begin(), 3, plotBounds.min.begin());
-		std::vector<float> maxBounds = params["plot-bounds"]["max"].get<std::vector<float>>();
-		std::copy_n(maxBounds.begin(), 3, plotBounds.max.begin());
+		plotBounds.min = params["plot-bounds"]["min"].get<Vec3>();
+		plotBounds.max = params["plot-bounds"]["max"].get<Vec3>();
 		inferPlotBounds = false;
 	} else {
 		inferPlotBounds = true;
 	}
-	charges.clear();
-	if (params.contains("charges")) {
-		DVecF jsonCharges = params["charges"].get<DVecF>();
-		for (auto it : jsonCharges) {
-			Vec4 charge;
-			std::copy_n(it.begin(), 4, charge.begin());
-			charges.push_back(charge);
-		}
-	}
 	if (params.contains("resolution")) {
 		resolution = params["resolution"];
 	}
+	if (params.contains("solver")) {
+		std::string name = params["solver"];
+		for (int i = 0; i < SOLVER_COUNT; i++) {
+			if (name == solverNames[i]) {
+				solver = i;
+			}
+		}
+	}
+	if (params.contains("opening-angle")) {
+		openingAngle = params["opening-angle"];
+	}
+	precision = PRECISION_SINGLE;
+	for (int i = 0; i < PRECISION_COUNT; i++) {
+		if (params.value("precision", "single") == std::string(precisionNames[i])) {
+			precision = i;
+		}
+	}
+	symmetryMode = SYMMETRY_AUTO;
+	declaredSymmetry = Symmetry();
+	if (params.contains("symmetry")) {
+		const nlohmann::json& symmetry = params["symmetry"];
+		if (symmetry.is_object()) {
+			symmetryMode = SYMMETRY_DECLARED;
+			const char* axes[] = {"x", "y", "z"};
+			for (int a = 0; a < 3; a++) {
+				int parity = symmetry.value(axes[a], 0);
+				declaredSymmetry.mirror[a] = (parity > 0) - (parity < 0);
+			}
+			int parity = symmetry.value("rotation", 0);
+			declaredSymmetry.rotation = (parity > 0) - (parity < 0);
+		} else if (symmetry == "none") {
+			symmetryMode = SYMMETRY_NONE;
+		}
+	}
+	sampling = SAMPLING_UNIFORM;
+	for (int i = 0; i < SAMPLING_COUNT; i++) {
+		if (params.value("sampling", "uniform") == std::string(samplingNames[i])) {
+			sampling = i;
+		}
+	}
+	adaptiveOptions.tolerance = params.value("error-budget", AdaptiveOptions().tolerance);
+	adaptiveOptions.maxDepth = params.value("max-depth", AdaptiveOptions().maxDepth);
+	if (params.contains("density-method")) {
+		std::string name = params["density-method"];
+		for (int i = 0; i < DENSITY_METHOD_COUNT; i++) {
+			if (name == densityMethods[i]) {
+				densityMethod = i;
+			}
+		}
+	}
+	if (params.contains("voxel-resolution")) {
+		voxelResolution = params["voxel-resolution"];
+	}
 	if (params.contains("colormap")) {
 		colormap = params["colormap"];
 		if (colormap.length() < 50) {
 			std::copy(colormap.begin(), colormap.end(), colormapbuf);
 		}
 	}
+	// The sources are parsed in place into the lists, without temporary
+	// copies of the json elements or of the parsed items
 	chargeDensities.clear();
 	if (params.contains("charge-densities")) {
-		for (auto rho : params["charge-densities"]) {
-			ChargeDensityFunc density;
-			density.isPreset = rho["preset"];
-			if (density.isPreset) {
-				density.scale = rho["scale"];
-				density.value = rho["value"];
-				density.preset = rho["func"];
-				std::string var = rho["var"];
-				if (var.length() < 5) {
-					std::copy(var.begin(), var.end(), density.var);
-				} else {
-					continue;
-				}
-				if (rho.contains("offset")) {
-					density.offset = rho["offset"].get<Vec3>();
-				}
-			} else {
-				std::string func = rho["func"];
-				if (func.length() < 100) {
-					std::copy(func.begin(), func.end(), density.func);
-				} else {
-					continue;
-				}
+		const nlohmann::json& list = params["charge-densities"];
+		chargeDensities.reserve(list.size());
+		for (const nlohmann::json& rho : list) {
+			chargeDensities.emplace_back();
+			if (!readDensity(rho, chargeDensities.back())) {
+				chargeDensities.pop_back();
+			}
+		}
+	}
+	readRows(params, "currents", currents);
+	readRows(params, "current-loops", currentLoops);
+	currentDensities.clear();
+	if (params.contains("current-densities")) {
+		const nlohmann::json& list = params["current-densities"];
+		currentDensities.reserve(list.size());
+		for (const nlohmann::json& J : list) {
+			currentDensities.emplace_back();
+			CurrentDensityFunc& density = currentDensities.back();
+			if (!readDensity(J, density)) {
+				currentDensities.pop_back();
+			} else if (J.contains("direction")) {
+				density.direction = J["direction"].get<Vec3>();
 			}
-			chargeDensities.push_back(density);
 		}
 	}
+
 	sprintf(ioMessage, "Read configuration from %s", filename);
+	return true;
 }
 
-void writeParameters(const char* filename) {
-	std::ofstream ofs(filename);
-	if (!ofs.is_open()) {
+bool writeParameters(const char* filename) {
+	ProfileScope stage("write-config");
+	FILE* file = fopen(filename, "wb");
+	if (!file) {
 		sprintf(ioMessage, "Failed to open %s for writing", filename);
-		return;
+		return false;
 	}
 	colormap = std::string(colormapbuf);
 	nlohmann::json params = {
@@ -122,43 +282,581 @@ void writeParameters(const char* filename) {
 		},
 		{"show", showPlots},
 		{"resolution", resolution},
+		{"solver", solverNames[solver]},
+		{"opening-angle", openingAngle},
+		// Always written, as the visualizer defaults to double precision
+		{"precision", precisionNames[precision]},
+		{"density-method", densityMethods[densityMethod]},
+		{"voxel-resolution", voxelResolution},
 		{"colormap", colormap}
 	};
+	if (sampling != SAMPLING_UNIFORM) {
+		params["sampling"] = samplingNames[sampling];
+	}
+	if (symmetryMode == SYMMETRY_NONE) {
+		params["symmetry"] = "none";
+	} else if (symmetryMode == SYMMETRY_DECLARED) {
+		params["symmetry"] = {
+			{"x", declaredSymmetry.mirror[0]},
+			{"y", declaredSymmetry.mirror[1]},
+			{"z", declaredSymmetry.mirror[2]},
+			{"rotation", declaredSymmetry.rotation}
+		};
+	}
+	if (sampling == SAMPLING_ADAPTIVE) {
+		params["error-budget"] = adaptiveOptions.tolerance;
+		params["max-depth"] = adaptiveOptions.maxDepth;
+	}
+	if (!sweepParams.is_null()) {
+		params["sweep"] = sweepParams;
+	}
+	if (volumeMode) {
+		params["volume"] = {{"slices", volumeSlices}};
+		if (volumeSpacing > 0) {
+			params["volume"]["spacing"] = volumeSpacing;
+		}
+	}
 	if (!inferPlotBounds) {
 		params["plot-bounds"] = {
 			{"min", plotBounds.min},
 			{"max", plotBounds.max}
 		};
 	}
-	if (charges.size() > 0) {
-		params["charges"] = charges;
-	}
 	if (chargeDensities.size() > 0) {
 		nlohmann::json densities;
-		for (auto rho : chargeDensities) {
-			nlohmann::json density;
-			density["preset"] = rho.isPreset;
-			if (rho.isPreset) {
-				density["scale"] = rho.scale;
-				density["func"] = rho.preset;
-				density["var"] = rho.var;
-				density["value"] = rho.value;
-				if (rho.offset[0] != 0 || rho.offset[1] != 0 || rho.offset[2] != 0) {
-					density["offset"] = rho.offset;
-				}
-			} else {
-				density["func"] = rho.func;
-			}
-			densities.push_back(density);
+		for (const ChargeDensityFunc& rho : chargeDensities) {
+			densities.push_back(writeDensity(rho));
 		}
 		params["charge-densities"] = densities;
 	}
-	ofs << params.dump(4);
-	ofs.close();
+	if (currents.size() > 0) {
+		params["currents"] = currents;
+	}
+	if (currentLoops.size() > 0) {
+		params["current-loops"] = currentLoops;
+	}
+	if (currentDensities.size() > 0) {
+		nlohmann::json densities;
+		for (const CurrentDensityFunc& J : currentDensities) {
+			nlohmann::json density = writeDensity(J);
+			density["direction"] = J.direction;
+			densities.push_back(density);
+		}
+		params["current-densities"] = densities;
+	}
+	// Cache key for the visualizer, computed with the bounds it will infer
+	nlohmann::json physics = params;
+	if (inferPlotBounds) {
+		Vec3 min, max;
+		inferSceneBounds(min, max);
+		physics["plot-bounds"] = {{"min", min}, {"max", max}};
+	}
+	params["hash"] = configHash(physics, &charges);
+	bool ok = writeConfig(file, isBinaryConfig(filename), params, charges);
+	if (fclose(file) != 0 || !ok) {
+		sprintf(ioMessage, "Failed to write configuration to %s", filename);
+		return false;
+	}
 	sprintf(ioMessage, "Wrote configuration to %s", filename);
+	return true;
+}
+
+FieldJob currentJob() {
+	FieldJob job;
+	job.charges = &charges;
+	job.densities = &chargeDensities;
+	job.currents = &currents;
+	job.loops = &currentLoops;
+	job.currentDensities = &currentDensities;
+	job.axis = planeAxis;
+	job.coordinate = planeCoordinate;
+	job.min = plotBounds.min;
+	job.max = plotBounds.max;
+	if (inferPlotBounds) {
+		inferSceneBounds(job.min, job.max);
+	}
+	job.margins = plotMargins;
+	job.resolution = resolution;
+	job.solver = solver;
+	job.openingAngle = openingAngle;
+	job.voxelResolution = voxelResolution;
+	job.precision = precision;
+	job.symmetryMode = symmetryMode;
+	job.symmetry = declaredSymmetry;
+	return job;
 }
 
-int main() {
+// Routes the direct summation of the charges to the GPU backend if enabled;
+// the shaders only sum in single precision
+void attachGpu(FieldSources& sources) {
+	if (!useGpu || !gpuField.ready() || sources.solver == SOLVER_BARNES_HUT
+		|| sources.charges.precision != PRECISION_SINGLE) {
+		return;
+	}
+	gpuField.upload(sources.charges);
+	sources.chargeBackend = [](const PlaneGrid& grid, FieldBuffer& field) {
+		return gpuField.evaluate(grid, field);
+	};
+}
+
+// Creates a hidden window whose context runs the compute shaders in
+// headless mode
+GLFWwindow* createComputeContext() {
+	if (!glfwInit()) {
+		return nullptr;
+	}
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	GLFWwindow* window = glfwCreateWindow(1, 1, "", NULL, NULL);
+	if (!window) {
+		glfwTerminate();
+		return nullptr;
+	}
+	glfwMakeContextCurrent(window);
+	// Core profiles need the experimental loader on older GLEW versions
+	glewExperimental = GL_TRUE;
+	if (glewInit() != GLEW_OK || !gpuField.init()) {
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return nullptr;
+	}
+	return window;
+}
+
+// Evaluates the fields coarse to fine; with a name, the images of the
+// fields interpolated from each level but the last are written as soon as
+// the level is done
+void sampleProgressive(const FieldSources& sources, const PlaneGrid& grid, FieldBuffer* efield,
+	FieldBuffer* bfield, const std::string* name) {
+	TaskPool& pool = TaskPool::shared();
+	ProgressivePlane plane;
+	plane.build(grid);
+	FieldBuffer* fields[] = {efield, bfield};
+	for (FieldBuffer* field : fields) {
+		if (field) {
+			field->resize(grid.width(), grid.height());
+		}
+	}
+	const char* kinds = "EB";
+	FieldBuffer coarse;
+	for (int level = 0; level < plane.levels(); level++) {
+		ProfileScope stage("progressive");
+		plane.evaluate(level, sources, efield, bfield, pool);
+		printf("Progressive sampling at %g: level %d of %d (stride %zu), %zu evaluations\n",
+			grid.coordinate, level + 1, plane.levels(), plane.stride(level), plane.evaluations(level));
+		if (!name || level == plane.levels() - 1) {
+			continue;
+		}
+		for (int f = 0; f < 2; f++) {
+			if (!fields[f]) {
+				continue;
+			}
+			plane.interpolate(level, *fields[f], coarse);
+			std::string image = *name + " " + kinds[f] + "-Field.ppm";
+			writeFieldImage(image.c_str(), grid, coarse);
+		}
+		fflush(stdout);
+	}
+}
+
+// Evaluates the fields on the grid at every point, through an adaptive
+// quadtree or coarse to fine
+void sampleFields(const FieldSources& sources, const PlaneGrid& grid, FieldBuffer* efield,
+	FieldBuffer* bfield, const std::string* name = nullptr) {
+	TaskPool& pool = TaskPool::shared();
+	if (sampling == SAMPLING_PROGRESSIVE) {
+		sampleProgressive(sources, grid, efield, bfield, name);
+		return;
+	}
+	if (sampling != SAMPLING_ADAPTIVE) {
+		evaluateSources(sources, grid, efield, bfield, pool);
+		return;
+	}
+	AdaptivePlane plane;
+	plane.build(sources, grid, efield != nullptr, bfield != nullptr, adaptiveOptions, pool);
+	plane.resample(grid, efield, bfield, pool);
+	printf("Adaptive sampling at %g: %zu evaluations in %zu cells (uniform grid has %zu points)\n",
+		grid.coordinate, plane.evaluations(), plane.leafCount(), grid.width() * grid.height());
+}
+
+// Prints the symmetry used, or that the point evaluations of adaptive and
+// progressive sampling go without the GPU backend and the symmetry
+void reportSampling(const FieldSources& sources) {
+	bool gpu = (bool)sources.chargeBackend;
+	bool symmetric = sources.symmetry.any();
+	if (sampling == SAMPLING_UNIFORM) {
+		if (symmetric) {
+			char buf[64];
+			sources.symmetry.describe(buf, sizeof(buf));
+			printf("Symmetry: %s\n", buf);
+		}
+		return;
+	}
+	if (gpu || symmetric) {
+		printf("With %s sampling the fields are evaluated on the CPU without %s\n", samplingNames[sampling],
+			gpu && symmetric ? "the GPU backend or the symmetry" : gpu ? "the GPU backend" : "the symmetry");
+	}
+}
+
+// Evaluates the volume slab by slab, streaming each slab to the output files
+// so that only one slab per field is held in memory
+int runVolume(FieldJob& job, const std::string& name, const char* filename) {
+	std::vector<float> slabs = volumeSlabs(job, volumeSlices, volumeSpacing);
+	if (slabs.empty()) {
+		fprintf(stderr, "Volume of %s has no slices\n", filename);
+		return 1;
+	}
+	FieldSources sources;
+	sources.build(job, plotEField, plotBField);
+	attachGpu(sources);
+	reportSampling(sources);
+	const char* kinds = "EB";
+	bool plot[] = {plotEField, plotBField};
+	FieldFileWriter writers[2];
+	FieldBuffer fields[2];
+	PlaneGrid grid;
+	for (size_t k = 0; k < slabs.size(); k++) {
+		ProfileScope slab("slab");
+		job.coordinate = slabs[k];
+		buildGrid(job, grid);
+		for (int f = 0; f < 2; f++) {
+			if (!plot[f]) {
+				continue;
+			}
+			fields[f].resize(grid.width(), grid.height());
+			std::string data = name + " " + kinds[f] + "-Volume.emf";
+			if (k == 0 && !writers[f].open(data.c_str(), grid, kinds[f], slabs)) {
+				fprintf(stderr, "Failed to write output for %s\n", filename);
+				return 1;
+			}
+		}
+		sampleFields(sources, grid, plotEField ? &fields[0] : nullptr, plotBField ? &fields[1] : nullptr);
+		ProfileScope stage("write-output");
+		for (int f = 0; f < 2; f++) {
+			if (plot[f] && !writers[f].write(fields[f])) {
+				fprintf(stderr, "Failed to write output for %s\n", filename);
+				return 1;
+			}
+		}
+	}
+	for (int f = 0; f < 2; f++) {
+		if (plot[f] && !writers[f].close()) {
+			fprintf(stderr, "Failed to write output for %s\n", filename);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Streamline plot of a field like the visualizer's, drawn natively
+bool writeFieldPlot(const char* filename, const PlaneGrid& grid, const FieldBuffer& field, bool magnetic) {
+	const char* name = colormap.empty() ? "cool" : colormap.c_str();
+	int map = findColormap(name);
+	if (map < 0) {
+		fprintf(stderr, "Colormap %s is not available natively; using cool\n", name);
+		map = 0;
+	}
+	std::vector<float> marks, lines;
+	for (const Vec4& charge : charges) {
+		marks.insert(marks.end(), {charge[0], charge[1 + grid.axis1], charge[1 + grid.axis2]});
+	}
+	if (magnetic) {
+		std::vector<Segment> segments = currents;
+		for (const Loop& loop : currentLoops) {
+			appendLoopSegments(loop, segments);
+		}
+		for (const Segment& s : segments) {
+			lines.insert(lines.end(), {s[1 + grid.axis1], s[1 + grid.axis2], s[4 + grid.axis1], s[4 + grid.axis2]});
+		}
+	}
+	const std::vector<float>* comps[] = {&field.x, &field.y, &field.z};
+	return writeStreamplot(filename, grid.u.front(), grid.u.back(), grid.v.front(), grid.v.back(),
+		grid.width(), grid.height(), comps[grid.axis1]->data(), comps[grid.axis2]->data(), nullptr,
+		map, marks, lines, TaskPool::shared());
+}
+
+// Prints the largest relative error of the point charge field on a subset of
+// the grid against a double precision reference
+void reportPrecision(const FieldSources& sources, const PlaneGrid& grid) {
+	if (sources.solver == SOLVER_BARNES_HUT) {
+		printf("The precision check needs direct summation\n");
+		return;
+	}
+	ProfileScope stage("precision-check");
+	size_t samples = std::min(grid.size(), (size_t)PRECISION_SAMPLES);
+	profiler.count("points", (double)samples);
+	profiler.count("interactions", (double)samples * sources.charges.count);
+	double error = chargeFieldError(sources.charges, grid, samples);
+	printf("Precision %s: max relative error %.3g of the point charge field at %zu samples (double precision reference)\n",
+		precisionNames[sources.charges.precision], error, samples);
+}
+
+int runHeadless(const char* filename, const char* prefix, bool text, bool plots, bool check) {
+	if (!readParameters(filename)) {
+		fprintf(stderr, "%s\n", ioMessage);
+		return 1;
+	}
+	std::string name = prefix ? prefix : std::string(filename);
+	if (!prefix && name.rfind('.') != std::string::npos) {
+		name = name.substr(0, name.rfind('.'));
+	}
+	FieldJob job = currentJob();
+	if (volumeMode) {
+		return runVolume(job, name, filename);
+	}
+	PlaneGrid grid;
+	buildGrid(job, grid);
+	FieldBuffer efield, bfield;
+	FieldSources sources;
+	sources.build(job, plotEField, plotBField);
+	attachGpu(sources);
+	reportSampling(sources);
+	sampleFields(sources, grid, plotEField ? &efield : nullptr, plotBField ? &bfield : nullptr, &name);
+	if (check && plotEField) {
+		reportPrecision(sources, grid);
+	}
+	ProfileScope stage("write-output");
+	const char* kinds = "EB";
+	const FieldBuffer* fields[] = {&efield, &bfield};
+	bool plot[] = {plotEField, plotBField};
+	for (int f = 0; f < 2; f++) {
+		if (!plot[f]) {
+			continue;
+		}
+		std::string base = name + " " + kinds[f] + "-Field";
+		std::string data = base + ".emf";
+		std::string image = base + ".ppm";
+		bool ok = writeFieldFile(data.c_str(), grid, *fields[f], kinds[f])
+			&& writeFieldImage(image.c_str(), grid, *fields[f]);
+		if (text) {
+			std::string table = base + ".dat";
+			ok = ok && writeFieldText(table.c_str(), grid, *fields[f]);
+		}
+		if (plots) {
+			std::string plot = base + ".png";
+			ok = ok && writeFieldPlot(plot.c_str(), grid, *fields[f], f == 1);
+		}
+		if (!ok) {
+			fprintf(stderr, "Failed to write output for %s\n", filename);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int renderFieldFile(const char* filename) {
+	MappedField mapped;
+	if (!mapped.open(filename)) {
+		fprintf(stderr, "Failed to read field data from %s\n", filename);
+		return 1;
+	}
+	std::string image(filename);
+	if (image.rfind('.') != std::string::npos) {
+		image = image.substr(0, image.rfind('.'));
+	}
+	image += ".ppm";
+	bool ok;
+	const FieldFileHeader& info = mapped.info();
+	if (mapped.u()) {
+		ok = writeFieldImage(image.c_str(), mapped.width(), mapped.height(),
+			mapped.component(info.axis1), mapped.component(info.axis2));
+	} else {
+		PlaneGrid grid;
+		FieldBuffer field;
+		ok = mapped.read(grid, field) && writeFieldImage(image.c_str(), grid, field);
+	}
+	if (!ok) {
+		fprintf(stderr, "Failed to write %s\n", image.c_str());
+		return 1;
+	}
+	return 0;
+}
+
+// Writes the recorded stages to the files requested on the command line
+bool writeProfile(const char* report, const char* trace) {
+	bool ok = true;
+	if (report && !profiler.writeReport(report, "config-editor")) {
+		fprintf(stderr, "Failed to write profile to %s\n", report);
+		ok = false;
+	}
+	if (trace && !profiler.writeTrace(trace, "config-editor")) {
+		fprintf(stderr, "Failed to write trace to %s\n", trace);
+		ok = false;
+	}
+	return ok;
+}
+
+// Stage times and counters, indented by nesting level
+// Whether the stage is one the editor opens every frame, i.e. the preview
+// or the bounds inference, with no stage nested in it
+bool idleStage(const std::vector<ProfileStage>& stages, size_t i) {
+	const ProfileStage& stage = stages[i];
+	if (stage.name != "preview" && stage.name != "infer-bounds") {
+		return false;
+	}
+	for (size_t j = i + 1; j < stages.size(); j++) {
+		if (stages[j].thread == stage.thread) {
+			return stages[j].depth <= stage.depth;
+		}
+	}
+	return true;
+}
+
+// Replaces the stages shown in the overlay with the ones recorded since the
+// last clear, minus the idle ones, if anything was computed
+void keepProfile() {
+	profiler.copyStages(frameProfile);
+	size_t kept = 0;
+	for (size_t i = 0; i < frameProfile.size(); i++) {
+		if (!idleStage(frameProfile, i)) {
+			if (kept != i) {
+				std::swap(frameProfile[kept], frameProfile[i]);
+			}
+			kept++;
+		}
+	}
+	if (kept > 0) {
+		frameProfile.resize(kept);
+		lastProfile.swap(frameProfile);
+	}
+}
+
+void drawProfile(const std::vector<ProfileStage>& stages) {
+	ImGui::SetNextWindowPos(ImVec2(710, 10), ImGuiCond_FirstUseEver);
+	if (ImGui::Begin("Profile", &showProfile, ImGuiWindowFlags_AlwaysAutoResize)) {
+		if (stages.empty()) {
+			ImGui::TextDisabled("Nothing computed yet");
+		}
+		for (const ProfileStage& stage : stages) {
+			// Formatted into a fixed buffer, since this is drawn every frame
+			char line[512];
+			int length = snprintf(line, sizeof(line), "%*s%-20s %9.3f ms", 2 * stage.depth, "",
+				stage.name.c_str(), stage.seconds * 1e3);
+			for (const auto& counter : stage.counters) {
+				if (length < 0 || (size_t)length >= sizeof(line)) {
+					break;
+				}
+				length += snprintf(line + length, sizeof(line) - length, "  %s %.4g", counter.first.c_str(), counter.second);
+			}
+			ImGui::TextUnformatted(line);
+		}
+		ImGui::TextDisabled("Peak memory %.1f MB", peakMemory() / 1e6);
+	}
+	ImGui::End();
+}
+
+// One line summary of a density for lists
+void describeDensity(const ChargeDensityFunc& rho, char* buf, size_t size) {
+	if (rho.isPreset) {
+		snprintf(buf, size, "%g * (%s %s %g), offset (%g, %g, %g)", rho.scale, rho.var,
+			rho.preset >= 0 && rho.preset < PRESET_COUNT ? presetSymbols[rho.preset] : "?", rho.value, rho.offset[0], rho.offset[1], rho.offset[2]);
+	} else {
+		snprintf(buf, size, "%s", rho.func);
+	}
+}
+
+// Detail editor of a density; the caller pushes the density's ID. Returns
+// whether the density was changed.
+bool editDensity(ChargeDensityFunc& rho, const char* symbol) {
+	bool changed = ImGui::Checkbox("Use preset function", &(rho.isPreset));
+	if (rho.isPreset) {
+		changed |= ImGui::InputFloat("Scale", &(rho.scale));
+		changed |= ImGui::Combo("Preset", &(rho.preset), presetFunctions, PRESET_COUNT);
+		ImGui::Text("Variable (x, y, z, r, theta, phi, rc)");
+		ImGui::SameLine();
+		changed |= ImGui::InputText("##Var", rho.var, 5, 0);
+		ImGui::Text("Value");
+		ImGui::SameLine();
+		changed |= ImGui::InputFloat("##Val", &(rho.value));
+		ImGui::Text("Offset");
+		changed |= ImGui::InputFloat3("##Offset", rho.offset.data(), "%g", 0);
+	} else {
+		ImGui::Text("%s(x,y,z/r,theta,phi/rc,phi,z) = ", symbol);
+		if (ImGui::InputText("##Func", rho.func, 100, 0)) {
+			rho.expr.compile(rho.func);
+			changed = true;
+		}
+		if (!rho.expr.valid() && !rho.expr.error().empty()) {
+			ImGui::Text("Invalid function: %s", rho.expr.error().c_str());
+		}
+	}
+	changed |= ImGui::Checkbox("Zero outside a box", &(rho.bounded));
+	if (rho.bounded) {
+		ImGui::Text("Box");
+		changed |= ImGui::InputFloat3("##SupportMin", rho.supportMin.data(), "%g", 0);
+		changed |= ImGui::InputFloat3("##SupportMax", rho.supportMax.data(), "%g", 0);
+	}
+	return changed;
+}
+
+int main(int argc, char** argv) {
+	bool headless = false;
+	bool text = false;
+	bool plots = false;
+	bool check = false;
+	const char* config = nullptr;
+	const char* render = nullptr;
+	const char* prefix = nullptr;
+	const char* report = nullptr;
+	const char* trace = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--headless") || !strcmp(argv[i], "-H")) {
+			headless = true;
+		} else if ((!strcmp(argv[i], "--out") || !strcmp(argv[i], "-o")) && i + 1 < argc) {
+			prefix = argv[++i];
+		} else if (!strcmp(argv[i], "--text")) {
+			text = true;
+		} else if (!strcmp(argv[i], "--png")) {
+			plots = true;
+		} else if (!strcmp(argv[i], "--precision-check")) {
+			check = true;
+		} else if (!strcmp(argv[i], "--gpu")) {
+			useGpu = true;
+		} else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+			report = argv[++i];
+		} else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+			trace = argv[++i];
+		} else if (!strcmp(argv[i], "--render") && i + 1 < argc) {
+			render = argv[++i];
+		} else {
+			config = argv[i];
+		}
+	}
+	if (render) {
+		return renderFieldFile(render);
+	}
+	if (headless) {
+		if (!config) {
+			fprintf(stderr, "Usage: %s --headless [--out prefix] [--text] [--png] [--precision-check] [--gpu] [--profile report.json] [--trace trace.json] config.json\n", argv[0]);
+			return 1;
+		}
+		profiler.enable(report || trace);
+		GLFWwindow* context = nullptr;
+		if (useGpu) {
+			context = createComputeContext();
+			if (!context) {
+				fprintf(stderr, "GPU backend unavailable (%s); using the CPU\n",
+					gpuField.error().empty() ? "no OpenGL 4.3 context" : gpuField.error().c_str());
+				useGpu = false;
+			}
+		}
+		int status = runHeadless(config, prefix, text, plots, check);
+		if (!writeProfile(report, trace)) {
+			status = 1;
+		}
+		if (context) {
+			gpuField.release();
+			glfwDestroyWindow(context);
+			glfwTerminate();
+		}
+		return status;
+	}
+	if (config) {
+		readParameters(config);
+	}
+
 	glfwSetErrorCallback(glfwErrorCallback);
 	if (!glfwInit()) {
 		return 1;
@@ -178,7 +876,7 @@ int main() {
 
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
-	GLFWwindow* window = glfwCreateWindow(700, 600, "Electro-/Magnetostatics Editor", NULL, NULL);
+	GLFWwindow* window = glfwCreateWindow(1300, 600, "Electro-/Magnetostatics Editor", NULL, NULL);
 	if (!window) {
 		return 1;
 	}
@@ -188,6 +886,7 @@ int main() {
 		fprintf(stderr, "Failed to initialize OpenGL loader\n");
 		return 1;
 	}
+	bool gpuAvailable = gpuField.init();
 
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -200,6 +899,15 @@ int main() {
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
+		profiler.enable(showProfile);
+		// Stages of the preview worker can outlast a frame, so the recording
+		// is only restarted while it is idle
+		if (!preview.computing()) {
+			if (showProfile) {
+				keepProfile();
+			}
+			profiler.clear();
+		}
 
 		ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_FirstUseEver);
 		ImGui::SetNextWindowSize(ImVec2(700, 600), ImGuiCond_FirstUseEver);
@@ -210,58 +918,150 @@ int main() {
 					std::array<float, 4> charge = {0,0,0,0};
 					charges.push_back(charge);
 				}
-				int i = 0;
-				char buf[100];
-				for (auto it = charges.begin(); it != charges.end();) {
-					sprintf(buf, "##Q%d", i);
-					ImGui::Text("Charge (q, x, y, z)");
-					ImGui::InputFloat4(buf, it->data(), "%g", 0);
+				ImGui::PushID("Charges");
+				chargeView.header(charges.size(), [](size_t i, char* buf, size_t size) {
+					const Vec4& q = charges[i];
+					snprintf(buf, size, "q=%g x=%g y=%g z=%g", q[0], q[1], q[2], q[3]);
+				});
+				ImGui::Text("Charge (q, x, y, z)");
+				chargeView.body("##ChargeList", ImGui::GetFrameHeightWithSpacing(), [](int i) {
+					chargeView.edited(ImGui::InputFloat4("##Q", charges[i].data(), "%g", 0));
 					ImGui::SameLine();
-					sprintf(buf, "Delete charge##DelQ%d", i);
-					if (ImGui::Button(buf)) {
-						charges.erase(it);
-					} else {
-						it++;
-						i++;
+					if (ImGui::Button("Delete")) {
+						chargeView.remove(i);
 					}
-				}
+				});
+				chargeView.apply(charges);
+				ImGui::PopID();
+
 				if (ImGui::Button("Add charge density function")) {
 					ChargeDensityFunc rho;
 					chargeDensities.push_back(rho);
+					densityView.active = chargeDensities.size() - 1;
 				}
-				i = 0;
-				for (auto it = chargeDensities.begin(); it != chargeDensities.end();) {
-					sprintf(buf, "Use preset function##Rho%d", i);
-					ImGui::Checkbox(buf, &(it->isPreset));
-					if (it->isPreset) {
-						sprintf(buf, "Scale##RhoScale%d", i);
-						ImGui::InputFloat(buf, &(it->scale));
-						sprintf(buf, "Preset##Rho%d", i);
-						ImGui::Combo(buf, &(it->preset), presetFunctions, PRESET_COUNT);
-						ImGui::Text("Variable (x, y, z, r, theta, phi, rc)");
-						ImGui::SameLine();
-						sprintf(buf, "##RhoVar%d", i);
-						ImGui::InputText(buf, it->var, 5, 0);
-						ImGui::Text("Value");
-						ImGui::SameLine();
-						sprintf(buf, "##RhoVal%d", i);
-						ImGui::InputFloat(buf, &(it->value));
-						ImGui::Text("Offset");
-						sprintf(buf, "##RhoOffset%d", i);
-						ImGui::InputFloat3(buf, it->offset.data(), "%g", 0);
-					} else {
-						ImGui::Text("rho(x,y,z/r,theta,phi/rc,phi,z) = ");
-						sprintf(buf, "##Rho%d", i);
-						ImGui::InputText(buf, it->func, 100, 0);
+				ImGui::PushID("Densities");
+				densityView.header(chargeDensities.size(), [](size_t i, char* buf, size_t size) {
+					describeDensity(chargeDensities[i], buf, size);
+				});
+				densityView.body("##DensityList", ImGui::GetFrameHeightWithSpacing(), [](int i) {
+					if (ImGui::Button(densityView.active == i ? "Editing" : "Edit")) {
+						densityView.active = i;
 					}
-					sprintf(buf, "Delete charge density function##DelRho%d", i);
-					if (ImGui::Button(buf)) {
-						chargeDensities.erase(it);
-					} else {
-						it++;
-						i++;
+					ImGui::SameLine();
+					if (ImGui::Button("Delete")) {
+						densityView.remove(i);
 					}
+					ImGui::SameLine();
+					char buf[128];
+					describeDensity(chargeDensities[i], buf, sizeof(buf));
+					ImGui::TextUnformatted(buf);
+				});
+				densityView.apply(chargeDensities);
+				int active = densityView.active;
+				if (active >= 0 && active < (int)chargeDensities.size()) {
+					ImGui::Text("Charge density function %d", active);
+					ImGui::PushID(densityView.ids[active]);
+					densityView.edited(editDensity(chargeDensities[active], "rho"));
+					ImGui::PopID();
 				}
+				ImGui::PopID();
+			}
+			if (ImGui::CollapsingHeader("Magnetostatics")) {
+				if (ImGui::Button("Add line current")) {
+					Segment segment = {{0, 0, 0, 0, 0, 0, 1}};
+					currents.push_back(segment);
+				}
+				ImGui::PushID("Currents");
+				currentView.header(currents.size(), [](size_t i, char* buf, size_t size) {
+					const Segment& c = currents[i];
+					snprintf(buf, size, "I=%g from (%g, %g, %g) to (%g, %g, %g)", c[0], c[1], c[2], c[3], c[4], c[5], c[6]);
+				});
+				ImGui::Text("Current (I) from (x, y, z) to (x, y, z)");
+				currentView.body("##CurrentList", ImGui::GetFrameHeightWithSpacing(), [](int i) {
+					float width = ImGui::GetContentRegionAvail().x / 8;
+					ImGui::SetNextItemWidth(width);
+					bool changed = ImGui::InputFloat("##I", currents[i].data());
+					ImGui::SameLine();
+					ImGui::SetNextItemWidth(3 * width);
+					changed |= ImGui::InputFloat3("##Start", currents[i].data() + 1, "%g", 0);
+					ImGui::SameLine();
+					ImGui::SetNextItemWidth(3 * width);
+					changed |= ImGui::InputFloat3("##End", currents[i].data() + 4, "%g", 0);
+					currentView.edited(changed);
+					ImGui::SameLine();
+					if (ImGui::Button("Delete")) {
+						currentView.remove(i);
+					}
+				});
+				currentView.apply(currents);
+				ImGui::PopID();
+
+				if (ImGui::Button("Add current loop")) {
+					Loop loop = {{0, 0, 0, 0, 0, 0, 1, 1}};
+					currentLoops.push_back(loop);
+				}
+				ImGui::PushID("Loops");
+				loopView.header(currentLoops.size(), [](size_t i, char* buf, size_t size) {
+					const Loop& l = currentLoops[i];
+					snprintf(buf, size, "I=%g r=%g center (%g, %g, %g) normal (%g, %g, %g)", l[0], l[7], l[1], l[2], l[3], l[4], l[5], l[6]);
+				});
+				ImGui::Text("Loop current (I), radius, center (x, y, z) and normal (x, y, z)");
+				loopView.body("##LoopList", ImGui::GetFrameHeightWithSpacing(), [](int i) {
+					float width = ImGui::GetContentRegionAvail().x / 9;
+					ImGui::SetNextItemWidth(width);
+					bool changed = ImGui::InputFloat("##I", currentLoops[i].data());
+					ImGui::SameLine();
+					ImGui::SetNextItemWidth(width);
+					changed |= ImGui::InputFloat("##R", currentLoops[i].data() + 7);
+					ImGui::SameLine();
+					ImGui::SetNextItemWidth(3 * width);
+					changed |= ImGui::InputFloat3("##Center", currentLoops[i].data() + 1, "%g", 0);
+					ImGui::SameLine();
+					ImGui::SetNextItemWidth(3 * width);
+					changed |= ImGui::InputFloat3("##Normal", currentLoops[i].data() + 4, "%g", 0);
+					loopView.edited(changed);
+					ImGui::SameLine();
+					if (ImGui::Button("Delete")) {
+						loopView.remove(i);
+					}
+				});
+				loopView.apply(currentLoops);
+				ImGui::PopID();
+
+				if (ImGui::Button("Add current density function")) {
+					CurrentDensityFunc J;
+					currentDensities.push_back(J);
+					currentDensityView.active = currentDensities.size() - 1;
+				}
+				ImGui::PushID("CurrentDensities");
+				currentDensityView.header(currentDensities.size(), [](size_t i, char* buf, size_t size) {
+					describeDensity(currentDensities[i], buf, size);
+				});
+				currentDensityView.body("##CurrentDensityList", ImGui::GetFrameHeightWithSpacing(), [](int i) {
+					if (ImGui::Button(currentDensityView.active == i ? "Editing" : "Edit")) {
+						currentDensityView.active = i;
+					}
+					ImGui::SameLine();
+					if (ImGui::Button("Delete")) {
+						currentDensityView.remove(i);
+					}
+					ImGui::SameLine();
+					char buf[128];
+					describeDensity(currentDensities[i], buf, sizeof(buf));
+					ImGui::TextUnformatted(buf);
+				});
+				currentDensityView.apply(currentDensities);
+				int active = currentDensityView.active;
+				if (active >= 0 && active < (int)currentDensities.size()) {
+					ImGui::Text("Current density function %d", active);
+					ImGui::PushID(currentDensityView.ids[active]);
+					bool changed = editDensity(currentDensities[active], "|J|");
+					ImGui::Text("Current direction (x, y, z)");
+					changed |= ImGui::InputFloat3("##Direction", currentDensities[active].direction.data(), "%g", 0);
+					currentDensityView.edited(changed);
+					ImGui::PopID();
+				}
+				ImGui::PopID();
 			}
 			if (ImGui::CollapsingHeader("Plane of interest")) {
 				ImGui::Text("Plot fields in which plane?");
@@ -274,6 +1074,16 @@ int main() {
 				ImGui::Text("Coordinate on nonplanar axis");
 				ImGui::SameLine();
 				ImGui::InputFloat("##ZCoord", &planeCoordinate);
+
+				ImGui::Checkbox("Volume (stack of planes along the nonplanar axis)", &volumeMode);
+				if (volumeMode) {
+					ImGui::Text("Slices");
+					ImGui::SameLine();
+					ImGui::InputInt("##Slices", &volumeSlices);
+					ImGui::Text("Spacing (0 uses the slice count)");
+					ImGui::SameLine();
+					ImGui::InputFloat("##Spacing", &volumeSpacing);
+				}
 			}
 			if (ImGui::CollapsingHeader("Plot")) {
 				ImGui::InputText("Color Map", colormapbuf, 50, 0);
@@ -292,6 +1102,55 @@ int main() {
 				ImGui::Text("Plot resolution");
 				ImGui::SameLine();
 				ImGui::InputInt("##Res", &resolution);
+				ImGui::Combo("Point charge solver", &solver, solverNames, SOLVER_COUNT);
+				if (solver == SOLVER_BARNES_HUT) {
+					ImGui::Text("Opening angle (0 is exact, larger is faster)");
+					ImGui::SameLine();
+					ImGui::InputFloat("##Theta", &openingAngle);
+				} else {
+					ImGui::Combo("Charge summation precision", &precision, precisionNames, PRECISION_COUNT);
+				}
+				if (symmetryMode == SYMMETRY_DECLARED) {
+					char buf[64];
+					declaredSymmetry.describe(buf, sizeof(buf));
+					ImGui::TextDisabled("Symmetry declared in the configuration: %s", buf);
+				} else {
+					bool exploit = symmetryMode == SYMMETRY_AUTO;
+					if (ImGui::Checkbox("Exploit mirror and rotation symmetries", &exploit)) {
+						symmetryMode = exploit ? SYMMETRY_AUTO : SYMMETRY_NONE;
+					}
+				}
+				ImGui::Combo("Sampling", &sampling, samplingNames, SAMPLING_COUNT);
+				if (sampling == SAMPLING_ADAPTIVE) {
+					ImGui::Text("Error budget (relative)");
+					ImGui::SameLine();
+					ImGui::InputFloat("##ErrorBudget", &adaptiveOptions.tolerance);
+					ImGui::Text("Maximum refinement depth");
+					ImGui::SameLine();
+					ImGui::InputInt("##MaxDepth", &adaptiveOptions.maxDepth);
+				}
+				ImGui::Combo("Charge density integration", &densityMethod, densityMethods, DENSITY_METHOD_COUNT);
+				if (densityMethod == 1) {
+					ImGui::Text("Voxels per unit");
+					ImGui::SameLine();
+					ImGui::InputInt("##VoxelRes", &voxelResolution);
+				}
+				ImGui::Checkbox("Show live preview", &showPreview);
+				ImGui::Checkbox("Show profile overlay", &showProfile);
+				if (showPreview) {
+					ImGui::SliderInt("Preview samples", &preview.samples, 8, 128);
+					if (preview.computing()) {
+						ImGui::ProgressBar(preview.progress(), ImVec2(-1, 0), "Computing preview");
+					} else {
+						ImGui::TextDisabled("Preview up to date (%.1f ms)", preview.seconds() * 1e3);
+					}
+				}
+				if (gpuAvailable) {
+					ImGui::Checkbox("Compute point charge fields on the GPU", &useGpu);
+				} else {
+					ImGui::TextDisabled("GPU backend unavailable: %s", gpuField.error().c_str());
+				}
+				preview.gpu = useGpu ? &gpuField : nullptr;
 			}
 			if (ImGui::CollapsingHeader("Disk")) {
 				static char filename[255];
@@ -306,6 +1165,17 @@ int main() {
 				if (ImGui::Button("Save")) {
 					writeParameters(filename);
 				}
+				ImGui::SameLine();
+				if (ImGui::Button("Save and submit") && writeParameters(filename)) {
+					std::string message;
+					submitJob(filename, message);
+					snprintf(ioMessage, sizeof(ioMessage), "%s", message.c_str());
+				}
+				ImGui::TextDisabled("Files ending in .cbor use the binary format");
+				ImGui::TextDisabled("Submitting renders the saved file with the visualizer service (visualizer.py --serve)");
+				if (!sweepParams.is_null()) {
+					ImGui::TextDisabled("The parameter sweep is kept for the visualizer");
+				}
 				ImGui::Text(ioMessage);
 			}
 			if (ImGui::Button("Exit")) {
@@ -313,6 +1183,23 @@ int main() {
 			}
 		}
 		ImGui::End();
+
+		if (showPreview) {
+			Vec3 min = plotBounds.min, max = plotBounds.max;
+			if (inferPlotBounds) {
+				inferSceneBounds(min, max);
+			}
+			preview.update(charges, planeAxis, planeCoordinate, min, max, plotMargins);
+			ImGui::SetNextWindowPos(ImVec2(700, 0), ImGuiCond_FirstUseEver);
+			ImGui::SetNextWindowSize(ImVec2(600, 600), ImGuiCond_FirstUseEver);
+			if (ImGui::Begin("Field Preview", &showPreview)) {
+				preview.draw(charges);
+			}
+			ImGui::End();
+		}
+		if (showProfile) {
+			drawProfile(lastProfile);
+		}
 		ImGui::Render();
 		int displayW, displayH;
 		glfwGetFramebufferSize(window, &displayW, &displayH);
@@ -323,6 +1210,8 @@ int main() {
 		glfwSwapBuffers(window);
 	}
 
+	preview.stop();
+	gpuField.release();
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
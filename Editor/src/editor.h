@@ -18,6 +18,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <fstream>
 
@@ -30,10 +31,23 @@
 
 #include "json.hpp"
 
-using Vec3 = std::array<float, 3>;
-using Vec4 = std::array<float, 4>;
-
-using DVecF = std::vector<std::vector<float>>;
+#include "adaptive.h"
+#include "confighash.h"
+#include "configio.h"
+#include "density.h"
+#include "engine.h"
+#include "field.h"
+#include "fieldfile.h"
+#include "gpufield.h"
+#include "listview.h"
+#include "octree.h"
+#include "output.h"
+#include "preview.h"
+#include "profile.h"
+#include "progressive.h"
+#include "scheduler.h"
+#include "service.h"
+#include "streamplot.h"
 
 char ioMessage[255] = "Enter a filename to read or save";
 
@@ -45,8 +59,32 @@ bool plotBField = true;
 int planeAxis = 2;
 float planeCoordinate = 0;
 
+// Volume mode evaluates a stack of planes along the nonplanar axis; a
+// positive spacing takes precedence over the slice count
+bool volumeMode = false;
+int volumeSlices = 10;
+float volumeSpacing = 0;
+
 bool showPlots = false;
 
+// Parameter sweep rendered by the visualizer, kept as read so that saving
+// the configuration preserves it
+nlohmann::json sweepParams;
+
+bool showPreview = true;
+FieldPreview preview;
+
+// Overlay listing the stages of the last frame that computed anything
+bool showProfile = false;
+std::vector<ProfileStage> lastProfile;
+// Stages recorded since the profiler was last cleared, kept to reuse their
+// memory
+std::vector<ProfileStage> frameProfile;
+
+// Direct summation of the charges on the GPU, if the context supports it
+bool useGpu = false;
+GpuChargeField gpuField;
+
 bool inferPlotBounds = true;
 struct PlotBounds {
 	Vec3 min = {{0, 0, 0}};
@@ -54,28 +92,55 @@ struct PlotBounds {
 } plotBounds;
 
 int resolution = 100;
+int solver = SOLVER_DIRECT;
+float openingAngle = 0.5;
+int precision = PRECISION_SINGLE;
+// Symmetries are detected unless disabled or declared in the configuration
+int symmetryMode = SYMMETRY_AUTO;
+Symmetry declaredSymmetry;
+#define SAMPLING_UNIFORM 0
+#define SAMPLING_ADAPTIVE 1
+#define SAMPLING_PROGRESSIVE 2
+// Adaptive sampling refines a quadtree near the sources and interpolates
+// the plot grid from it; progressive sampling evaluates the grid coarse to
+// fine, writing the images after every level
+int sampling = SAMPLING_UNIFORM;
+AdaptiveOptions adaptiveOptions;
+int densityMethod = 0;
+int voxelResolution = 10;
 char colormapbuf[50] = "cool";
 std::string colormap;
 
 std::vector<Vec4> charges;
 
-struct ChargeDensityFunc {
-	bool isPreset = true;
-	float scale = 1;
-	union {
-		int preset = 0;
-		char func[100];
-	};
-	char var[5] = "r";
-	float value = 1;
-	Vec3 offset = {{0, 0, 0}};
-};
-
 std::vector<ChargeDensityFunc> chargeDensities;
 
+ListView chargeView;
+ListView densityView;
+
+std::vector<Segment> currents;
+std::vector<Loop> currentLoops;
+
+std::vector<CurrentDensityFunc> currentDensities;
+
+ListView currentView;
+ListView loopView;
+ListView currentDensityView;
+
 #define PRESET_COUNT 3
 const char* presetFunctions[] = {
 	"Delta (var == val)", "Heaviside (var > val)", "Reverse Heaviside (var < val)"
 };
+const char* presetSymbols[] = {"==", ">", "<"};
+
+#define SAMPLING_COUNT 3
+const char* samplingNames[] = {
+	"uniform", "adaptive", "progressive"
+};
+
+#define DENSITY_METHOD_COUNT 2
+const char* densityMethods[] = {
+	"quadrature", "voxel"
+};
 
 #endif
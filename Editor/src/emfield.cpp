@@ -0,0 +1,77 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <algorithm>
+
+#include "emfield.h"
+#include "field.h"
+#include "octree.h"
+#include "scheduler.h"
+#include "streamplot.h"
+
+static std::vector<Vec4> unpackCharges(const float* charges, size_t count) {
+	std::vector<Vec4> list(count);
+	for (size_t i = 0; i < count; i++) {
+		std::copy_n(charges + 4 * i, 4, list[i].begin());
+	}
+	return list;
+}
+
+unsigned emf_threads() {
+	return TaskPool::shared().size();
+}
+
+void emf_charge_field(const float* charges, size_t count, int precision,
+	const float* px, const float* py, const float* pz, size_t points,
+	float* ex, float* ey, float* ez) {
+	ChargeBuffer buffer;
+	buffer.precision = precision;
+	buffer.assign(unpackCharges(charges, count));
+	evaluateChargesAt(buffer, px, py, pz, points, ex, ey, ez, TaskPool::shared());
+}
+
+void emf_charge_field_tree(const float* charges, size_t count, float theta,
+	const float* px, const float* py, const float* pz, size_t points,
+	float* ex, float* ey, float* ez) {
+	ChargeTree tree;
+	tree.build(unpackCharges(charges, count));
+	evaluateTreeAt(tree, theta, px, py, pz, points, ex, ey, ez, TaskPool::shared());
+}
+
+void emf_current_field(const float* segments, size_t count,
+	const float* px, const float* py, const float* pz, size_t points,
+	float* bx, float* by, float* bz) {
+	std::vector<Segment> list(count);
+	for (size_t i = 0; i < count; i++) {
+		std::copy_n(segments + 7 * i, 7, list[i].begin());
+	}
+	CurrentBuffer buffer;
+	buffer.assign(list);
+	evaluateCurrentsAt(buffer, px, py, pz, points, bx, by, bz, TaskPool::shared());
+}
+
+int emf_streamplot(const char* filename, float u0, float u1, float v0, float v1,
+	size_t width, size_t height, const float* f1, const float* f2, const float* density,
+	const char* colormap, const float* charges, size_t charge_count,
+	const float* segments, size_t segment_count) {
+	int map = findColormap(colormap);
+	if (map < 0) {
+		return -1;
+	}
+	std::vector<float> marks(charges, charges + 3 * charge_count);
+	std::vector<float> lines(segments, segments + 4 * segment_count);
+	return writeStreamplot(filename, u0, u1, v0, v1, width, height, f1, f2, density, map,
+		marks, lines, TaskPool::shared());
+}
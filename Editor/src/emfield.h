@@ -0,0 +1,64 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+// C interface to the field engine, built into libemfield and loaded by the
+// visualizer through ctypes (see Visualizer/native.py)
+
+#ifndef EMFIELD_H
+#define EMFIELD_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of threads (including the caller) used by the shared pool
+unsigned emf_threads();
+
+// Adds the field of `count` charges, given as interleaved (q, x, y, z)
+// quadruples, at `points` sample points to the output arrays, summing with
+// the given precision (PRECISION_SINGLE, _COMPENSATED or _DOUBLE in field.h)
+void emf_charge_field(const float* charges, size_t count, int precision,
+	const float* px, const float* py, const float* pz, size_t points,
+	float* ex, float* ey, float* ez);
+
+// Same using a Barnes-Hut octree with the given opening angle
+void emf_charge_field_tree(const float* charges, size_t count, float theta,
+	const float* px, const float* py, const float* pz, size_t points,
+	float* ex, float* ey, float* ez);
+
+// Adds the magnetic field of `count` straight current segments, given as
+// interleaved (I, x1, y1, z1, x2, y2, z2) tuples
+void emf_current_field(const float* segments, size_t count,
+	const float* px, const float* py, const float* pz, size_t points,
+	float* bx, float* by, float* bz);
+
+// Writes a PNG streamline plot of the in-plane field components `f1` and
+// `f2`, stored row-major on a width by height grid spanning [u0, u1] and
+// [v0, v1], over the optional `density` (same layout, or null) and under
+// the charges, given as (q, u, v) triples, and the current segments, given
+// as (u1, v1, u2, v2). Returns 1 on success, 0 if the file couldn't be
+// written and -1 if the colormap isn't available.
+int emf_streamplot(const char* filename, float u0, float u1, float v0, float v1,
+	size_t width, size_t height, const float* f1, const float* f2, const float* density,
+	const char* colormap, const float* charges, size_t charge_count,
+	const float* segments, size_t segment_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
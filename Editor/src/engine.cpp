@@ -0,0 +1,300 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "engine.h"
+#include "octree.h"
+#include "profile.h"
+#include "scheduler.h"
+
+void buildGrid(const FieldJob& job, PlaneGrid& grid) {
+	ProfileScope stage("grid");
+	grid.build(job.axis, job.coordinate, job.min, job.max, job.margins, job.resolution);
+	profiler.count("points", (double)grid.size());
+}
+
+std::vector<float> volumeSlabs(const FieldJob& job, int slices, float spacing) {
+	float lo = job.min[job.axis] - job.margins[job.axis];
+	float hi = job.max[job.axis] + job.margins[job.axis];
+	if (spacing > 0) {
+		slices = (int)((hi - lo) / spacing) + 1;
+	} else if (slices > 1) {
+		spacing = (hi - lo) / (slices - 1);
+	}
+	std::vector<float> slabs(std::max(slices, 0));
+	for (size_t k = 0; k < slabs.size(); k++) {
+		slabs[k] = lo + spacing * k;
+	}
+	return slabs;
+}
+
+static void integrationBox(const FieldJob& job, Vec3& lo, Vec3& hi) {
+	for (int i = 0; i < 3; i++) {
+		lo[i] = job.min[i] - job.margins[i];
+		hi[i] = job.max[i] + job.margins[i];
+	}
+}
+
+// Point charges plus rasterized densities; densities with a closed-form field
+// are collected separately
+static void chargeSources(const FieldJob& job, std::vector<Vec4>& sources,
+	std::vector<const ChargeDensityFunc*>& analytic) {
+	if (job.charges) {
+		sources = *job.charges;
+	}
+	if (job.densities) {
+		Vec3 lo, hi;
+		integrationBox(job, lo, hi);
+		for (const ChargeDensityFunc& rho : *job.densities) {
+			if (hasPresetField(rho)) {
+				analytic.push_back(&rho);
+			} else {
+				ProfileScope stage("rasterize-density");
+				rasterizeDensity(rho, lo, hi, job.voxelResolution, sources);
+			}
+		}
+	}
+}
+
+static void currentSources(const FieldJob& job, std::vector<Segment>& sources) {
+	if (job.currents) {
+		sources = *job.currents;
+	}
+	if (job.loops) {
+		for (const Loop& loop : *job.loops) {
+			appendLoopSegments(loop, sources);
+		}
+	}
+	if (job.currentDensities) {
+		Vec3 lo, hi;
+		integrationBox(job, lo, hi);
+		for (const CurrentDensityFunc& J : *job.currentDensities) {
+			ProfileScope stage("rasterize-current-density");
+			rasterizeCurrentDensity(J, lo, hi, job.voxelResolution, sources);
+		}
+	}
+}
+
+static void addPresetFieldsTile(const std::vector<const ChargeDensityFunc*>& analytic,
+	const PlaneGrid& grid, FieldBuffer& field, const Tile& tile) {
+	for (size_t j = tile.j0; j < tile.j1; j++) {
+		for (size_t i = tile.i0; i < tile.i1; i++) {
+			size_t idx = j * field.width + i;
+			for (const ChargeDensityFunc* rho : analytic) {
+				Vec3 E = presetField(*rho, grid.point(i, j));
+				field.x[idx] += E[0];
+				field.y[idx] += E[1];
+				field.z[idx] += E[2];
+			}
+		}
+	}
+}
+
+static void addPresetFields(const std::vector<const ChargeDensityFunc*>& analytic,
+	const PlaneGrid& grid, FieldBuffer& field, TaskPool& pool) {
+	if (analytic.empty()) {
+		return;
+	}
+	ProfileScope stage("preset-densities");
+	profiler.count("points", (double)grid.size());
+	profiler.count("density-evaluations", (double)grid.size() * analytic.size());
+	std::vector<Tile> tiles = tileGrid(grid.width(), grid.height());
+	pool.run(tiles.size(), [&](size_t t) {
+		addPresetFieldsTile(analytic, grid, field, tiles[t]);
+	});
+}
+
+void FieldSources::build(const FieldJob& job, bool electric, bool magnetic) {
+	ProfileScope stage("sources");
+	solver = job.solver;
+	openingAngle = job.openingAngle;
+	analytic.clear();
+	std::vector<Vec4> chargeList;
+	if (electric) {
+		chargeSources(job, chargeList, analytic);
+	}
+	profiler.count("charges", (double)chargeList.size());
+	symmetry = Symmetry();
+	axis = job.axis;
+	if (electric && job.symmetryMode != SYMMETRY_NONE) {
+		ProfileScope stage("symmetry");
+		for (int a = 0; a < 3; a++) {
+			center[a] = (job.min[a] + job.max[a]) / 2;
+		}
+		if (job.symmetryMode == SYMMETRY_DECLARED) {
+			symmetry = job.symmetry;
+			symmetry.restrict(axis);
+		} else {
+			symmetry = detectSymmetry(chargeList, analytic, center, axis);
+		}
+	}
+	if (solver == SOLVER_BARNES_HUT) {
+		ProfileScope stage("octree");
+		tree.build(chargeList);
+		charges.clear();
+	} else {
+		charges.precision = job.precision;
+		charges.assign(chargeList);
+	}
+	std::vector<Segment> segments;
+	if (magnetic) {
+		currentSources(job, segments);
+	}
+	profiler.count("segments", (double)segments.size());
+	currents.assign(segments);
+}
+
+static void evaluateSourcesOn(const FieldSources& sources, const PlaneGrid& grid, FieldBuffer* efield,
+	FieldBuffer* bfield, TaskPool& pool) {
+	bool direct = sources.solver != SOLVER_BARNES_HUT;
+	double points = (double)grid.size();
+	if (efield && direct && !sources.chargeBackend) {
+		// Charges, closed-form densities and (if wanted) currents are summed
+		// tile by tile, so each tile of the buffers is written while it is
+		// still in cache instead of once per kind of source
+		ProfileScope stage("fields");
+		profiler.count("points", points);
+		profiler.count("interactions", points * (sources.charges.count + (bfield ? sources.currents.count : 0)));
+		profiler.count("density-evaluations", points * sources.analytic.size());
+		for (FieldBuffer* field : {efield, bfield}) {
+			if (field && (field->width != grid.width() || field->height != grid.height())) {
+				field->resize(grid.width(), grid.height());
+			}
+		}
+		std::vector<Tile> tiles = tileGrid(grid.width(), grid.height());
+		pool.run(tiles.size(), [&](size_t t) {
+			if (bfield) {
+				evaluateFieldsTile(sources.charges, sources.currents, grid, *efield, *bfield, tiles[t]);
+			} else {
+				evaluateChargesTile(sources.charges, grid, *efield, tiles[t]);
+			}
+			addPresetFieldsTile(sources.analytic, grid, *efield, tiles[t]);
+		});
+		return;
+	}
+	if (efield) {
+		if (!direct) {
+			ProfileScope stage("barnes-hut");
+			profiler.count("points", points);
+			evaluateTree(sources.tree, grid, *efield, sources.openingAngle, pool);
+		} else {
+			ProfileScope stage("charges");
+			profiler.count("points", points);
+			profiler.count("interactions", points * sources.charges.count);
+			if (!sources.chargeBackend || !sources.chargeBackend(grid, *efield)) {
+				evaluateCharges(sources.charges, grid, *efield, pool);
+			}
+		}
+		addPresetFields(sources.analytic, grid, *efield, pool);
+	}
+	if (bfield) {
+		ProfileScope stage("currents");
+		profiler.count("points", points);
+		profiler.count("interactions", points * sources.currents.count);
+		evaluateCurrents(sources.currents, grid, *bfield, pool);
+	}
+}
+
+// Whether the grid is mirrored onto itself by the symmetry of the sources
+static bool symmetricGrid(const FieldSources& sources, const PlaneGrid& grid) {
+	if (!sources.symmetry.any() || grid.axis != sources.axis || grid.size() == 0) {
+		return false;
+	}
+	const std::vector<float>* samples[] = {&grid.u, &grid.v};
+	int axes[] = {grid.axis1, grid.axis2};
+	for (int k = 0; k < 2; k++) {
+		const std::vector<float>& s = *samples[k];
+		float tolerance = 1e-4f * std::max(1.0f, s.back() - s.front());
+		if (fabsf(s.front() + s.back() - 2 * sources.center[axes[k]]) > tolerance) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void evaluateSources(const FieldSources& sources, const PlaneGrid& grid, FieldBuffer* efield,
+	FieldBuffer* bfield, TaskPool& pool) {
+	if (!efield || !symmetricGrid(sources, grid)) {
+		evaluateSourcesOn(sources, grid, efield, bfield, pool);
+		return;
+	}
+	PlaneGrid reduced;
+	fundamentalGrid(grid, sources.symmetry, reduced);
+	FieldBuffer half;
+	evaluateSourcesOn(sources, reduced, &half, nullptr, pool);
+	{
+		ProfileScope stage("unfold");
+		profiler.count("points", (double)(grid.size() - reduced.size()));
+		unfoldField(half, grid, sources.symmetry, *efield);
+	}
+	// The symmetry is only detected on the charges, and the magnetic field
+	// is a pseudovector besides, so currents are evaluated on the whole grid
+	if (bfield) {
+		evaluateSourcesOn(sources, grid, nullptr, bfield, pool);
+	}
+}
+
+void evaluateSourcesAt(const FieldSources& sources, const float* px, const float* py,
+	const float* pz, size_t count, float* const* efield, float* const* bfield, TaskPool& pool) {
+	ProfileScope stage("points");
+	profiler.count("points", (double)count);
+	bool direct = sources.solver != SOLVER_BARNES_HUT;
+	if (efield && !direct) {
+		evaluateTreeAt(sources.tree, sources.openingAngle, px, py, pz, count,
+			efield[0], efield[1], efield[2], pool);
+	}
+	bool charges = efield && direct;
+	bool analytic = efield && !sources.analytic.empty();
+	if (!charges && !analytic && !bfield) {
+		return;
+	}
+	profiler.count("interactions", (double)count * ((charges ? sources.charges.count : 0) +
+		(bfield ? sources.currents.count : 0)));
+	if (analytic) {
+		profiler.count("density-evaluations", (double)count * sources.analytic.size());
+	}
+	// All remaining sources are summed point by point in a single pass
+	const size_t block = FIELD_TILE * FIELD_TILE;
+	pool.run((count + block - 1) / block, [&](size_t t) {
+		size_t end = std::min(count, (t + 1) * block);
+		for (size_t k = t * block; k < end; k++) {
+			Vec3 p = {{px[k], py[k], pz[k]}};
+			if (efield) {
+				Vec3 E = {{0, 0, 0}};
+				if (charges) {
+					E = chargeField(sources.charges, p);
+				}
+				for (const ChargeDensityFunc* rho : sources.analytic) {
+					Vec3 D = presetField(*rho, p);
+					for (int c = 0; c < 3; c++) {
+						E[c] += D[c];
+					}
+				}
+				for (int c = 0; c < 3; c++) {
+					efield[c][k] += E[c];
+				}
+			}
+			if (bfield) {
+				Vec3 B = currentField(sources.currents, p);
+				for (int c = 0; c < 3; c++) {
+					bfield[c][k] += B[c];
+				}
+			}
+		}
+	});
+}
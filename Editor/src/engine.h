@@ -0,0 +1,98 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <functional>
+
+#include "density.h"
+#include "field.h"
+#include "octree.h"
+#include "symmetry.h"
+
+// Everything needed to compute the fields of a configuration, independent
+// of the editor's UI state
+struct FieldJob {
+	const std::vector<Vec4>* charges = nullptr;
+	const std::vector<ChargeDensityFunc>* densities = nullptr;
+	const std::vector<Segment>* currents = nullptr;
+	const std::vector<Loop>* loops = nullptr;
+	const std::vector<CurrentDensityFunc>* currentDensities = nullptr;
+	int axis = 2;
+	float coordinate = 0;
+	// Plot bounds (already inferred if needed) and margins
+	Vec3 min = {{0, 0, 0}};
+	Vec3 max = {{0, 0, 0}};
+	Vec3 margins = {{5, 5, 5}};
+	int resolution = 100;
+	int solver = 0;
+	float openingAngle = 0.5;
+	int voxelResolution = 10;
+	int precision = PRECISION_SINGLE;
+	// Whether to detect the symmetries of the charges, use the declared ones
+	// or evaluate the whole grid
+	int symmetryMode = SYMMETRY_NONE;
+	Symmetry symmetry;
+};
+
+void buildGrid(const FieldJob& job, PlaneGrid& grid);
+
+// Coordinates along the plane's normal axis of the slabs of a volume spanning
+// the plot bounds and margins, given either their number or their spacing
+std::vector<float> volumeSlabs(const FieldJob& job, int slices, float spacing);
+
+// Sources of a job in the form the kernels use, built once and evaluated on
+// any number of grids (e.g. every slab of a volume)
+struct FieldSources {
+	int solver = 0;
+	float openingAngle = 0.5;
+	// Point charges plus rasterized densities, as a buffer or an octree
+	// depending on the solver
+	ChargeBuffer charges;
+	ChargeTree tree;
+	// Densities with a closed-form field, owned by the job
+	std::vector<const ChargeDensityFunc*> analytic;
+	// Line currents, loop segments and rasterized current densities
+	CurrentBuffer currents;
+	// Optional replacement for the direct summation of the charges on a grid
+	// (e.g. the GPU backend); returning false falls back to the CPU
+	std::function<bool(const PlaneGrid&, FieldBuffer&)> chargeBackend;
+	// Symmetry of the charges about the center of the plot box, for planes
+	// normal to the given axis
+	Symmetry symmetry;
+	Vec3 center = {{0, 0, 0}};
+	int axis = 2;
+
+	// Densities with a closed-form field are evaluated exactly; all others
+	// are rasterized into voxel charges. Loops are split into segments and
+	// current densities rasterized into voxel current elements.
+	void build(const FieldJob& job, bool electric, bool magnetic);
+};
+
+// Adds the field of the sources to the given buffers (either may be null),
+// which are resized to match the grid. With direct summation both fields are
+// evaluated in a single pass over the grid. If the charges have a symmetry
+// about the center of the grid, their field is only evaluated on the
+// fundamental domain.
+void evaluateSources(const FieldSources& sources, const PlaneGrid& grid, FieldBuffer* efield,
+	FieldBuffer* bfield, TaskPool& pool);
+
+// Same at an arbitrary list of points; `efield` and `bfield` point to three
+// output arrays each (x, y, z) or are null
+void evaluateSourcesAt(const FieldSources& sources, const float* px, const float* py,
+	const float* pz, size_t count, float* const* efield, float* const* bfield, TaskPool& pool);
+
+#endif
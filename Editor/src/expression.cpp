@@ -0,0 +1,355 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "expression.h"
+
+#define VARIABLE_COUNT 7
+static const char* variableNames[] = {
+	"x", "y", "z", "r", "rc", "theta", "phi"
+};
+
+// Recursive descent parser emitting postfix code, with Python's precedence:
+//   expr  := term (('+' | '-') term)*
+//   term  := unary (('*' | '/' | '//') unary)*
+//   unary := ('+' | '-') unary | power
+//   power := atom ('**' unary)?
+//   atom  := number | name | name '(' expr (',' expr)* ')' | '(' expr ')'
+struct Parser {
+	Expression& expr;
+	const char* pos;
+	int depth = 0;
+
+	Parser(Expression& expr, const char* source) : expr(expr), pos(source) {}
+
+	void skip() {
+		while (isspace(*pos)) {
+			pos++;
+		}
+	}
+
+	bool accept(const char* token) {
+		skip();
+		size_t len = strlen(token);
+		if (strncmp(pos, token, len) != 0) {
+			return false;
+		}
+		// Don't read the first character of ** or // as * or /
+		if (len == 1 && (token[0] == '*' || token[0] == '/') && pos[1] == token[0]) {
+			return false;
+		}
+		pos += len;
+		return true;
+	}
+
+	bool fail(const char* message) {
+		expr.message = message;
+		return false;
+	}
+
+	void emit(Expression::Op op, int arg = 0, float value = 0) {
+		Expression::Instruction instr = {op, arg, value};
+		expr.code.push_back(instr);
+		if (op == Expression::CONST || op == Expression::VAR) {
+			depth++;
+		} else if (op == Expression::NORM) {
+			depth -= arg - 1;
+		} else if (op <= Expression::POW) {
+			depth--;
+		}
+		expr.depth = std::max(expr.depth, depth);
+	}
+
+	bool parseExpr() {
+		if (!parseTerm()) {
+			return false;
+		}
+		while (true) {
+			if (accept("+")) {
+				if (!parseTerm()) {
+					return false;
+				}
+				emit(Expression::ADD);
+			} else if (accept("-")) {
+				if (!parseTerm()) {
+					return false;
+				}
+				emit(Expression::SUB);
+			} else {
+				return true;
+			}
+		}
+	}
+
+	bool parseTerm() {
+		if (!parseUnary()) {
+			return false;
+		}
+		while (true) {
+			Expression::Op op;
+			if (accept("//")) {
+				op = Expression::FLOORDIV;
+			} else if (accept("*")) {
+				op = Expression::MUL;
+			} else if (accept("/")) {
+				op = Expression::DIV;
+			} else {
+				return true;
+			}
+			if (!parseUnary()) {
+				return false;
+			}
+			emit(op);
+		}
+	}
+
+	bool parseUnary() {
+		if (accept("-")) {
+			if (!parseUnary()) {
+				return false;
+			}
+			emit(Expression::NEG);
+			return true;
+		}
+		if (accept("+")) {
+			return parseUnary();
+		}
+		return parsePower();
+	}
+
+	bool parsePower() {
+		if (!parseAtom()) {
+			return false;
+		}
+		if (accept("**")) {
+			if (!parseUnary()) {
+				return false;
+			}
+			emit(Expression::POW);
+		}
+		return true;
+	}
+
+	bool parseAtom() {
+		skip();
+		if (accept("(")) {
+			if (!parseExpr()) {
+				return false;
+			}
+			return accept(")") || fail("Expected )");
+		}
+		if (isdigit(*pos) || *pos == '.') {
+			char* end;
+			float value = strtof(pos, &end);
+			if (end == pos) {
+				return fail("Invalid number");
+			}
+			pos = end;
+			emit(Expression::CONST, 0, value);
+			return true;
+		}
+		if (!isalpha(*pos) && *pos != '_') {
+			return fail(*pos ? "Unexpected character" : "Unexpected end of function");
+		}
+		const char* start = pos;
+		while (isalnum(*pos) || *pos == '_') {
+			pos++;
+		}
+		std::string name(start, pos);
+		if (accept("(")) {
+			return parseCall(name);
+		}
+		if (name == "pi") {
+			emit(Expression::CONST, 0, (float)M_PI);
+			return true;
+		}
+		if (name == "e") {
+			emit(Expression::CONST, 0, (float)M_E);
+			return true;
+		}
+		for (int i = 0; i < VARIABLE_COUNT; i++) {
+			if (name == variableNames[i]) {
+				emit(Expression::VAR, i);
+				expr.used |= 1u << i;
+				return true;
+			}
+		}
+		return fail("Unknown variable");
+	}
+
+	bool parseCall(const std::string& name) {
+		Expression::Op op;
+		if (name == "sin") {
+			op = Expression::SIN;
+		} else if (name == "cos") {
+			op = Expression::COS;
+		} else if (name == "tan") {
+			op = Expression::TAN;
+		} else if (name == "abs") {
+			op = Expression::ABS;
+		} else if (name == "norm") {
+			op = Expression::NORM;
+		} else {
+			return fail("Unknown function");
+		}
+		int argc = 0;
+		do {
+			if (!parseExpr()) {
+				return false;
+			}
+			argc++;
+		} while (accept(","));
+		if (!accept(")")) {
+			return fail("Expected )");
+		}
+		if (op != Expression::NORM && argc != 1) {
+			return fail("Function takes one argument");
+		}
+		emit(op, argc);
+		return true;
+	}
+};
+
+bool Expression::compile(const char* source) {
+	code.clear();
+	depth = 0;
+	used = 0;
+	message.clear();
+	Parser parser(*this, source);
+	bool ok = parser.parseExpr();
+	parser.skip();
+	if (ok && *parser.pos != 0) {
+		ok = parser.fail("Unexpected character");
+	}
+	if (!ok) {
+		code.clear();
+	}
+	return ok;
+}
+
+float Expression::evaluate(float x, float y, float z) const {
+	float out;
+	evaluate(&x, &y, &z, 1, &out);
+	return out;
+}
+
+void Expression::evaluate(const float* x, const float* y, const float* z, size_t count,
+	float* out) const {
+	std::vector<float> stack(depth * EXPRESSION_BLOCK);
+	for (size_t k = 0; k < count; k += EXPRESSION_BLOCK) {
+		size_t n = std::min((size_t)EXPRESSION_BLOCK, count - k);
+		evaluateBlock(x + k, y + k, z + k, n, out + k, stack.data());
+	}
+}
+
+void Expression::evaluateBlock(const float* x, const float* y, const float* z, size_t n,
+	float* out, float* stack) const {
+	if (code.empty()) {
+		std::fill(out, out + n, 0.0f);
+		return;
+	}
+	float vars[VARIABLE_COUNT][EXPRESSION_BLOCK];
+	std::copy(x, x + n, vars[0]);
+	std::copy(y, y + n, vars[1]);
+	std::copy(z, z + n, vars[2]);
+	// Derived variables as defined by get_variable in the visualizer
+	if (used & ~7u) {
+		for (size_t k = 0; k < n; k++) {
+			float r = sqrtf(x[k] * x[k] + y[k] * y[k] + z[k] * z[k]);
+			float rc = sqrtf(x[k] * x[k] + y[k] * y[k]);
+			vars[3][k] = r;
+			vars[4][k] = rc;
+			vars[5][k] = acosf(z[k] / r);
+			vars[6][k] = acosf(x[k] / rc);
+		}
+	}
+
+	int top = 0;
+	for (const Instruction& instr : code) {
+		// Operands: a is the top of the stack, b the one below it
+		float* next = stack + top * EXPRESSION_BLOCK;
+		float* a = top > 0 ? next - EXPRESSION_BLOCK : stack;
+		float* b = top > 1 ? a - EXPRESSION_BLOCK : stack;
+		switch (instr.op) {
+		case CONST:
+			std::fill(next, next + n, instr.value);
+			top++;
+			break;
+		case VAR:
+			std::copy(vars[instr.arg], vars[instr.arg] + n, next);
+			top++;
+			break;
+		case ADD:
+			for (size_t k = 0; k < n; k++) b[k] += a[k];
+			top--;
+			break;
+		case SUB:
+			for (size_t k = 0; k < n; k++) b[k] -= a[k];
+			top--;
+			break;
+		case MUL:
+			for (size_t k = 0; k < n; k++) b[k] *= a[k];
+			top--;
+			break;
+		case DIV:
+			for (size_t k = 0; k < n; k++) b[k] /= a[k];
+			top--;
+			break;
+		case FLOORDIV:
+			for (size_t k = 0; k < n; k++) b[k] = floorf(b[k] / a[k]);
+			top--;
+			break;
+		case POW:
+			for (size_t k = 0; k < n; k++) b[k] = powf(b[k], a[k]);
+			top--;
+			break;
+		case NEG:
+			for (size_t k = 0; k < n; k++) a[k] = -a[k];
+			break;
+		case SIN:
+			for (size_t k = 0; k < n; k++) a[k] = sinf(a[k]);
+			break;
+		case COS:
+			for (size_t k = 0; k < n; k++) a[k] = cosf(a[k]);
+			break;
+		case TAN:
+			for (size_t k = 0; k < n; k++) a[k] = tanf(a[k]);
+			break;
+		case ABS:
+			for (size_t k = 0; k < n; k++) a[k] = fabsf(a[k]);
+			break;
+		case NORM: {
+			float* first = a - (instr.arg - 1) * EXPRESSION_BLOCK;
+			for (size_t k = 0; k < n; k++) {
+				float sum = 0;
+				for (int i = 0; i < instr.arg; i++) {
+					float v = first[i * EXPRESSION_BLOCK + k];
+					sum += v * v;
+				}
+				first[k] = sqrtf(sum);
+			}
+			top -= instr.arg - 1;
+			break;
+		}
+		}
+	}
+	std::copy(stack, stack + n, out);
+}
@@ -0,0 +1,64 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+// Points are evaluated in blocks of this size so that each instruction
+// runs as a tight loop over the block
+#define EXPRESSION_BLOCK 256
+
+// Custom density function compiled to postfix bytecode. The accepted
+// syntax is the same whitelist as the visualizer's safety level 1: numbers,
+// the variables x, y, z, r, rc, theta and phi, the constants pi and e, the
+// operators + - * / // ** and the functions sin, cos, tan, abs and norm.
+class Expression {
+public:
+	// Returns false and sets the error message if the source is rejected
+	bool compile(const char* source);
+	bool valid() const { return !code.empty(); }
+	const std::string& error() const { return message; }
+
+	float evaluate(float x, float y, float z) const;
+	void evaluate(const float* x, const float* y, const float* z, size_t count, float* out) const;
+private:
+	friend struct Parser;
+
+	enum Op {
+		CONST, VAR, ADD, SUB, MUL, DIV, FLOORDIV, POW, NEG,
+		SIN, COS, TAN, ABS, NORM
+	};
+	struct Instruction {
+		Op op;
+		int arg;
+		float value;
+	};
+
+	void evaluateBlock(const float* x, const float* y, const float* z, size_t count,
+		float* out, float* stack) const;
+
+	std::vector<Instruction> code;
+	int depth = 0;
+	// Bit i is set if the expression uses variable i
+	unsigned used = 0;
+	std::string message;
+};
+
+#endif
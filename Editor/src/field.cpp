@@ -0,0 +1,500 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <math.h>
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "field.h"
+#include "profile.h"
+#include "scheduler.h"
+
+const char* precisionNames[] = {
+	"single", "compensated", "double"
+};
+
+void ChargeBuffer::assign(const std::vector<Vec4>& charges) {
+	count = charges.size();
+	size_t n = (count + FIELD_LANES - 1) / FIELD_LANES * FIELD_LANES;
+	q.assign(n, 0);
+	x.assign(n, 0);
+	y.assign(n, 0);
+	z.assign(n, 0);
+	profiler.count("bytes", 4 * n * sizeof(float));
+	for (size_t i = 0; i < count; i++) {
+		q[i] = charges[i][0];
+		x[i] = charges[i][1];
+		y[i] = charges[i][2];
+		z[i] = charges[i][3];
+	}
+}
+
+void ChargeBuffer::clear() {
+	count = 0;
+	q.clear();
+	x.clear();
+	y.clear();
+	z.clear();
+}
+
+void CurrentBuffer::assign(const std::vector<Segment>& segments) {
+	count = segments.size();
+	size_t n = (count + FIELD_LANES - 1) / FIELD_LANES * FIELD_LANES;
+	std::vector<float>* arrays[] = {&I, &ax, &ay, &az, &bx, &by, &bz};
+	for (int c = 0; c < 7; c++) {
+		arrays[c]->assign(n, 0);
+		for (size_t i = 0; i < count; i++) {
+			(*arrays[c])[i] = segments[i][c];
+		}
+	}
+	profiler.count("bytes", 7 * n * sizeof(float));
+}
+
+void CurrentBuffer::clear() {
+	count = 0;
+	std::vector<float>* arrays[] = {&I, &ax, &ay, &az, &bx, &by, &bz};
+	for (std::vector<float>* array : arrays) {
+		array->clear();
+	}
+}
+
+static void linspace(std::vector<float>& axis, float min, float max, int n) {
+	axis.resize(std::max(n, 0));
+	if (n == 1) {
+		axis[0] = min;
+		return;
+	}
+	for (int i = 0; i < n; i++) {
+		axis[i] = min + (max - min) * i / (n - 1);
+	}
+}
+
+void PlaneGrid::build(int axis, float coordinate, const Vec3& min, const Vec3& max,
+	const Vec3& margins, int resolution) {
+	this->axis = axis;
+	this->coordinate = coordinate;
+	axis1 = axis == 0 ? 1 : 0;
+	axis2 = axis == 2 ? 1 : 2;
+	std::vector<float>* samples[] = {&u, &v};
+	int planar[] = {axis1, axis2};
+	for (int k = 0; k < 2; k++) {
+		int i = planar[k];
+		float lo = min[i] - margins[i];
+		float hi = max[i] + margins[i];
+		// Same sample count as np.linspace in visualize_fields
+		linspace(*samples[k], lo, hi, resolution * (int)(hi - lo));
+	}
+}
+
+void PlaneGrid::build(int axis, float coordinate, const Vec3& lo, const Vec3& hi,
+	size_t width, size_t height) {
+	this->axis = axis;
+	this->coordinate = coordinate;
+	axis1 = axis == 0 ? 1 : 0;
+	axis2 = axis == 2 ? 1 : 2;
+	linspace(u, lo[axis1], hi[axis1], (int)width);
+	linspace(v, lo[axis2], hi[axis2], (int)height);
+}
+
+Vec3 PlaneGrid::point(size_t i, size_t j) const {
+	Vec3 p;
+	p[axis] = coordinate;
+	p[axis1] = u[i];
+	p[axis2] = v[j];
+	return p;
+}
+
+void FieldBuffer::resize(size_t width, size_t height) {
+	this->width = width;
+	this->height = height;
+	x.assign(width * height, 0);
+	y.assign(width * height, 0);
+	z.assign(width * height, 0);
+	profiler.count("bytes", 3 * width * height * sizeof(float));
+}
+
+void FieldBuffer::clear() {
+	std::fill(x.begin(), x.end(), 0);
+	std::fill(y.begin(), y.end(), 0);
+	std::fill(z.begin(), z.end(), 0);
+}
+
+void inferBounds(const std::vector<Vec4>& charges, Vec3& min, Vec3& max) {
+	min = {{0, 0, 0}};
+	max = {{0, 0, 0}};
+	if (charges.empty()) {
+		return;
+	}
+	for (int i = 0; i < 3; i++) {
+		min[i] = max[i] = charges[0][i + 1];
+	}
+	for (const Vec4& charge : charges) {
+		for (int i = 0; i < 3; i++) {
+			min[i] = std::min(min[i], charge[i + 1]);
+			max[i] = std::max(max[i], charge[i + 1]);
+		}
+	}
+}
+
+#if defined(__AVX2__)
+
+static inline float hsum(__m256 v) {
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+
+static Vec3 chargeFieldSingle(const ChargeBuffer& charges, const Vec3& point) {
+	const __m256 px = _mm256_set1_ps(point[0]);
+	const __m256 py = _mm256_set1_ps(point[1]);
+	const __m256 pz = _mm256_set1_ps(point[2]);
+	const __m256 eps = _mm256_set1_ps(FIELD_SOFTENING);
+	__m256 ex = _mm256_setzero_ps();
+	__m256 ey = _mm256_setzero_ps();
+	__m256 ez = _mm256_setzero_ps();
+	for (size_t k = 0; k < charges.padded(); k += 8) {
+		__m256 dx = _mm256_sub_ps(px, _mm256_loadu_ps(&charges.x[k]));
+		__m256 dy = _mm256_sub_ps(py, _mm256_loadu_ps(&charges.y[k]));
+		__m256 dz = _mm256_sub_ps(pz, _mm256_loadu_ps(&charges.z[k]));
+		__m256 r2 = _mm256_add_ps(_mm256_mul_ps(dx, dx),
+			_mm256_add_ps(_mm256_mul_ps(dy, dy), _mm256_mul_ps(dz, dz)));
+		__m256 denom = _mm256_add_ps(_mm256_mul_ps(r2, _mm256_sqrt_ps(r2)), eps);
+		__m256 w = _mm256_div_ps(_mm256_loadu_ps(&charges.q[k]), denom);
+		ex = _mm256_add_ps(ex, _mm256_mul_ps(w, dx));
+		ey = _mm256_add_ps(ey, _mm256_mul_ps(w, dy));
+		ez = _mm256_add_ps(ez, _mm256_mul_ps(w, dz));
+	}
+	return {{hsum(ex), hsum(ey), hsum(ez)}};
+}
+
+// With a = A - P and b = B - P the field of the segment from A to B is
+// I (a x b) (|a| + |b|) / (|a| |b| (|a| |b| + a . b))
+Vec3 currentField(const CurrentBuffer& currents, const Vec3& point) {
+	const __m256 px = _mm256_set1_ps(point[0]);
+	const __m256 py = _mm256_set1_ps(point[1]);
+	const __m256 pz = _mm256_set1_ps(point[2]);
+	const __m256 eps = _mm256_set1_ps(FIELD_SOFTENING);
+	__m256 fx = _mm256_setzero_ps();
+	__m256 fy = _mm256_setzero_ps();
+	__m256 fz = _mm256_setzero_ps();
+	for (size_t k = 0; k < currents.padded(); k += 8) {
+		__m256 ax = _mm256_sub_ps(_mm256_loadu_ps(&currents.ax[k]), px);
+		__m256 ay = _mm256_sub_ps(_mm256_loadu_ps(&currents.ay[k]), py);
+		__m256 az = _mm256_sub_ps(_mm256_loadu_ps(&currents.az[k]), pz);
+		__m256 bx = _mm256_sub_ps(_mm256_loadu_ps(&currents.bx[k]), px);
+		__m256 by = _mm256_sub_ps(_mm256_loadu_ps(&currents.by[k]), py);
+		__m256 bz = _mm256_sub_ps(_mm256_loadu_ps(&currents.bz[k]), pz);
+		__m256 la = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(ax, ax),
+			_mm256_add_ps(_mm256_mul_ps(ay, ay), _mm256_mul_ps(az, az))));
+		__m256 lb = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(bx, bx),
+			_mm256_add_ps(_mm256_mul_ps(by, by), _mm256_mul_ps(bz, bz))));
+		__m256 dot = _mm256_add_ps(_mm256_mul_ps(ax, bx),
+			_mm256_add_ps(_mm256_mul_ps(ay, by), _mm256_mul_ps(az, bz)));
+		__m256 lab = _mm256_mul_ps(la, lb);
+		__m256 denom = _mm256_add_ps(_mm256_mul_ps(lab, _mm256_add_ps(lab, dot)), eps);
+		__m256 w = _mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(&currents.I[k]), _mm256_add_ps(la, lb)), denom);
+		fx = _mm256_add_ps(fx, _mm256_mul_ps(w, _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by))));
+		fy = _mm256_add_ps(fy, _mm256_mul_ps(w, _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz))));
+		fz = _mm256_add_ps(fz, _mm256_mul_ps(w, _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx))));
+	}
+	return {{hsum(fx), hsum(fy), hsum(fz)}};
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+static Vec3 chargeFieldSingle(const ChargeBuffer& charges, const Vec3& point) {
+	const float32x4_t px = vdupq_n_f32(point[0]);
+	const float32x4_t py = vdupq_n_f32(point[1]);
+	const float32x4_t pz = vdupq_n_f32(point[2]);
+	const float32x4_t eps = vdupq_n_f32(FIELD_SOFTENING);
+	float32x4_t ex = vdupq_n_f32(0);
+	float32x4_t ey = vdupq_n_f32(0);
+	float32x4_t ez = vdupq_n_f32(0);
+	for (size_t k = 0; k < charges.padded(); k += 4) {
+		float32x4_t dx = vsubq_f32(px, vld1q_f32(&charges.x[k]));
+		float32x4_t dy = vsubq_f32(py, vld1q_f32(&charges.y[k]));
+		float32x4_t dz = vsubq_f32(pz, vld1q_f32(&charges.z[k]));
+		float32x4_t r2 = vfmaq_f32(vfmaq_f32(vmulq_f32(dx, dx), dy, dy), dz, dz);
+		float32x4_t denom = vfmaq_f32(eps, r2, vsqrtq_f32(r2));
+		float32x4_t w = vdivq_f32(vld1q_f32(&charges.q[k]), denom);
+		ex = vfmaq_f32(ex, w, dx);
+		ey = vfmaq_f32(ey, w, dy);
+		ez = vfmaq_f32(ez, w, dz);
+	}
+	return {{vaddvq_f32(ex), vaddvq_f32(ey), vaddvq_f32(ez)}};
+}
+
+Vec3 currentField(const CurrentBuffer& currents, const Vec3& point) {
+	const float32x4_t px = vdupq_n_f32(point[0]);
+	const float32x4_t py = vdupq_n_f32(point[1]);
+	const float32x4_t pz = vdupq_n_f32(point[2]);
+	const float32x4_t eps = vdupq_n_f32(FIELD_SOFTENING);
+	float32x4_t fx = vdupq_n_f32(0);
+	float32x4_t fy = vdupq_n_f32(0);
+	float32x4_t fz = vdupq_n_f32(0);
+	for (size_t k = 0; k < currents.padded(); k += 4) {
+		float32x4_t ax = vsubq_f32(vld1q_f32(&currents.ax[k]), px);
+		float32x4_t ay = vsubq_f32(vld1q_f32(&currents.ay[k]), py);
+		float32x4_t az = vsubq_f32(vld1q_f32(&currents.az[k]), pz);
+		float32x4_t bx = vsubq_f32(vld1q_f32(&currents.bx[k]), px);
+		float32x4_t by = vsubq_f32(vld1q_f32(&currents.by[k]), py);
+		float32x4_t bz = vsubq_f32(vld1q_f32(&currents.bz[k]), pz);
+		float32x4_t la = vsqrtq_f32(vfmaq_f32(vfmaq_f32(vmulq_f32(ax, ax), ay, ay), az, az));
+		float32x4_t lb = vsqrtq_f32(vfmaq_f32(vfmaq_f32(vmulq_f32(bx, bx), by, by), bz, bz));
+		float32x4_t dot = vfmaq_f32(vfmaq_f32(vmulq_f32(ax, bx), ay, by), az, bz);
+		float32x4_t lab = vmulq_f32(la, lb);
+		float32x4_t denom = vfmaq_f32(eps, lab, vaddq_f32(lab, dot));
+		float32x4_t w = vdivq_f32(vmulq_f32(vld1q_f32(&currents.I[k]), vaddq_f32(la, lb)), denom);
+		fx = vfmaq_f32(fx, w, vfmsq_f32(vmulq_f32(ay, bz), az, by));
+		fy = vfmaq_f32(fy, w, vfmsq_f32(vmulq_f32(az, bx), ax, bz));
+		fz = vfmaq_f32(fz, w, vfmsq_f32(vmulq_f32(ax, by), ay, bx));
+	}
+	return {{vaddvq_f32(fx), vaddvq_f32(fy), vaddvq_f32(fz)}};
+}
+
+#else
+
+static Vec3 chargeFieldSingle(const ChargeBuffer& charges, const Vec3& point) {
+	float ex = 0, ey = 0, ez = 0;
+	for (size_t k = 0; k < charges.padded(); k++) {
+		float dx = point[0] - charges.x[k];
+		float dy = point[1] - charges.y[k];
+		float dz = point[2] - charges.z[k];
+		float r2 = dx * dx + dy * dy + dz * dz;
+		float w = charges.q[k] / (r2 * sqrtf(r2) + FIELD_SOFTENING);
+		ex += w * dx;
+		ey += w * dy;
+		ez += w * dz;
+	}
+	return {{ex, ey, ez}};
+}
+
+Vec3 currentField(const CurrentBuffer& currents, const Vec3& point) {
+	float fx = 0, fy = 0, fz = 0;
+	for (size_t k = 0; k < currents.padded(); k++) {
+		float ax = currents.ax[k] - point[0];
+		float ay = currents.ay[k] - point[1];
+		float az = currents.az[k] - point[2];
+		float bx = currents.bx[k] - point[0];
+		float by = currents.by[k] - point[1];
+		float bz = currents.bz[k] - point[2];
+		float la = sqrtf(ax * ax + ay * ay + az * az);
+		float lb = sqrtf(bx * bx + by * by + bz * bz);
+		float lab = la * lb;
+		float dot = ax * bx + ay * by + az * bz;
+		float w = currents.I[k] * (la + lb) / (lab * (lab + dot) + FIELD_SOFTENING);
+		fx += w * (ay * bz - az * by);
+		fy += w * (az * bx - ax * bz);
+		fz += w * (ax * by - ay * bx);
+	}
+	return {{fx, fy, fz}};
+}
+
+#endif
+
+// Kahan summation; the compiler must not reassociate (no -ffast-math)
+struct CompensatedSum {
+	float sum = 0, error = 0;
+
+	void add(float term) {
+		float y = term - error;
+		float t = sum + y;
+		error = (t - sum) - y;
+		sum = t;
+	}
+};
+
+struct DoubleSum {
+	double sum = 0;
+
+	void add(double term) { sum += term; }
+};
+
+template <typename Sum>
+static Vec3 chargeFieldSummed(const ChargeBuffer& charges, const Vec3& point) {
+	Sum ex, ey, ez;
+	for (size_t k = 0; k < charges.count; k++) {
+		float dx = point[0] - charges.x[k];
+		float dy = point[1] - charges.y[k];
+		float dz = point[2] - charges.z[k];
+		float r2 = dx * dx + dy * dy + dz * dz;
+		float w = charges.q[k] / (r2 * sqrtf(r2) + FIELD_SOFTENING);
+		ex.add(w * dx);
+		ey.add(w * dy);
+		ez.add(w * dz);
+	}
+	return {{(float)ex.sum, (float)ey.sum, (float)ez.sum}};
+}
+
+Vec3 chargeField(const ChargeBuffer& charges, const Vec3& point) {
+	switch (charges.precision) {
+	case PRECISION_COMPENSATED:
+		return chargeFieldSummed<CompensatedSum>(charges, point);
+	case PRECISION_DOUBLE:
+		return chargeFieldSummed<DoubleSum>(charges, point);
+	default:
+		return chargeFieldSingle(charges, point);
+	}
+}
+
+double chargeFieldError(const ChargeBuffer& charges, const PlaneGrid& grid, size_t samples) {
+	size_t n = grid.size();
+	samples = std::min(samples, n);
+	double worst = 0;
+	for (size_t s = 0; s < samples; s++) {
+		size_t idx = s * n / samples;
+		Vec3 p = grid.point(idx % grid.width(), idx / grid.width());
+		Vec3 E = chargeField(charges, p);
+		double ref[3] = {0, 0, 0};
+		for (size_t k = 0; k < charges.count; k++) {
+			double d[3] = {(double)p[0] - charges.x[k], (double)p[1] - charges.y[k],
+				(double)p[2] - charges.z[k]};
+			double r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+			double w = charges.q[k] / (r2 * sqrt(r2) + (double)FIELD_SOFTENING);
+			for (int c = 0; c < 3; c++) {
+				ref[c] += w * d[c];
+			}
+		}
+		double norm = 0, diff = 0;
+		for (int c = 0; c < 3; c++) {
+			norm += ref[c] * ref[c];
+			diff += (E[c] - ref[c]) * (E[c] - ref[c]);
+		}
+		if (norm > 0) {
+			worst = std::max(worst, sqrt(diff / norm));
+		}
+	}
+	return worst;
+}
+
+void evaluateChargesTile(const ChargeBuffer& charges, const PlaneGrid& grid, FieldBuffer& field,
+	const Tile& tile) {
+	for (size_t j = tile.j0; j < tile.j1; j++) {
+		for (size_t i = tile.i0; i < tile.i1; i++) {
+			Vec3 E = chargeField(charges, grid.point(i, j));
+			size_t idx = j * field.width + i;
+			field.x[idx] += E[0];
+			field.y[idx] += E[1];
+			field.z[idx] += E[2];
+		}
+	}
+}
+
+void evaluateCharges(const ChargeBuffer& charges, const PlaneGrid& grid, FieldBuffer& field) {
+	if (field.width != grid.width() || field.height != grid.height()) {
+		field.resize(grid.width(), grid.height());
+	}
+	Tile all = {0, grid.width(), 0, grid.height()};
+	evaluateChargesTile(charges, grid, field, all);
+}
+
+void evaluateCharges(const ChargeBuffer& charges, const PlaneGrid& grid, FieldBuffer& field,
+	TaskPool& pool) {
+	if (field.width != grid.width() || field.height != grid.height()) {
+		field.resize(grid.width(), grid.height());
+	}
+	std::vector<Tile> tiles = tileGrid(grid.width(), grid.height());
+	pool.run(tiles.size(), [&](size_t t) {
+		evaluateChargesTile(charges, grid, field, tiles[t]);
+	});
+}
+
+void evaluateChargesAt(const ChargeBuffer& charges, const float* px, const float* py,
+	const float* pz, size_t count, float* ex, float* ey, float* ez, TaskPool& pool) {
+	const size_t block = FIELD_TILE * FIELD_TILE;
+	pool.run((count + block - 1) / block, [&](size_t t) {
+		size_t end = std::min(count, (t + 1) * block);
+		for (size_t k = t * block; k < end; k++) {
+			Vec3 p = {{px[k], py[k], pz[k]}};
+			Vec3 E = chargeField(charges, p);
+			ex[k] += E[0];
+			ey[k] += E[1];
+			ez[k] += E[2];
+		}
+	});
+}
+
+void evaluateCurrents(const CurrentBuffer& currents, const PlaneGrid& grid, FieldBuffer& field,
+	TaskPool& pool) {
+	if (field.width != grid.width() || field.height != grid.height()) {
+		field.resize(grid.width(), grid.height());
+	}
+	std::vector<Tile> tiles = tileGrid(grid.width(), grid.height());
+	pool.run(tiles.size(), [&](size_t t) {
+		const Tile& tile = tiles[t];
+		for (size_t j = tile.j0; j < tile.j1; j++) {
+			for (size_t i = tile.i0; i < tile.i1; i++) {
+				Vec3 B = currentField(currents, grid.point(i, j));
+				size_t idx = j * field.width + i;
+				field.x[idx] += B[0];
+				field.y[idx] += B[1];
+				field.z[idx] += B[2];
+			}
+		}
+	});
+}
+
+void evaluateCurrentsAt(const CurrentBuffer& currents, const float* px, const float* py,
+	const float* pz, size_t count, float* bx, float* by, float* bz, TaskPool& pool) {
+	const size_t block = FIELD_TILE * FIELD_TILE;
+	pool.run((count + block - 1) / block, [&](size_t t) {
+		size_t end = std::min(count, (t + 1) * block);
+		for (size_t k = t * block; k < end; k++) {
+			Vec3 p = {{px[k], py[k], pz[k]}};
+			Vec3 B = currentField(currents, p);
+			bx[k] += B[0];
+			by[k] += B[1];
+			bz[k] += B[2];
+		}
+	});
+}
+
+void evaluateFieldsTile(const ChargeBuffer& charges, const CurrentBuffer& currents,
+	const PlaneGrid& grid, FieldBuffer& efield, FieldBuffer& bfield, const Tile& tile) {
+	for (size_t j = tile.j0; j < tile.j1; j++) {
+		for (size_t i = tile.i0; i < tile.i1; i++) {
+			Vec3 p = grid.point(i, j);
+			Vec3 E = chargeField(charges, p);
+			Vec3 B = currentField(currents, p);
+			size_t idx = j * efield.width + i;
+			efield.x[idx] += E[0];
+			efield.y[idx] += E[1];
+			efield.z[idx] += E[2];
+			bfield.x[idx] += B[0];
+			bfield.y[idx] += B[1];
+			bfield.z[idx] += B[2];
+		}
+	}
+}
+
+void evaluateFields(const ChargeBuffer& charges, const CurrentBuffer& currents,
+	const PlaneGrid& grid, FieldBuffer& efield, FieldBuffer& bfield, TaskPool& pool) {
+	for (FieldBuffer* field : {&efield, &bfield}) {
+		if (field->width != grid.width() || field->height != grid.height()) {
+			field->resize(grid.width(), grid.height());
+		}
+	}
+	std::vector<Tile> tiles = tileGrid(grid.width(), grid.height());
+	pool.run(tiles.size(), [&](size_t t) {
+		evaluateFieldsTile(charges, currents, grid, efield, bfield, tiles[t]);
+	});
+}
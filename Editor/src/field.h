@@ -0,0 +1,145 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef FIELD_H
+#define FIELD_H
+
+#include <stddef.h>
+
+#include <array>
+#include <vector>
+
+using Vec3 = std::array<float, 3>;
+using Vec4 = std::array<float, 4>;
+// Straight current segment (I, x1, y1, z1, x2, y2, z2) from the first point
+// to the second
+using Segment = std::array<float, 7>;
+
+// Added to |s|^3 in the Coulomb denominator, as in the visualizer
+#define FIELD_SOFTENING 1e-6f
+
+// The charge buffers are padded with zero charges to a multiple of this
+// so the kernel never needs a scalar tail loop
+#define FIELD_LANES 8
+
+// How the contributions of the charges are summed; the terms themselves are
+// always computed in single precision. Single precision sums use the SIMD
+// kernels, the others a scalar loop with a compensated (Kahan) or a double
+// precision accumulator for large numbers of charges.
+#define PRECISION_SINGLE 0
+#define PRECISION_COMPENSATED 1
+#define PRECISION_DOUBLE 2
+
+#define PRECISION_COUNT 3
+extern const char* precisionNames[];
+
+// Point charges stored as structure of arrays (q, x, y, z)
+struct ChargeBuffer {
+	std::vector<float> q, x, y, z;
+	size_t count = 0;
+	// Kept by assign() and clear()
+	int precision = PRECISION_SINGLE;
+
+	void assign(const std::vector<Vec4>& charges);
+	void clear();
+	size_t padded() const { return q.size(); }
+};
+
+// Current segments stored as structure of arrays, padded like ChargeBuffer
+// with zero currents
+struct CurrentBuffer {
+	std::vector<float> I, ax, ay, az, bx, by, bz;
+	size_t count = 0;
+
+	void assign(const std::vector<Segment>& segments);
+	void clear();
+	size_t padded() const { return I.size(); }
+};
+
+// Sample points on the plane of interest. The plane is normal to `axis`;
+// `u` holds the samples along `axis1` and `v` those along `axis2`, with
+// axis1 < axis2 as in the visualizer.
+struct PlaneGrid {
+	int axis = 2;
+	float coordinate = 0;
+	int axis1 = 0, axis2 = 1;
+	std::vector<float> u, v;
+
+	void build(int axis, float coordinate, const Vec3& min, const Vec3& max,
+		const Vec3& margins, int resolution);
+	// Fixed number of samples between the given (already padded) extents
+	void build(int axis, float coordinate, const Vec3& lo, const Vec3& hi,
+		size_t width, size_t height);
+	size_t width() const { return u.size(); }
+	size_t height() const { return v.size(); }
+	size_t size() const { return u.size() * v.size(); }
+	Vec3 point(size_t i, size_t j) const;
+};
+
+// Field components on a plane grid, stored row-major (index j * width + i)
+struct FieldBuffer {
+	size_t width = 0, height = 0;
+	std::vector<float> x, y, z;
+
+	void resize(size_t width, size_t height);
+	void clear();
+	size_t size() const { return width * height; }
+};
+
+struct Tile;
+class TaskPool;
+
+void inferBounds(const std::vector<Vec4>& charges, Vec3& min, Vec3& max);
+
+Vec3 chargeField(const ChargeBuffer& charges, const Vec3& point);
+
+// Largest relative error of chargeField (with the buffer's precision) at up
+// to `samples` grid points spread evenly over the grid, against the field
+// computed entirely in double precision. Points where the reference field
+// vanishes are skipped.
+double chargeFieldError(const ChargeBuffer& charges, const PlaneGrid& grid, size_t samples);
+
+// Number of samples used by the headless precision check
+#define PRECISION_SAMPLES 1024
+
+// Biot-Savart field of the segments in the same units as the Coulomb field
+// (mu0 / 4pi = 1), using the closed form for a finite straight wire
+Vec3 currentField(const CurrentBuffer& currents, const Vec3& point);
+
+// Add the field of the charges to the given buffer, which is resized to
+// match the grid if needed
+void evaluateCharges(const ChargeBuffer& charges, const PlaneGrid& grid, FieldBuffer& field);
+void evaluateCharges(const ChargeBuffer& charges, const PlaneGrid& grid, FieldBuffer& field,
+	TaskPool& pool);
+void evaluateChargesTile(const ChargeBuffer& charges, const PlaneGrid& grid, FieldBuffer& field,
+	const Tile& tile);
+
+// Same for an arbitrary list of sample points
+void evaluateChargesAt(const ChargeBuffer& charges, const float* px, const float* py,
+	const float* pz, size_t count, float* ex, float* ey, float* ez, TaskPool& pool);
+
+void evaluateCurrents(const CurrentBuffer& currents, const PlaneGrid& grid, FieldBuffer& field,
+	TaskPool& pool);
+void evaluateCurrentsAt(const CurrentBuffer& currents, const float* px, const float* py,
+	const float* pz, size_t count, float* bx, float* by, float* bz, TaskPool& pool);
+
+// Electric and magnetic fields in a single pass over the grid, so each tile
+// is visited (and its sample points computed) once
+void evaluateFields(const ChargeBuffer& charges, const CurrentBuffer& currents,
+	const PlaneGrid& grid, FieldBuffer& efield, FieldBuffer& bfield, TaskPool& pool);
+void evaluateFieldsTile(const ChargeBuffer& charges, const CurrentBuffer& currents,
+	const PlaneGrid& grid, FieldBuffer& efield, FieldBuffer& bfield, const Tile& tile);
+
+#endif
@@ -0,0 +1,196 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fieldfile.h"
+
+static_assert(sizeof(FieldFileHeader) == 64, "field file header must be 64 bytes");
+
+bool writeFieldFile(const char* filename, const PlaneGrid& grid, const FieldBuffer& field, char kind) {
+	FieldFileWriter writer;
+	return writer.open(filename, grid, kind, std::vector<float>()) && writer.write(field) && writer.close();
+}
+
+FieldFileWriter::~FieldFileWriter() {
+	if (file) {
+		fclose(file);
+	}
+}
+
+bool FieldFileWriter::open(const char* filename, const PlaneGrid& grid, char kind,
+	const std::vector<float>& slabs) {
+	file = fopen(filename, "wb");
+	if (!file) {
+		return false;
+	}
+	FieldFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FIELD_FILE_MAGIC, 4);
+	header.version = FIELD_FILE_VERSION;
+	header.dtype = FIELD_FLOAT32;
+	header.kind = kind;
+	header.axis = grid.axis;
+	header.axis1 = grid.axis1;
+	header.axis2 = grid.axis2;
+	header.depth = slabs.size();
+	header.width = grid.width();
+	header.height = grid.height();
+	header.coordinate = slabs.empty() ? grid.coordinate : slabs[0];
+	header.dataOffset = sizeof(header);
+	ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	const std::vector<float>* arrays[] = {&grid.u, &grid.v, &slabs};
+	for (const std::vector<float>* array : arrays) {
+		ok = ok && fwrite(array->data(), sizeof(float), array->size(), file) == array->size();
+	}
+	slabSize = grid.size();
+	remaining = slabs.empty() ? 1 : slabs.size();
+	return ok;
+}
+
+bool FieldFileWriter::write(const FieldBuffer& field) {
+	if (!file || remaining == 0 || field.size() != slabSize) {
+		ok = false;
+		return false;
+	}
+	const std::vector<float>* arrays[] = {&field.x, &field.y, &field.z};
+	for (const std::vector<float>* array : arrays) {
+		ok = ok && fwrite(array->data(), sizeof(float), array->size(), file) == array->size();
+	}
+	remaining--;
+	return ok;
+}
+
+bool FieldFileWriter::close() {
+	if (!file) {
+		return false;
+	}
+	bool closed = fclose(file) == 0;
+	file = nullptr;
+	return closed && ok && remaining == 0;
+}
+
+MappedField::~MappedField() {
+	close();
+}
+
+bool MappedField::open(const char* filename) {
+	close();
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FieldFileHeader)) {
+		::close(fd);
+		return false;
+	}
+	void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+	data = (const char*)map;
+	length = st.st_size;
+	header = (const FieldFileHeader*)data;
+	size_t samples = header->width * header->height;
+	if (memcmp(header->magic, FIELD_FILE_MAGIC, 4) || header->version != FIELD_FILE_VERSION
+		|| header->dtype > FIELD_FLOAT64
+		|| header->dataOffset + (header->width + header->height + header->depth
+			+ 3 * samples * slabs()) * itemSize() > length) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedField::close() {
+	if (data) {
+		munmap((void*)data, length);
+	}
+	header = nullptr;
+	data = nullptr;
+	length = 0;
+}
+
+const float* MappedField::u() const {
+	if (header->dtype != FIELD_FLOAT32) {
+		return nullptr;
+	}
+	return (const float*)(data + header->dataOffset);
+}
+
+const float* MappedField::v() const {
+	const float* base = u();
+	return base ? base + header->width : nullptr;
+}
+
+const float* MappedField::w() const {
+	const float* base = v();
+	return base ? base + header->height : nullptr;
+}
+
+const float* MappedField::component(int axis, size_t slab) const {
+	const float* base = w();
+	if (!base || slab >= slabs()) {
+		return nullptr;
+	}
+	size_t samples = header->width * header->height;
+	return base + header->depth + (3 * slab + axis) * samples;
+}
+
+template <typename T>
+static void copyArray(const char* src, size_t count, std::vector<float>& dst) {
+	dst.resize(count);
+	const T* values = (const T*)src;
+	for (size_t k = 0; k < count; k++) {
+		dst[k] = values[k];
+	}
+}
+
+bool MappedField::read(PlaneGrid& grid, FieldBuffer& field, size_t slab) const {
+	if (slab >= slabs()) {
+		return false;
+	}
+	grid.axis = header->axis;
+	grid.axis1 = header->axis1;
+	grid.axis2 = header->axis2;
+	field.width = header->width;
+	field.height = header->height;
+	size_t samples = header->width * header->height;
+	const char* src = data + header->dataOffset;
+	std::vector<float> slabs;
+	std::vector<float>* arrays[] = {&grid.u, &grid.v, &slabs, &field.x, &field.y, &field.z};
+	size_t counts[] = {header->width, header->height, header->depth, samples, samples, samples};
+	for (int k = 0; k < 6; k++) {
+		if (k == 3) {
+			// Skip to the requested slab
+			src += 3 * samples * slab * itemSize();
+		}
+		if (header->dtype == FIELD_FLOAT64) {
+			copyArray<double>(src, counts[k], *arrays[k]);
+		} else {
+			copyArray<float>(src, counts[k], *arrays[k]);
+		}
+		src += counts[k] * itemSize();
+	}
+	grid.coordinate = header->depth ? slabs[slab] : header->coordinate;
+	return true;
+}
@@ -0,0 +1,117 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef FIELDFILE_H
+#define FIELDFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "field.h"
+
+// Binary field data shared with the visualizer (Visualizer/fieldfile.py).
+// A fixed little-endian header is followed by the sample coordinates along
+// the two in-plane axes and then the three field components, each stored
+// contiguously in row-major order (v, u), so either side can map the file
+// and use the arrays in place. Volume files hold a stack of such planes
+// (slabs) along the normal axis: the slab coordinates follow the in-plane
+// axes and the slabs are stored one after the other, so they can be written
+// as they are computed.
+
+#define FIELD_FILE_MAGIC "EMFD"
+#define FIELD_FILE_VERSION 1
+
+#define FIELD_FLOAT32 0
+#define FIELD_FLOAT64 1
+
+struct FieldFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t dtype;
+	// 'E' or 'B'
+	uint32_t kind;
+	int32_t axis;
+	int32_t axis1;
+	int32_t axis2;
+	// Number of slabs of a volume file, or 0 for a single plane
+	uint32_t depth;
+	uint64_t width;
+	uint64_t height;
+	double coordinate;
+	// Offset of the u axis from the start of the file
+	uint64_t dataOffset;
+};
+
+bool writeFieldFile(const char* filename, const PlaneGrid& grid, const FieldBuffer& field, char kind);
+
+// Writes a volume file slab by slab so only one slab needs to be in memory
+class FieldFileWriter {
+	FILE* file = nullptr;
+	size_t slabSize = 0;
+	size_t remaining = 0;
+	bool ok = true;
+public:
+	FieldFileWriter() = default;
+	FieldFileWriter(const FieldFileWriter&) = delete;
+	FieldFileWriter& operator=(const FieldFileWriter&) = delete;
+	~FieldFileWriter();
+
+	// Writes the header and axes; `slabs` holds the coordinate of each slab
+	// along grid.axis, or is empty for a single plane at grid.coordinate
+	bool open(const char* filename, const PlaneGrid& grid, char kind, const std::vector<float>& slabs);
+	// Appends the next slab, computed on the grid passed to open
+	bool write(const FieldBuffer& field);
+	// Fails if not all slabs were written
+	bool close();
+};
+
+// Read-only memory mapping of a field file
+class MappedField {
+	const FieldFileHeader* header = nullptr;
+	const char* data = nullptr;
+	size_t length = 0;
+public:
+	MappedField() = default;
+	MappedField(const MappedField&) = delete;
+	MappedField& operator=(const MappedField&) = delete;
+	~MappedField();
+
+	// Maps the file and validates its header and size
+	bool open(const char* filename);
+	void close();
+	bool isOpen() const { return header != nullptr; }
+
+	const FieldFileHeader& info() const { return *header; }
+	size_t width() const { return header->width; }
+	size_t height() const { return header->height; }
+	size_t depth() const { return header->depth; }
+	size_t slabs() const { return header->depth ? header->depth : 1; }
+	size_t itemSize() const { return header->dtype == FIELD_FLOAT64 ? 8 : 4; }
+
+	// Pointers into the mapping, or null if the file doesn't hold float32
+	// data (e.g. double precision output from the visualizer)
+	const float* u() const;
+	const float* v() const;
+	// Slab coordinates of a volume file
+	const float* w() const;
+	// Null as well if the file has no such slab
+	const float* component(int axis, size_t slab = 0) const;
+
+	// Copies a slab into the engine's structures, converting from double
+	// precision if needed; false if the file has no such slab
+	bool read(PlaneGrid& grid, FieldBuffer& field, size_t slab = 0) const;
+};
+
+#endif
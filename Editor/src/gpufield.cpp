@@ -0,0 +1,184 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <algorithm>
+
+#include "gpufield.h"
+#include "profile.h"
+
+// Work group size along each axis; a work group reads CHARGE_BLOCK charges
+// into shared memory per step
+#define GPU_GROUP 16
+#define CHARGE_BLOCK (GPU_GROUP * GPU_GROUP)
+
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+
+static const char* shaderSource =
+	"#version 430\n"
+	"#define GROUP " TOSTRING(GPU_GROUP) "\n"
+	"#define BLOCK " TOSTRING(CHARGE_BLOCK) "\n"
+	"#define SOFTENING " TOSTRING(FIELD_SOFTENING) "\n"
+	"layout(local_size_x = GROUP, local_size_y = GROUP) in;\n"
+	"layout(std430, binding = 0) readonly buffer Charges { float charges[]; };\n"
+	"layout(std430, binding = 1) readonly buffer Axes { float axes[]; };\n"
+	"layout(std430, binding = 2) writeonly buffer Field { float field[]; };\n"
+	"uniform uint width;\n"
+	"uniform uint height;\n"
+	"uniform uint padded;\n"
+	"uniform int axis;\n"
+	"uniform int axis1;\n"
+	"uniform int axis2;\n"
+	"uniform float coordinate;\n"
+	"shared vec4 staged[BLOCK];\n"
+	"void main() {\n"
+	"	uvec2 id = gl_GlobalInvocationID.xy;\n"
+	"	bool inside = id.x < width && id.y < height;\n"
+	"	vec3 p;\n"
+	"	p[axis] = coordinate;\n"
+	"	p[axis1] = inside ? axes[id.x] : 0.0;\n"
+	"	p[axis2] = inside ? axes[width + id.y] : 0.0;\n"
+	"	vec3 E = vec3(0.0);\n"
+	"	for (uint base = 0u; base < padded; base += uint(BLOCK)) {\n"
+	"		uint k = base + gl_LocalInvocationIndex;\n"
+	"		staged[gl_LocalInvocationIndex] = k < padded\n"
+	"			? vec4(charges[padded + k], charges[2u * padded + k], charges[3u * padded + k], charges[k])\n"
+	"			: vec4(0.0);\n"
+	"		barrier();\n"
+	"		for (int j = 0; j < BLOCK; j++) {\n"
+	"			vec3 d = p - staged[j].xyz;\n"
+	"			float r2 = dot(d, d);\n"
+	"			E += staged[j].w / (r2 * sqrt(r2) + SOFTENING) * d;\n"
+	"		}\n"
+	"		barrier();\n"
+	"	}\n"
+	"	if (inside) {\n"
+	"		uint idx = id.y * width + id.x;\n"
+	"		uint n = width * height;\n"
+	"		field[idx] = E.x;\n"
+	"		field[n + idx] = E.y;\n"
+	"		field[2u * n + idx] = E.z;\n"
+	"	}\n"
+	"}\n";
+
+bool GpuChargeField::supported() {
+	return GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object);
+}
+
+bool GpuChargeField::init() {
+	if (program) {
+		return true;
+	}
+	if (!supported()) {
+		log = "Compute shaders are not supported by this OpenGL context";
+		return false;
+	}
+	GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(shader, 1, &shaderSource, nullptr);
+	glCompileShader(shader);
+	GLint status = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		char buf[1024];
+		glGetShaderInfoLog(shader, sizeof(buf), nullptr, buf);
+		log = buf;
+		glDeleteShader(shader);
+		return false;
+	}
+	program = glCreateProgram();
+	glAttachShader(program, shader);
+	glLinkProgram(program);
+	glDeleteShader(shader);
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status) {
+		char buf[1024];
+		glGetProgramInfoLog(program, sizeof(buf), nullptr, buf);
+		log = buf;
+		glDeleteProgram(program);
+		program = 0;
+		return false;
+	}
+	glGenBuffers(3, buffers);
+	log.clear();
+	return true;
+}
+
+void GpuChargeField::release() {
+	if (program) {
+		glDeleteBuffers(3, buffers);
+		glDeleteProgram(program);
+		program = 0;
+		padded = 0;
+	}
+}
+
+void GpuChargeField::upload(const ChargeBuffer& charges) {
+	if (!program) {
+		return;
+	}
+	padded = charges.padded();
+	std::vector<float> data;
+	data.reserve(4 * padded);
+	for (const std::vector<float>* array : {&charges.q, &charges.x, &charges.y, &charges.z}) {
+		data.insert(data.end(), array->begin(), array->end());
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[0]);
+	// An empty store can't be bound, so there is always at least one element
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(data.size(), 1) * sizeof(float),
+		data.empty() ? nullptr : data.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+bool GpuChargeField::evaluate(const PlaneGrid& grid, FieldBuffer& field) {
+	if (!program) {
+		return false;
+	}
+	ProfileScope stage("gpu-charges");
+	size_t width = grid.width(), height = grid.height();
+	field.resize(width, height);
+	size_t n = width * height;
+	if (n == 0) {
+		return true;
+	}
+	std::vector<float> axes(grid.u);
+	axes.insert(axes.end(), grid.v.begin(), grid.v.end());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, axes.size() * sizeof(float), axes.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[2]);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 3 * n * sizeof(float), nullptr, GL_STREAM_READ);
+	for (GLuint i = 0; i < 3; i++) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, buffers[i]);
+	}
+
+	glUseProgram(program);
+	glUniform1ui(glGetUniformLocation(program, "width"), width);
+	glUniform1ui(glGetUniformLocation(program, "height"), height);
+	glUniform1ui(glGetUniformLocation(program, "padded"), padded);
+	glUniform1i(glGetUniformLocation(program, "axis"), grid.axis);
+	glUniform1i(glGetUniformLocation(program, "axis1"), grid.axis1);
+	glUniform1i(glGetUniformLocation(program, "axis2"), grid.axis2);
+	glUniform1f(glGetUniformLocation(program, "coordinate"), grid.coordinate);
+	glDispatchCompute((width + GPU_GROUP - 1) / GPU_GROUP, (height + GPU_GROUP - 1) / GPU_GROUP, 1);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glUseProgram(0);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[2]);
+	std::vector<float>* out[] = {&field.x, &field.y, &field.z};
+	for (int c = 0; c < 3; c++) {
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, c * n * sizeof(float), n * sizeof(float), out[c]->data());
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	return glGetError() == GL_NO_ERROR;
+}
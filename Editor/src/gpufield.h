@@ -0,0 +1,56 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef GPUFIELD_H
+#define GPUFIELD_H
+
+#include <string>
+
+#include <GL/glew.h>
+
+#include "field.h"
+
+// Direct summation of the field of point charges in an OpenGL compute
+// shader. The charge buffer is uploaded once and can then be evaluated on
+// any number of grids; each work group steps through the charges in blocks
+// staged in shared memory. Requires a current context with compute shaders
+// (OpenGL 4.3 or ARB_compute_shader).
+class GpuChargeField {
+	GLuint program = 0;
+	// Charges (q, x, y, z as in ChargeBuffer), grid axes (u then v), field
+	GLuint buffers[3] = {0, 0, 0};
+	size_t padded = 0;
+	std::string log;
+public:
+	GpuChargeField() = default;
+	GpuChargeField(const GpuChargeField&) = delete;
+	GpuChargeField& operator=(const GpuChargeField&) = delete;
+
+	// Whether the current context supports compute shaders
+	static bool supported();
+
+	// Compiles the shader in the current context
+	bool init();
+	// Frees the GPU resources; the context must still be current
+	void release();
+	bool ready() const { return program != 0; }
+	const std::string& error() const { return log; }
+
+	void upload(const ChargeBuffer& charges);
+	// Computes the field of the uploaded charges and reads it back
+	bool evaluate(const PlaneGrid& grid, FieldBuffer& field);
+};
+
+#endif
@@ -0,0 +1,116 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <algorithm>
+
+#include "incremental.h"
+#include "profile.h"
+#include "scheduler.h"
+
+void IncrementalField::reset(const PlaneGrid& grid) {
+	this->grid = grid;
+	total.resize(grid.width(), grid.height());
+	sources.clear();
+	updates = 0;
+	valid = false;
+}
+
+void IncrementalField::assign(const std::vector<Vec4>& charges, const FieldBuffer& field) {
+	total = field;
+	sources = charges;
+	updates = 0;
+	valid = true;
+}
+
+const FieldBuffer& IncrementalField::update(const std::vector<Vec4>& charges, TaskPool& pool) {
+	apply(charges, pool, nullptr);
+	return total;
+}
+
+bool IncrementalField::update(const std::vector<Vec4>& charges, TaskPool& pool, JobControl& control) {
+	return apply(charges, pool, &control);
+}
+
+bool IncrementalField::apply(const std::vector<Vec4>& charges, TaskPool& pool, JobControl* control) {
+	// Edits in the UI touch one contiguous run of charges (a changed value,
+	// an insertion or a deletion), which is what remains after stripping the
+	// common prefix and suffix
+	size_t prefix = 0;
+	size_t shorter = std::min(charges.size(), sources.size());
+	while (prefix < shorter && charges[prefix] == sources[prefix]) {
+		prefix++;
+	}
+	size_t suffix = 0;
+	while (suffix < shorter - prefix
+		&& charges[charges.size() - 1 - suffix] == sources[sources.size() - 1 - suffix]) {
+		suffix++;
+	}
+	size_t added = charges.size() - prefix - suffix;
+	size_t removed = sources.size() - prefix - suffix;
+	if (valid && added == 0 && removed == 0) {
+		return true;
+	}
+	ProfileScope stage("incremental");
+
+	bool full = !valid || updates >= MAX_UPDATES || 4 * (added + removed) > charges.size();
+	std::vector<Vec4> changed;
+	if (full) {
+		changed = charges;
+	} else {
+		changed.assign(charges.begin() + prefix, charges.begin() + prefix + added);
+		for (size_t i = prefix; i < prefix + removed; i++) {
+			Vec4 charge = sources[i];
+			charge[0] = -charge[0];
+			changed.push_back(charge);
+		}
+	}
+	profiler.count("points", (double)grid.size());
+	profiler.count("interactions", (double)grid.size() * changed.size());
+	if (!control) {
+		if (full) {
+			total.clear();
+		}
+		delta.assign(changed);
+		evaluateCharges(delta, grid, total, pool);
+	} else {
+		// Accumulated separately so a cancelled update leaves no trace
+		partial.resize(grid.width(), grid.height());
+		control->total = (changed.size() + CHUNK - 1) / CHUNK;
+		for (size_t begin = 0; begin < changed.size(); begin += CHUNK) {
+			if (control->cancelled) {
+				return false;
+			}
+			size_t end = std::min(changed.size(), begin + CHUNK);
+			delta.assign(std::vector<Vec4>(changed.begin() + begin, changed.begin() + end));
+			evaluateCharges(delta, grid, partial, pool);
+			control->done++;
+		}
+		if (full) {
+			total.x.swap(partial.x);
+			total.y.swap(partial.y);
+			total.z.swap(partial.z);
+		} else {
+			for (size_t k = 0; k < total.size(); k++) {
+				total.x[k] += partial.x[k];
+				total.y[k] += partial.y[k];
+				total.z[k] += partial.z[k];
+			}
+		}
+	}
+	updates = full ? 0 : updates + 1;
+	sources = charges;
+	valid = true;
+	return true;
+}
@@ -0,0 +1,57 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "field.h"
+
+struct JobControl;
+
+// Keeps the field of a list of charges on a fixed grid up to date as the
+// list is edited. The field is linear in the charges, so only the charges
+// that differ from the previous list are evaluated: the new ones are added
+// and the old ones subtracted.
+class IncrementalField {
+public:
+	// After this many incremental updates the field is recomputed from
+	// scratch so rounding errors can't accumulate
+	static const int MAX_UPDATES = 256;
+	// Charges evaluated between checks for cancellation
+	static const size_t CHUNK = 4096;
+
+	void reset(const PlaneGrid& grid);
+	const FieldBuffer& update(const std::vector<Vec4>& charges, TaskPool& pool);
+	// Same in chunks of charges, giving up if the job is cancelled; the field
+	// and the charges it was computed from are only changed once every
+	// chunk is done
+	bool update(const std::vector<Vec4>& charges, TaskPool& pool, JobControl& control);
+	// Takes over a field computed elsewhere from the given charges on the
+	// current grid
+	void assign(const std::vector<Vec4>& charges, const FieldBuffer& field);
+	const FieldBuffer& field() const { return total; }
+	const PlaneGrid& plane() const { return grid; }
+private:
+	bool apply(const std::vector<Vec4>& charges, TaskPool& pool, JobControl* control);
+
+	PlaneGrid grid;
+	FieldBuffer total, partial;
+	std::vector<Vec4> sources;
+	ChargeBuffer delta;
+	int updates = 0;
+	bool valid = false;
+};
+
+#endif
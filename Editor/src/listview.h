@@ -0,0 +1,182 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef LISTVIEW_H
+#define LISTVIEW_H
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "imgui.h"
+
+// Filtered, clipped view of a list in the editor. Only the rows that are
+// visible are submitted each frame; the rows passing the filter are cached
+// and rebuilt only when the filter, the length of the list or (through
+// `dirty`) its contents change. Rows are selected with checkboxes and
+// deletions are collected and applied in a single pass after drawing.
+// Every item has a stable ID for ImGui::PushID that moves with it when the
+// items before it are deleted, so the state of its widgets (e.g. a field
+// being edited) stays with it. Nothing is allocated in frames where the
+// list does not change.
+struct ListView {
+	// Number of rows visible without scrolling
+	static const int VISIBLE_ROWS = 12;
+
+	ImGuiTextFilter filter;
+	// Indices of the items passing the filter
+	std::vector<int> rows;
+	std::vector<char> selected;
+	std::vector<char> removed;
+	// Stable ID of each item
+	std::vector<int> ids;
+	int nextId = 0;
+	bool dirty = true;
+	bool anyRemoved = false;
+	// Item opened in a detail editor, or -1
+	int active = -1;
+
+	// Draws the filter and the bulk operations; `describe(i, buf, size)`
+	// formats item i for filtering
+	template <typename F>
+	void header(size_t count, F describe) {
+		if (filter.Draw("Filter##ListFilter")) {
+			dirty = true;
+		}
+		if (selected.size() != count) {
+			selected.resize(count, 0);
+			dirty = true;
+		}
+		if (ids.size() > count) {
+			ids.resize(count);
+		}
+		while (ids.size() < count) {
+			ids.push_back(nextId++);
+		}
+		removed.assign(count, 0);
+		anyRemoved = false;
+		if (dirty) {
+			char buf[256];
+			rows.clear();
+			for (size_t i = 0; i < count; i++) {
+				if (filter.IsActive()) {
+					describe(i, buf, sizeof(buf));
+					if (!filter.PassFilter(buf)) {
+						continue;
+					}
+				}
+				rows.push_back(i);
+			}
+			dirty = false;
+		}
+		ImGui::Text("%zu of %zu shown", rows.size(), count);
+		ImGui::SameLine();
+		if (ImGui::Button("Select shown")) {
+			for (int i : rows) {
+				selected[i] = 1;
+			}
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Select none")) {
+			std::fill(selected.begin(), selected.end(), 0);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Delete selected")) {
+			for (size_t i = 0; i < count; i++) {
+				remove(i, selected[i]);
+			}
+		}
+	}
+
+	// Draws the visible rows with `row(i)` in a scrolling child window of
+	// rows of the given height
+	template <typename F>
+	void body(const char* id, float rowHeight, F row) {
+		int shown = std::min<int>(rows.size(), VISIBLE_ROWS);
+		ImGui::BeginChild(id, ImVec2(0, std::max(shown, 1) * rowHeight + rowHeight / 2), true);
+		ImGuiListClipper clipper;
+		clipper.Begin(rows.size(), rowHeight);
+		while (clipper.Step()) {
+			for (int r = clipper.DisplayStart; r < clipper.DisplayEnd; r++) {
+				int i = rows[r];
+				ImGui::PushID(ids[i]);
+				bool checked = selected[i];
+				if (ImGui::Checkbox("##Selected", &checked)) {
+					selected[i] = checked;
+				}
+				ImGui::SameLine();
+				row(i);
+				ImGui::PopID();
+			}
+		}
+		clipper.End();
+		ImGui::EndChild();
+	}
+
+	// To be called with whether an item was edited in place, which may
+	// change whether it passes the filter
+	void edited(bool changed) {
+		if (changed && filter.IsActive()) {
+			dirty = true;
+		}
+	}
+
+	// Forgets the selection and the IDs, e.g. after the list was replaced
+	void reset() {
+		selected.clear();
+		ids.clear();
+		active = -1;
+		dirty = true;
+	}
+
+	void remove(size_t i, bool remove = true) {
+		if (remove) {
+			removed[i] = 1;
+			anyRemoved = true;
+		}
+	}
+
+	// Erases the items marked for removal, keeping the selection of the rest
+	template <typename T>
+	void apply(std::vector<T>& items) {
+		if (!anyRemoved) {
+			return;
+		}
+		size_t kept = 0;
+		int moved = -1;
+		for (size_t i = 0; i < items.size(); i++) {
+			if (!removed[i]) {
+				if (kept != i) {
+					items[kept] = std::move(items[i]);
+				}
+				selected[kept] = selected[i];
+				ids[kept] = ids[i];
+				if ((int)i == active) {
+					moved = kept;
+				}
+				kept++;
+			}
+		}
+		active = moved;
+		items.erase(items.begin() + kept, items.end());
+		selected.resize(kept);
+		ids.resize(kept);
+		anyRemoved = false;
+		dirty = true;
+	}
+};
+
+#endif
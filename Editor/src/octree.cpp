@@ -0,0 +1,194 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "octree.h"
+#include "scheduler.h"
+
+const char* solverNames[] = {
+	"direct", "barnes-hut"
+};
+
+// Deeper than this, coincident charges would be split forever
+#define OCTREE_MAX_DEPTH 20
+
+void ChargeTree::build(const std::vector<Vec4>& charges) {
+	nodes.clear();
+	buckets.clear();
+	count = charges.size();
+	Node root;
+	root.center = {{0, 0, 0}};
+	root.size = 0;
+	if (!charges.empty()) {
+		Vec3 min, max;
+		inferBounds(charges, min, max);
+		for (int i = 0; i < 3; i++) {
+			root.center[i] = (min[i] + max[i]) / 2;
+			root.size = std::max(root.size, max[i] - min[i]);
+		}
+	}
+	nodes.push_back(root);
+	std::vector<Vec4> sorted(charges);
+	build(0, sorted, 0, sorted.size(), 0);
+}
+
+void ChargeTree::build(int node, std::vector<Vec4>& charges, size_t begin, size_t end, int depth) {
+	float q = 0, abs = 0;
+	Vec3 c = {{0, 0, 0}};
+	for (size_t k = begin; k < end; k++) {
+		q += charges[k][0];
+		abs += fabsf(charges[k][0]);
+		for (int i = 0; i < 3; i++) {
+			c[i] += fabsf(charges[k][0]) * charges[k][i + 1];
+		}
+	}
+	for (int i = 0; i < 3; i++) {
+		c[i] = abs > 0 ? c[i] / abs : nodes[node].center[i];
+	}
+	Vec3 p = {{0, 0, 0}};
+	for (size_t k = begin; k < end; k++) {
+		for (int i = 0; i < 3; i++) {
+			p[i] += charges[k][0] * (charges[k][i + 1] - c[i]);
+		}
+	}
+	nodes[node].n = end - begin;
+	nodes[node].q = q;
+	nodes[node].c = c;
+	nodes[node].p = p;
+	nodes[node].children = -1;
+	nodes[node].bucket = -1;
+
+	if (end - begin <= OCTREE_LEAF_SIZE || depth >= OCTREE_MAX_DEPTH) {
+		nodes[node].bucket = (int)buckets.size();
+		buckets.push_back(ChargeBuffer());
+		buckets.back().assign(std::vector<Vec4>(charges.begin() + begin, charges.begin() + end));
+		return;
+	}
+
+	// Sort the charges into octants; bit i of the octant is set when the
+	// charge lies above the center on axis i
+	Vec3 center = nodes[node].center;
+	float size = nodes[node].size;
+	auto octant = [&](const Vec4& charge) {
+		int o = 0;
+		for (int i = 0; i < 3; i++) {
+			o |= (charge[i + 1] > center[i]) << i;
+		}
+		return o;
+	};
+	size_t bounds[9] = {begin};
+	for (int o = 0; o < 8; o++) {
+		auto mid = std::partition(charges.begin() + bounds[o], charges.begin() + end,
+			[&](const Vec4& charge) { return octant(charge) == o; });
+		bounds[o + 1] = mid - charges.begin();
+	}
+
+	int first = (int)nodes.size();
+	nodes[node].children = first;
+	for (int o = 0; o < 8; o++) {
+		Node child;
+		child.size = size / 2;
+		for (int i = 0; i < 3; i++) {
+			child.center[i] = center[i] + (o >> i & 1 ? size : -size) / 4;
+		}
+		child.n = 0;
+		child.children = -1;
+		child.bucket = -1;
+		nodes.push_back(child);
+	}
+	for (int o = 0; o < 8; o++) {
+		if (bounds[o + 1] > bounds[o]) {
+			build(first + o, charges, bounds[o], bounds[o + 1], depth + 1);
+		}
+	}
+}
+
+Vec3 ChargeTree::field(const Vec3& point, float theta) const {
+	Vec3 E = {{0, 0, 0}};
+	if (nodes.empty()) {
+		return E;
+	}
+	int stack[8 * OCTREE_MAX_DEPTH + 8];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (node.n == 0) {
+			continue;
+		}
+		Vec3 s;
+		for (int i = 0; i < 3; i++) {
+			s[i] = point[i] - node.c[i];
+		}
+		float r2 = s[0] * s[0] + s[1] * s[1] + s[2] * s[2];
+		float r = sqrtf(r2);
+		if (node.size < theta * r) {
+			// Monopole and dipole terms
+			float inv = 1 / (r2 * r + FIELD_SOFTENING);
+			float ps = node.p[0] * s[0] + node.p[1] * s[1] + node.p[2] * s[2];
+			for (int i = 0; i < 3; i++) {
+				E[i] += (node.q * s[i] + 3 * ps * s[i] / r2 - node.p[i]) * inv;
+			}
+		} else if (node.children < 0) {
+			Vec3 e = chargeField(buckets[node.bucket], point);
+			for (int i = 0; i < 3; i++) {
+				E[i] += e[i];
+			}
+		} else {
+			for (int o = 0; o < 8; o++) {
+				stack[top++] = node.children + o;
+			}
+		}
+	}
+	return E;
+}
+
+void evaluateTree(const ChargeTree& tree, const PlaneGrid& grid, FieldBuffer& field,
+	float theta, TaskPool& pool) {
+	if (field.width != grid.width() || field.height != grid.height()) {
+		field.resize(grid.width(), grid.height());
+	}
+	std::vector<Tile> tiles = tileGrid(grid.width(), grid.height());
+	pool.run(tiles.size(), [&](size_t t) {
+		const Tile& tile = tiles[t];
+		for (size_t j = tile.j0; j < tile.j1; j++) {
+			for (size_t i = tile.i0; i < tile.i1; i++) {
+				Vec3 E = tree.field(grid.point(i, j), theta);
+				size_t idx = j * field.width + i;
+				field.x[idx] += E[0];
+				field.y[idx] += E[1];
+				field.z[idx] += E[2];
+			}
+		}
+	});
+}
+
+void evaluateTreeAt(const ChargeTree& tree, float theta, const float* px, const float* py,
+	const float* pz, size_t count, float* ex, float* ey, float* ez, TaskPool& pool) {
+	const size_t block = FIELD_TILE * FIELD_TILE;
+	pool.run((count + block - 1) / block, [&](size_t t) {
+		size_t end = std::min(count, (t + 1) * block);
+		for (size_t k = t * block; k < end; k++) {
+			Vec3 p = {{px[k], py[k], pz[k]}};
+			Vec3 E = tree.field(p, theta);
+			ex[k] += E[0];
+			ey[k] += E[1];
+			ez[k] += E[2];
+		}
+	});
+}
@@ -0,0 +1,67 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include "field.h"
+
+#define SOLVER_DIRECT 0
+#define SOLVER_BARNES_HUT 1
+
+#define SOLVER_COUNT 2
+extern const char* solverNames[];
+
+// Maximum number of charges in a leaf, which is summed directly
+#define OCTREE_LEAF_SIZE 16
+
+// Barnes-Hut octree over a set of point charges. Cells that are small
+// compared to their distance from the sample point (size / distance below
+// the opening angle) are replaced by their total charge and dipole moment
+// about the center of absolute charge, which stays accurate for cells
+// whose charges largely cancel. An opening angle of 0 gives the direct sum.
+class ChargeTree {
+public:
+	void build(const std::vector<Vec4>& charges);
+	Vec3 field(const Vec3& point, float theta) const;
+	size_t size() const { return count; }
+private:
+	struct Node {
+		Vec3 center;
+		float size;
+		size_t n;
+		float q;
+		Vec3 c;
+		Vec3 p;
+		// Index of the first of 8 consecutive child nodes, or -1 for a leaf
+		int children;
+		// Charges of a leaf, packed for the direct sum kernel
+		int bucket;
+	};
+
+	void build(int node, std::vector<Vec4>& charges, size_t begin, size_t end, int depth);
+
+	std::vector<Node> nodes;
+	std::vector<ChargeBuffer> buckets;
+	size_t count = 0;
+};
+
+void evaluateTree(const ChargeTree& tree, const PlaneGrid& grid, FieldBuffer& field,
+	float theta, TaskPool& pool);
+
+void evaluateTreeAt(const ChargeTree& tree, float theta, const float* px, const float* py,
+	const float* pz, size_t count, float* ex, float* ey, float* ez, TaskPool& pool);
+
+#endif
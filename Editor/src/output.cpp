@@ -0,0 +1,159 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "output.h"
+
+static const std::vector<float>& component(const FieldBuffer& field, int axis) {
+	return axis == 0 ? field.x : axis == 1 ? field.y : field.z;
+}
+
+bool writeFieldText(const char* filename, const PlaneGrid& grid, const FieldBuffer& field) {
+	FILE* file = fopen(filename, "w");
+	if (!file) {
+		return false;
+	}
+	const char* names = "xyz";
+	fprintf(file, "# %c %c Ex Ey Ez (%c = %g)\n", names[grid.axis1], names[grid.axis2],
+		names[grid.axis], grid.coordinate);
+	for (size_t j = 0; j < grid.height(); j++) {
+		for (size_t i = 0; i < grid.width(); i++) {
+			size_t k = j * field.width + i;
+			fprintf(file, "%g %g %g %g %g\n", grid.u[i], grid.v[j], field.x[k], field.y[k], field.z[k]);
+		}
+	}
+	return fclose(file) == 0;
+}
+
+bool writeFieldImage(const char* filename, const PlaneGrid& grid, const FieldBuffer& field) {
+	return writeFieldImage(filename, field.width, field.height,
+		component(field, grid.axis1).data(), component(field, grid.axis2).data());
+}
+
+bool writeFieldImage(const char* filename, size_t width, size_t height, const float* f1, const float* f2) {
+	size_t n = width * height;
+	if (n == 0) {
+		return false;
+	}
+	std::vector<float> color(n);
+	for (size_t k = 0; k < n; k++) {
+		color[k] = 2 * logf(hypotf(f1[k], f2[k]) + 1e-6f);
+	}
+	float lo = *std::min_element(color.begin(), color.end());
+	float hi = *std::max_element(color.begin(), color.end());
+	float range = hi > lo ? hi - lo : 1;
+
+	FILE* file = fopen(filename, "wb");
+	if (!file) {
+		return false;
+	}
+	fprintf(file, "P6\n%zu %zu\n255\n", width, height);
+	std::vector<unsigned char> row(3 * width);
+	// Image rows go from the top, i.e. the largest v
+	for (size_t j = height; j-- > 0;) {
+		for (size_t i = 0; i < width; i++) {
+			float t = (color[j * width + i] - lo) / range;
+			row[3 * i] = (unsigned char)(255 * t);
+			row[3 * i + 1] = (unsigned char)(255 * (1 - t));
+			row[3 * i + 2] = 255;
+		}
+		fwrite(row.data(), 1, row.size(), file);
+	}
+	return fclose(file) == 0;
+}
+
+static uint32_t crc32(uint32_t crc, const unsigned char* data, size_t size) {
+	static uint32_t table[256];
+	if (!table[1]) {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) {
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			table[n] = c;
+		}
+	}
+	crc = ~crc;
+	for (size_t k = 0; k < size; k++) {
+		crc = table[(crc ^ data[k]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void putBigEndian(std::vector<unsigned char>& out, uint32_t value) {
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		out.push_back((unsigned char)(value >> shift));
+	}
+}
+
+static bool writeChunk(FILE* file, const char* type, const std::vector<unsigned char>& data) {
+	std::vector<unsigned char> chunk;
+	putBigEndian(chunk, (uint32_t)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	putBigEndian(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+	return fwrite(chunk.data(), 1, chunk.size(), file) == chunk.size();
+}
+
+bool writePng(const char* filename, size_t width, size_t height, const unsigned char* rgb) {
+	if (width == 0 || height == 0) {
+		return false;
+	}
+	// Every row starts with filter type 0 (none)
+	size_t stride = 3 * width + 1;
+	std::vector<unsigned char> raw(stride * height);
+	for (size_t j = 0; j < height; j++) {
+		raw[j * stride] = 0;
+		std::copy_n(rgb + 3 * width * j, 3 * width, &raw[j * stride + 1]);
+	}
+	// Zlib stream of stored deflate blocks followed by the Adler-32 checksum
+	std::vector<unsigned char> data = {0x78, 0x01};
+	uint32_t a = 1, b = 0;
+	for (size_t begin = 0; begin < raw.size(); begin += 65535) {
+		size_t size = std::min(raw.size() - begin, (size_t)65535);
+		data.push_back(begin + size == raw.size());
+		data.push_back(size & 0xff);
+		data.push_back(size >> 8);
+		data.push_back(~size & 0xff);
+		data.push_back((~size >> 8) & 0xff);
+		data.insert(data.end(), raw.begin() + begin, raw.begin() + begin + size);
+		for (size_t k = begin; k < begin + size; k++) {
+			a = (a + raw[k]) % 65521;
+			b = (b + a) % 65521;
+		}
+	}
+	putBigEndian(data, b << 16 | a);
+
+	FILE* file = fopen(filename, "wb");
+	if (!file) {
+		return false;
+	}
+	const unsigned char signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	std::vector<unsigned char> header;
+	putBigEndian(header, (uint32_t)width);
+	putBigEndian(header, (uint32_t)height);
+	// 8 bits per channel, RGB, default compression, filtering and no interlacing
+	header.insert(header.end(), {8, 2, 0, 0, 0});
+	bool ok = fwrite(signature, 1, sizeof(signature), file) == sizeof(signature)
+		&& writeChunk(file, "IHDR", header)
+		&& writeChunk(file, "IDAT", data)
+		&& writeChunk(file, "IEND", std::vector<unsigned char>());
+	return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,35 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "field.h"
+
+// One line per sample with the in-plane coordinates followed by the three
+// field components
+bool writeFieldText(const char* filename, const PlaneGrid& grid, const FieldBuffer& field);
+
+// Binary PPM image of the in-plane field strength, colored by 2 * log(|F|)
+// with the "cool" colormap like the visualizer's streamplots
+bool writeFieldImage(const char* filename, const PlaneGrid& grid, const FieldBuffer& field);
+
+// Same from the in-plane components stored row-major, e.g. a mapped field file
+bool writeFieldImage(const char* filename, size_t width, size_t height, const float* f1, const float* f2);
+
+// 8-bit RGB PNG image from rows stored top to bottom, without compression
+bool writePng(const char* filename, size_t width, size_t height, const unsigned char* rgb);
+
+#endif
@@ -0,0 +1,209 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "imgui.h"
+
+#include "preview.h"
+#include "profile.h"
+#include "scheduler.h"
+
+static bool sameGrid(const PlaneGrid& a, const PlaneGrid& b) {
+	return a.axis == b.axis && a.coordinate == b.coordinate && a.u == b.u && a.v == b.v;
+}
+
+bool FieldPreview::stale(int axis, float coordinate, const Vec3& lo, const Vec3& hi) const {
+	return !valid || axis != target.axis || coordinate != target.coordinate
+		|| lo != lastLo || hi != lastHi || samples != lastSamples;
+}
+
+void FieldPreview::update(const std::vector<Vec4>& charges, int axis, float coordinate,
+	const Vec3& min, const Vec3& max, const Vec3& margins) {
+	ProfileScope stage("preview");
+	Vec3 lo, hi;
+	for (int i = 0; i < 3; i++) {
+		lo[i] = min[i] - margins[i];
+		hi[i] = max[i] + margins[i];
+	}
+	bool refresh = stale(axis, coordinate, lo, hi);
+	if (refresh) {
+		int a1 = axis == 0 ? 1 : 0;
+		int a2 = axis == 2 ? 1 : 2;
+		float w = hi[a1] - lo[a1], h = hi[a2] - lo[a2];
+		int n = std::max(samples, 2);
+		size_t width = n, height = n;
+		if (w > h && w > 0) {
+			height = std::max(2, (int)(n * h / w));
+		} else if (h > 0) {
+			width = std::max(2, (int)(n * w / h));
+		}
+		target.build(axis, coordinate, lo, hi, width, height);
+		lastLo = lo;
+		lastHi = hi;
+		lastSamples = samples;
+		valid = true;
+	}
+	if (gpu && gpu->ready()) {
+		// The GPU needs the UI thread's context and is fast enough to wait for
+		worker.cancel();
+		submittedAny = false;
+		if (refresh || !gpuShown || charges != gpuCharges) {
+			auto start = std::chrono::steady_clock::now();
+			ChargeBuffer buffer;
+			buffer.assign(charges);
+			gpu->upload(buffer);
+			gpu->evaluate(target, gpuField);
+			gpuCharges = charges;
+			shownSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			show(target, gpuField);
+			gpuShown = true;
+		}
+		return;
+	}
+	gpuShown = false;
+	if (refresh || !submittedAny || charges != submitted) {
+		PlaneGrid grid = target;
+		std::vector<Vec4> list = charges;
+		worker.submit([this, grid, list](JobControl& control) {
+			auto start = std::chrono::steady_clock::now();
+			if (!sameGrid(grid, field.plane())) {
+				if (!refine(grid, list, control, start)) {
+					return false;
+				}
+			} else if (!field.update(list, TaskPool::shared(), control)) {
+				return false;
+			}
+			publish(grid, field.field(), start);
+			return true;
+		});
+		submitted = charges;
+		submittedAny = true;
+	}
+	std::lock_guard<std::mutex> guard(lock);
+	if (fresh) {
+		shownSeconds = readySeconds;
+		show(readyGrid, ready);
+		fresh = false;
+	}
+}
+
+// Evaluates the field on a new plane coarse to fine, publishing every level
+// but the last interpolated onto the whole grid. The incremental field only
+// moves to the new plane once all levels are done.
+bool FieldPreview::refine(const PlaneGrid& grid, const std::vector<Vec4>& charges,
+	JobControl& control, std::chrono::steady_clock::time_point start) {
+	ProgressivePlane plane;
+	plane.build(grid);
+	ChargeBuffer buffer;
+	buffer.assign(charges);
+	FieldBuffer values, coarse;
+	values.resize(grid.width(), grid.height());
+	control.total = plane.blocks();
+	for (int level = 0; level < plane.levels(); level++) {
+		if (!plane.evaluate(level, buffer, values, TaskPool::shared(), control)) {
+			return false;
+		}
+		if (level < plane.levels() - 1) {
+			plane.interpolate(level, values, coarse);
+			publish(grid, coarse, start);
+		}
+	}
+	field.reset(grid);
+	field.assign(charges, values);
+	return true;
+}
+
+void FieldPreview::publish(const PlaneGrid& grid, const FieldBuffer& values,
+	std::chrono::steady_clock::time_point start) {
+	std::lock_guard<std::mutex> guard(lock);
+	readyGrid = grid;
+	ready = values;
+	readySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	fresh = true;
+}
+
+void FieldPreview::show(const PlaneGrid& grid, const FieldBuffer& total) {
+	shownGrid = grid;
+	shown = total;
+	// Same coloring as the visualizer's streamplots: 2 * log(|F|) within the plane
+	const std::vector<float>* comps[] = {&total.x, &total.y, &total.z};
+	const std::vector<float>& f1 = *comps[grid.axis1];
+	const std::vector<float>& f2 = *comps[grid.axis2];
+	color.resize(total.size());
+	for (size_t k = 0; k < total.size(); k++) {
+		color[k] = 2 * logf(hypotf(f1[k], f2[k]) + 1e-6f);
+	}
+}
+
+void FieldPreview::draw(const std::vector<Vec4>& charges) const {
+	ImVec2 avail = ImGui::GetContentRegionAvail();
+	const PlaneGrid& grid = shownGrid;
+	const FieldBuffer& total = shown;
+	if (grid.size() == 0 || total.size() != grid.size() || avail.x < 2 || avail.y < 2) {
+		return;
+	}
+	float w = grid.u.back() - grid.u.front();
+	float h = grid.v.back() - grid.v.front();
+	if (w <= 0 || h <= 0) {
+		return;
+	}
+	float scale = std::min(avail.x / w, avail.y / h);
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	ImVec2 size(w * scale, h * scale);
+	ImGui::InvisibleButton("##PreviewCanvas", size);
+
+	ImDrawList* draw = ImGui::GetWindowDrawList();
+	draw->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y), IM_COL32(20, 20, 20, 255));
+	auto toScreen = [&](float u, float v) {
+		return ImVec2(origin.x + (u - grid.u.front()) * scale,
+			origin.y + (grid.v.back() - v) * scale);
+	};
+
+	float lo = *std::min_element(color.begin(), color.end());
+	float hi = *std::max_element(color.begin(), color.end());
+	float range = hi > lo ? hi - lo : 1;
+	float len = 0.4f * std::min(size.x / grid.width(), size.y / grid.height());
+
+	const std::vector<float>* comps[] = {&total.x, &total.y, &total.z};
+	const std::vector<float>& f1 = *comps[grid.axis1];
+	const std::vector<float>& f2 = *comps[grid.axis2];
+	for (size_t j = 0; j < grid.height(); j++) {
+		for (size_t i = 0; i < grid.width(); i++) {
+			size_t k = j * grid.width() + i;
+			float mag = hypotf(f1[k], f2[k]);
+			if (mag == 0) {
+				continue;
+			}
+			// Screen y points down
+			float dx = f1[k] / mag * len, dy = -f2[k] / mag * len;
+			ImVec2 c = toScreen(grid.u[i], grid.v[j]);
+			ImVec2 tail(c.x - dx, c.y - dy), tip(c.x + dx, c.y + dy);
+			// "cool" colormap
+			float t = (color[k] - lo) / range;
+			ImU32 col = ImGui::ColorConvertFloat4ToU32(ImVec4(t, 1 - t, 1, 1));
+			draw->AddLine(tail, tip, col);
+			draw->AddLine(tip, ImVec2(tip.x - 0.5f * (dx + dy), tip.y - 0.5f * (dy - dx)), col);
+			draw->AddLine(tip, ImVec2(tip.x - 0.5f * (dx - dy), tip.y - 0.5f * (dy + dx)), col);
+		}
+	}
+	for (const Vec4& charge : charges) {
+		ImVec2 c = toScreen(charge[1 + grid.axis1], charge[1 + grid.axis2]);
+		draw->AddCircleFilled(c, 4, charge[0] > 0 ? IM_COL32(255, 0, 0, 255) : IM_COL32(0, 0, 255, 255));
+	}
+}
@@ -0,0 +1,97 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <chrono>
+
+#include "field.h"
+#include "gpufield.h"
+#include "incremental.h"
+#include "progressive.h"
+#include "scheduler.h"
+
+// Coarse electric field plot drawn in the editor's own frame loop. Edits to
+// the charges are applied incrementally; the field is only recomputed from
+// scratch when the plane changes, coarse to fine so that a rough picture
+// is shown right away. Without the GPU the field is computed by a
+// background worker, cancelling the computation in flight whenever the
+// charges change again, and the last finished field (or refinement level)
+// is drawn until the next one is ready.
+class FieldPreview {
+public:
+	// Number of arrows along the longer in-plane axis
+	int samples = 32;
+	// When set, the field is recomputed on the GPU whenever the charges
+	// change instead of being updated incrementally
+	GpuChargeField* gpu = nullptr;
+
+	void update(const std::vector<Vec4>& charges, int axis, float coordinate,
+		const Vec3& min, const Vec3& max, const Vec3& margins);
+	// Draws into the current ImGui window
+	void draw(const std::vector<Vec4>& charges) const;
+
+	// Whether a newer field is being computed and how far along it is
+	bool computing() const { return worker.busy(); }
+	float progress() const { return worker.progress(); }
+	// Wall time of the last finished computation
+	double seconds() const { return shownSeconds; }
+	// Stops the background worker before the editor shuts down
+	void stop() { worker.stop(); }
+private:
+	bool stale(int axis, float coordinate, const Vec3& lo, const Vec3& hi) const;
+	void show(const PlaneGrid& grid, const FieldBuffer& field);
+	// Called by the worker thread
+	bool refine(const PlaneGrid& grid, const std::vector<Vec4>& charges, JobControl& control,
+		std::chrono::steady_clock::time_point start);
+	void publish(const PlaneGrid& grid, const FieldBuffer& field,
+		std::chrono::steady_clock::time_point start);
+
+	// Grid the preview is being computed on
+	PlaneGrid target;
+	Vec3 lastLo = {{0, 0, 0}}, lastHi = {{0, 0, 0}};
+	int lastSamples = 0;
+	bool valid = false;
+	// Charges of the last job handed to the worker
+	std::vector<Vec4> submitted;
+	bool submittedAny = false;
+
+	// Only used by the worker thread
+	IncrementalField field;
+	// Latest field (or refinement level) handed from the worker to the UI
+	// thread
+	std::mutex lock;
+	PlaneGrid readyGrid;
+	FieldBuffer ready;
+	double readySeconds = 0;
+	bool fresh = false;
+
+	FieldBuffer gpuField;
+	std::vector<Vec4> gpuCharges;
+	bool gpuShown = false;
+
+	// Drawn by the UI thread
+	PlaneGrid shownGrid;
+	FieldBuffer shown;
+	std::vector<float> color;
+	double shownSeconds = 0;
+
+	// Declared last so its thread is joined before the buffers it uses are
+	// destroyed
+	BackgroundWorker worker;
+};
+
+#endif
@@ -0,0 +1,224 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <stdio.h>
+#include <sys/resource.h>
+
+#include <map>
+
+#include "profile.h"
+
+Profiler profiler;
+
+namespace {
+
+struct OpenStage {
+	size_t index;
+	unsigned generation;
+};
+
+// Stages opened on this thread that have not ended yet
+thread_local std::vector<OpenStage> openStages;
+
+int threadIndex() {
+	static std::atomic<int> next{0};
+	thread_local int index = next++;
+	return index;
+}
+
+void writeString(FILE* fp, const std::string& str) {
+	fputc('"', fp);
+	for (char c : str) {
+		if (c == '"' || c == '\\') {
+			fputc('\\', fp);
+		}
+		fputc(c, fp);
+	}
+	fputc('"', fp);
+}
+
+void writeCounters(FILE* fp, const ProfileCounters& counters) {
+	fputc('{', fp);
+	for (size_t i = 0; i < counters.size(); i++) {
+		fputs(i ? ", " : "", fp);
+		writeString(fp, counters[i].first);
+		fprintf(fp, ": %.17g", counters[i].second);
+	}
+	fputc('}', fp);
+}
+
+void addCounter(ProfileCounters& counters, const std::string& name, double amount) {
+	for (auto& counter : counters) {
+		if (counter.first == name) {
+			counter.second += amount;
+			return;
+		}
+	}
+	counters.emplace_back(name, amount);
+}
+
+}
+
+void Profiler::enable(bool enabled) {
+	if (enabled && !this->enabled()) {
+		clear();
+	}
+	active.store(enabled, std::memory_order_relaxed);
+}
+
+void Profiler::clear() {
+	std::lock_guard<std::mutex> guard(lock);
+	recorded.clear();
+	origin = std::chrono::steady_clock::now();
+	generation++;
+}
+
+double Profiler::now() const {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+}
+
+size_t Profiler::begin(const char* name) {
+	std::lock_guard<std::mutex> guard(lock);
+	ProfileStage stage;
+	stage.name = name;
+	stage.start = now();
+	stage.thread = threadIndex();
+	stage.depth = (int)openStages.size();
+	recorded.push_back(stage);
+	openStages.push_back({recorded.size() - 1, generation});
+	return recorded.size() - 1;
+}
+
+void Profiler::end(size_t stage) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (openStages.empty() || openStages.back().index != stage) {
+		return;
+	}
+	if (openStages.back().generation == generation) {
+		recorded[stage].seconds = now() - recorded[stage].start;
+	}
+	openStages.pop_back();
+}
+
+void Profiler::count(const char* counter, double amount) {
+	if (!enabled()) {
+		return;
+	}
+	std::lock_guard<std::mutex> guard(lock);
+	if (openStages.empty() || openStages.back().generation != generation) {
+		return;
+	}
+	addCounter(recorded[openStages.back().index].counters, counter, amount);
+}
+
+std::vector<ProfileStage> Profiler::stages() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return recorded;
+}
+
+void Profiler::copyStages(std::vector<ProfileStage>& out) const {
+	std::lock_guard<std::mutex> guard(lock);
+	out.resize(recorded.size());
+	for (size_t i = 0; i < recorded.size(); i++) {
+		const ProfileStage& stage = recorded[i];
+		ProfileStage& copy = out[i];
+		copy.name.assign(stage.name);
+		copy.start = stage.start;
+		copy.seconds = stage.seconds;
+		copy.thread = stage.thread;
+		copy.depth = stage.depth;
+		copy.counters.resize(stage.counters.size());
+		for (size_t c = 0; c < stage.counters.size(); c++) {
+			copy.counters[c].first.assign(stage.counters[c].first);
+			copy.counters[c].second = stage.counters[c].second;
+		}
+	}
+}
+
+bool Profiler::writeReport(const char* filename, const char* tool) const {
+	std::vector<ProfileStage> all = stages();
+	FILE* fp = fopen(filename, "w");
+	if (!fp) {
+		return false;
+	}
+	fprintf(fp, "{\n\t\"version\": 1,\n\t\"tool\": ");
+	writeString(fp, tool);
+	fprintf(fp, ",\n\t\"peak_rss_bytes\": %.17g,\n\t\"stages\": [", peakMemory());
+	struct Total {
+		size_t calls = 0;
+		double seconds = 0;
+		ProfileCounters counters;
+	};
+	std::map<std::string, Total> totals;
+	for (size_t i = 0; i < all.size(); i++) {
+		const ProfileStage& stage = all[i];
+		fprintf(fp, "%s\n\t\t{\"name\": ", i ? "," : "");
+		writeString(fp, stage.name);
+		fprintf(fp, ", \"thread\": %d, \"depth\": %d, \"start\": %.9f, \"seconds\": %.9f, \"counters\": ",
+			stage.thread, stage.depth, stage.start, stage.seconds);
+		writeCounters(fp, stage.counters);
+		fputc('}', fp);
+		Total& total = totals[stage.name];
+		total.calls++;
+		total.seconds += stage.seconds;
+		for (const auto& counter : stage.counters) {
+			addCounter(total.counters, counter.first, counter.second);
+		}
+	}
+	fprintf(fp, "\n\t],\n\t\"totals\": {");
+	bool first = true;
+	for (const auto& total : totals) {
+		fprintf(fp, "%s\n\t\t", first ? "" : ",");
+		writeString(fp, total.first);
+		fprintf(fp, ": {\"calls\": %zu, \"seconds\": %.9f, \"counters\": ", total.second.calls, total.second.seconds);
+		writeCounters(fp, total.second.counters);
+		fputc('}', fp);
+		first = false;
+	}
+	fprintf(fp, "\n\t}\n}\n");
+	return fclose(fp) == 0;
+}
+
+bool Profiler::writeTrace(const char* filename, const char* tool) const {
+	std::vector<ProfileStage> all = stages();
+	FILE* fp = fopen(filename, "w");
+	if (!fp) {
+		return false;
+	}
+	fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	fprintf(fp, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": ");
+	writeString(fp, tool);
+	fprintf(fp, "}}");
+	for (const ProfileStage& stage : all) {
+		fprintf(fp, ",\n{\"name\": ");
+		writeString(fp, stage.name);
+		fprintf(fp, ", \"cat\": \"emfield\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": ",
+			stage.thread, stage.start * 1e6, stage.seconds * 1e6);
+		writeCounters(fp, stage.counters);
+		fputc('}', fp);
+	}
+	fprintf(fp, "\n]}\n");
+	return fclose(fp) == 0;
+}
+
+double peakMemory() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	#ifdef __APPLE__
+	return usage.ru_maxrss;
+	#else
+	return usage.ru_maxrss * 1024.0;
+	#endif
+}
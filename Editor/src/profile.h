@@ -0,0 +1,101 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Named per-stage counters such as sample points, interactions or bytes
+// allocated, in the order they were first counted
+typedef std::vector<std::pair<std::string, double>> ProfileCounters;
+
+struct ProfileStage {
+	std::string name;
+	// Seconds since the profiler was enabled or cleared
+	double start = 0, seconds = 0;
+	// Small index of the recording thread and nesting level on it
+	int thread = 0, depth = 0;
+	ProfileCounters counters;
+};
+
+// Records the wall time and counters of the stages of a computation. The
+// reports have the same layout as those of the visualizer's profiler
+// (Visualizer/profiler.py). Stages nest per thread and counters are added
+// to the innermost open stage of the calling thread, so counts made by
+// pool workers are dropped; count totals on the thread that opened the
+// stage instead. While disabled, stages and counts only cost a check.
+class Profiler {
+public:
+	void enable(bool enabled);
+	bool enabled() const { return active.load(std::memory_order_relaxed); }
+	// Drops the recorded stages and restarts the clock
+	void clear();
+
+	size_t begin(const char* name);
+	void end(size_t stage);
+	void count(const char* counter, double amount);
+
+	std::vector<ProfileStage> stages() const;
+	// Same into a vector owned by the caller, reusing the memory of its
+	// elements, e.g. for drawing the stages every frame
+	void copyStages(std::vector<ProfileStage>& out) const;
+
+	// Every stage in the order they were opened plus inclusive totals per
+	// stage name
+	bool writeReport(const char* filename, const char* tool) const;
+	// Chrome trace event format, for chrome://tracing or Perfetto
+	bool writeTrace(const char* filename, const char* tool) const;
+private:
+	double now() const;
+
+	std::atomic<bool> active{false};
+	mutable std::mutex lock;
+	std::vector<ProfileStage> recorded;
+	std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	// Incremented by clear() so stages opened before it are not closed into
+	// the new recording
+	unsigned generation = 0;
+};
+
+extern Profiler profiler;
+
+// Stage that is open for the lifetime of the object
+class ProfileScope {
+public:
+	explicit ProfileScope(const char* name) : stage(profiler.enabled() ? profiler.begin(name) : NONE) {}
+	~ProfileScope() {
+		if (stage != NONE) {
+			profiler.end(stage);
+		}
+	}
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+private:
+	enum : size_t { NONE = (size_t)-1 };
+	size_t stage;
+};
+
+// Peak resident set size of the process in bytes
+double peakMemory();
+
+#endif
@@ -0,0 +1,162 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <algorithm>
+
+#include "progressive.h"
+#include "scheduler.h"
+
+static bool onLattice(size_t i, size_t n, size_t stride) {
+	return i % stride == 0 || i == n - 1;
+}
+
+void ProgressivePlane::build(const PlaneGrid& plane, int levels) {
+	grid = plane;
+	levels = std::max(levels, 1);
+	strides.resize(levels);
+	points.assign(levels, std::vector<uint32_t>());
+	size_t w = grid.width(), h = grid.height();
+	for (int k = 0; k < levels; k++) {
+		size_t s = (size_t)1 << (levels - 1 - k);
+		strides[k] = s;
+		for (size_t j = 0; j < h; j++) {
+			if (!onLattice(j, h, s)) {
+				continue;
+			}
+			for (size_t i = 0; i < w; i++) {
+				if (!onLattice(i, w, s)) {
+					continue;
+				}
+				if (k > 0 && onLattice(i, w, 2 * s) && onLattice(j, h, 2 * s)) {
+					continue;
+				}
+				points[k].push_back(j * w + i);
+			}
+		}
+	}
+}
+
+size_t ProgressivePlane::blocks() const {
+	size_t n = 0;
+	for (const std::vector<uint32_t>& level : points) {
+		n += (level.size() + BLOCK - 1) / BLOCK;
+	}
+	return n;
+}
+
+void ProgressivePlane::gather(const std::vector<uint32_t>& indices, size_t begin, size_t end,
+	std::vector<float>* p) const {
+	size_t w = grid.width();
+	for (int c = 0; c < 3; c++) {
+		p[c].resize(end - begin);
+	}
+	for (size_t k = begin; k < end; k++) {
+		Vec3 q = grid.point(indices[k] % w, indices[k] / w);
+		for (int c = 0; c < 3; c++) {
+			p[c][k - begin] = q[c];
+		}
+	}
+}
+
+void ProgressivePlane::evaluate(int level, const FieldSources& sources, FieldBuffer* efield,
+	FieldBuffer* bfield, TaskPool& pool) const {
+	const std::vector<uint32_t>& indices = points[level];
+	size_t n = indices.size();
+	std::vector<float> p[3];
+	gather(indices, 0, n, p);
+	std::vector<float> values[6];
+	float* out[6];
+	for (int c = 0; c < 6; c++) {
+		values[c].assign(n, 0);
+		out[c] = values[c].data();
+	}
+	evaluateSourcesAt(sources, p[0].data(), p[1].data(), p[2].data(), n,
+		efield ? out : nullptr, bfield ? out + 3 : nullptr, pool);
+	FieldBuffer* fields[] = {efield, bfield};
+	for (int f = 0; f < 2; f++) {
+		if (!fields[f]) {
+			continue;
+		}
+		std::vector<float>* comps[] = {&fields[f]->x, &fields[f]->y, &fields[f]->z};
+		for (int c = 0; c < 3; c++) {
+			const std::vector<float>& v = values[3 * f + c];
+			for (size_t k = 0; k < n; k++) {
+				(*comps[c])[indices[k]] += v[k];
+			}
+		}
+	}
+}
+
+bool ProgressivePlane::evaluate(int level, const ChargeBuffer& charges, FieldBuffer& field,
+	TaskPool& pool, JobControl& control) const {
+	const std::vector<uint32_t>& indices = points[level];
+	std::vector<float> p[3], e[3];
+	for (size_t begin = 0; begin < indices.size(); begin += BLOCK) {
+		if (control.cancelled) {
+			return false;
+		}
+		size_t end = std::min(indices.size(), begin + BLOCK);
+		gather(indices, begin, end, p);
+		for (int c = 0; c < 3; c++) {
+			e[c].assign(end - begin, 0);
+		}
+		evaluateChargesAt(charges, p[0].data(), p[1].data(), p[2].data(), end - begin,
+			e[0].data(), e[1].data(), e[2].data(), pool);
+		for (size_t k = begin; k < end; k++) {
+			field.x[indices[k]] += e[0][k - begin];
+			field.y[indices[k]] += e[1][k - begin];
+			field.z[indices[k]] += e[2][k - begin];
+		}
+		control.done++;
+	}
+	return true;
+}
+
+void ProgressivePlane::interpolate(int level, const FieldBuffer& field, FieldBuffer& out) const {
+	size_t w = grid.width(), h = grid.height(), s = strides[level];
+	out.resize(w, h);
+	// Lattice neighbors below and above each row and column and the weight
+	// of the upper one
+	auto neighbors = [s](size_t n, std::vector<size_t>& lo, std::vector<size_t>& hi,
+		std::vector<float>& t) {
+		lo.resize(n);
+		hi.resize(n);
+		t.resize(n);
+		for (size_t i = 0; i < n; i++) {
+			lo[i] = i == n - 1 ? i : i / s * s;
+			hi[i] = std::min(lo[i] + s, n - 1);
+			t[i] = hi[i] > lo[i] ? (float)(i - lo[i]) / (hi[i] - lo[i]) : 0;
+		}
+	};
+	std::vector<size_t> i0, i1, j0, j1;
+	std::vector<float> ti, tj;
+	neighbors(w, i0, i1, ti);
+	neighbors(h, j0, j1, tj);
+	const std::vector<float>* in[] = {&field.x, &field.y, &field.z};
+	std::vector<float>* dst[] = {&out.x, &out.y, &out.z};
+	for (int c = 0; c < 3; c++) {
+		const std::vector<float>& F = *in[c];
+		std::vector<float>& G = *dst[c];
+		for (size_t j = 0; j < h; j++) {
+			const float* r0 = &F[j0[j] * w];
+			const float* r1 = &F[j1[j] * w];
+			for (size_t i = 0; i < w; i++) {
+				float a = r0[i0[i]] + ti[i] * (r0[i1[i]] - r0[i0[i]]);
+				float b = r1[i0[i]] + ti[i] * (r1[i1[i]] - r1[i0[i]]);
+				G[j * w + i] = a + tj[j] * (b - a);
+			}
+		}
+	}
+}
@@ -0,0 +1,65 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include <stdint.h>
+
+#include "engine.h"
+
+struct JobControl;
+
+// Number of refinement levels; the first samples every eighth row and column
+#define PROGRESSIVE_LEVELS 4
+
+// Coarse-to-fine sampling of a plane grid. Level k covers every
+// 2^(levels - 1 - k)-th row and column of the grid (plus the last ones), so
+// each level's lattice contains the previous one and only the points that
+// are new to a level are evaluated: over all levels every point of the grid
+// is evaluated exactly once. After any level the rest of the grid can be
+// filled in by bilinear interpolation across the lattice.
+class ProgressivePlane {
+	PlaneGrid grid;
+	std::vector<size_t> strides;
+	// Grid indices (j * width + i) new to each level
+	std::vector<std::vector<uint32_t>> points;
+
+	void gather(const std::vector<uint32_t>& indices, size_t begin, size_t end,
+		std::vector<float>* p) const;
+public:
+	// Points evaluated between checks for cancellation
+	static const size_t BLOCK = 4096;
+
+	void build(const PlaneGrid& grid, int levels = PROGRESSIVE_LEVELS);
+	int levels() const { return (int)strides.size(); }
+	size_t stride(int level) const { return strides[level]; }
+	size_t evaluations(int level) const { return points[level].size(); }
+	// Number of blocks the levels are evaluated in when cancellable
+	size_t blocks() const;
+
+	// Adds the fields of the sources at the points new to the level to the
+	// buffers (either may be null), which must already match the grid
+	void evaluate(int level, const FieldSources& sources, FieldBuffer* efield,
+		FieldBuffer* bfield, TaskPool& pool) const;
+	// Same for point charges only, one block at a time, giving up if the
+	// job is cancelled
+	bool evaluate(int level, const ChargeBuffer& charges, FieldBuffer& field, TaskPool& pool,
+		JobControl& control) const;
+	// Interpolates the field sampled up to the level onto the whole grid
+	void interpolate(int level, const FieldBuffer& field, FieldBuffer& out) const;
+};
+
+#endif
@@ -0,0 +1,199 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <algorithm>
+
+#include "scheduler.h"
+
+std::vector<Tile> tileGrid(size_t width, size_t height, size_t tileSize) {
+	std::vector<Tile> tiles;
+	for (size_t j = 0; j < height; j += tileSize) {
+		for (size_t i = 0; i < width; i += tileSize) {
+			Tile tile = {i, std::min(i + tileSize, width), j, std::min(j + tileSize, height)};
+			tiles.push_back(tile);
+		}
+	}
+	return tiles;
+}
+
+TaskPool::TaskPool(unsigned threads) : remaining(0) {
+	if (threads == 0) {
+		unsigned cores = std::thread::hardware_concurrency();
+		threads = cores > 1 ? cores - 1 : 0;
+	}
+	for (unsigned i = 0; i <= threads; i++) {
+		queues.push_back(std::unique_ptr<Queue>(new Queue));
+	}
+	for (unsigned i = 0; i < threads; i++) {
+		workers.push_back(std::thread(&TaskPool::work, this, i));
+	}
+}
+
+TaskPool::~TaskPool() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+TaskPool& TaskPool::shared() {
+	static TaskPool pool;
+	return pool;
+}
+
+void TaskPool::run(size_t count, const Task& task) {
+	if (count == 0) {
+		return;
+	}
+	unsigned n = size();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		job = &task;
+		remaining = count;
+		size_t block = (count + n - 1) / n;
+		for (unsigned q = 0; q < n; q++) {
+			std::lock_guard<std::mutex> qguard(queues[q]->lock);
+			for (size_t t = q * block; t < std::min(count, (q + 1) * block); t++) {
+				queues[q]->tasks.push_back(t);
+			}
+		}
+		generation++;
+	}
+	wake.notify_all();
+	// The caller owns the last queue
+	drain(n - 1);
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [this] { return remaining == 0; });
+	job = nullptr;
+}
+
+bool TaskPool::next(unsigned id, size_t& task) {
+	{
+		Queue& own = *queues[id];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.tasks.empty()) {
+			task = own.tasks.front();
+			own.tasks.pop_front();
+			return true;
+		}
+	}
+	for (size_t k = 1; k < queues.size(); k++) {
+		Queue& victim = *queues[(id + k) % queues.size()];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.back();
+			victim.tasks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskPool::drain(unsigned id) {
+	size_t task;
+	while (next(id, task)) {
+		(*job)(task);
+		if (--remaining == 0) {
+			std::lock_guard<std::mutex> guard(lock);
+			done.notify_all();
+		}
+	}
+}
+
+void TaskPool::work(unsigned id) {
+	size_t seen = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [&] { return stopping || generation != seen; });
+			if (stopping) {
+				return;
+			}
+			seen = generation;
+		}
+		drain(id);
+	}
+}
+
+BackgroundWorker::~BackgroundWorker() {
+	stop();
+}
+
+void BackgroundWorker::stop() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+		control.cancelled = true;
+	}
+	wake.notify_all();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void BackgroundWorker::submit(const Job& job) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (stopping) {
+			return;
+		}
+		pending = job;
+		queued = true;
+		if (running) {
+			control.cancelled = true;
+		}
+		if (!thread.joinable()) {
+			thread = std::thread(&BackgroundWorker::run, this);
+		}
+	}
+	wake.notify_one();
+}
+
+void BackgroundWorker::cancel() {
+	std::lock_guard<std::mutex> guard(lock);
+	pending = nullptr;
+	queued = false;
+	if (running) {
+		control.cancelled = true;
+	}
+}
+
+bool BackgroundWorker::busy() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return queued || running;
+}
+
+void BackgroundWorker::run() {
+	std::unique_lock<std::mutex> guard(lock);
+	while (true) {
+		wake.wait(guard, [this] { return queued || stopping; });
+		if (stopping) {
+			return;
+		}
+		Job job;
+		job.swap(pending);
+		queued = false;
+		running = true;
+		control.reset();
+		guard.unlock();
+		job(control);
+		guard.lock();
+		running = false;
+	}
+}
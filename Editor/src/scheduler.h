@@ -0,0 +1,132 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Edge length (in samples) of a grid tile. A tile's output components
+// (3 * 32 * 32 floats) stay in L1 while every charge is streamed past it.
+#define FIELD_TILE 32
+
+struct Tile {
+	size_t i0, i1;
+	size_t j0, j1;
+};
+
+std::vector<Tile> tileGrid(size_t width, size_t height, size_t tileSize = FIELD_TILE);
+
+// Fixed set of worker threads with one task deque each. Tasks are dealt
+// out in contiguous blocks; a worker takes from the front of its own deque
+// and, once it runs dry, steals from the back of the others, so expensive
+// tiles don't leave the remaining threads idle. The calling thread works
+// too, so a pool with zero threads runs everything serially.
+class TaskPool {
+public:
+	typedef std::function<void(size_t)> Task;
+
+	// threads = 0 uses one thread per core besides the caller
+	explicit TaskPool(unsigned threads = 0);
+	~TaskPool();
+
+	// Runs task(0) ... task(count - 1) and returns when all have finished.
+	// Must not be called concurrently on the same pool.
+	void run(size_t count, const Task& task);
+	unsigned size() const { return (unsigned)workers.size() + 1; }
+
+	static TaskPool& shared();
+private:
+	struct Queue {
+		std::mutex lock;
+		std::deque<size_t> tasks;
+	};
+
+	void work(unsigned id);
+	bool next(unsigned id, size_t& task);
+	void drain(unsigned id);
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<Queue>> queues;
+
+	std::mutex lock;
+	std::condition_variable wake, done;
+	const Task* job = nullptr;
+	std::atomic<size_t> remaining;
+	size_t generation = 0;
+	bool stopping = false;
+};
+
+// Cancellation flag and progress counters shared by a background job and
+// the thread that started it. Jobs check the flag between steps and count
+// the steps they have finished.
+struct JobControl {
+	std::atomic<bool> cancelled{false};
+	std::atomic<size_t> done{0}, total{0};
+
+	void reset() {
+		cancelled = false;
+		done = 0;
+		total = 0;
+	}
+	float progress() const {
+		size_t n = total;
+		return n ? (float)done / n : 0;
+	}
+};
+
+// Single thread running jobs in the background so that the UI thread never
+// waits for them. Only the latest submitted job is kept: submitting
+// replaces a queued job and cancels the running one, which is expected to
+// return early once it sees the flag. The thread is started by the first
+// job, and jobs on it may use TaskPool::shared() as long as no other thread
+// does.
+class BackgroundWorker {
+public:
+	// Returns false if the job was cancelled before finishing
+	typedef std::function<bool(JobControl&)> Job;
+
+	~BackgroundWorker();
+
+	void submit(const Job& job);
+	void cancel();
+	// Cancels the running job and joins the thread; must be called before
+	// anything the jobs use (such as TaskPool::shared()) is destroyed
+	void stop();
+	// Whether a job is queued or running
+	bool busy() const;
+	// Progress of the running job in [0, 1]
+	float progress() const { return control.progress(); }
+private:
+	void run();
+
+	std::thread thread;
+	mutable std::mutex lock;
+	std::condition_variable wake;
+	Job pending;
+	bool queued = false, running = false, stopping = false;
+	JobControl control;
+};
+
+#endif
@@ -0,0 +1,130 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "json.hpp"
+
+#include "service.h"
+
+std::string servicePath() {
+	const char* path = getenv("EMFIELD_SERVICE");
+	if (path && *path) {
+		return path;
+	}
+	const char* runtime = getenv("XDG_RUNTIME_DIR");
+	if (runtime && *runtime) {
+		return std::string(runtime) + "/em-field-visualizer.sock";
+	}
+	// The temporary directory as chosen by Python's tempfile.gettempdir
+	std::string tmp = "/tmp";
+	for (const char* name : {"TMPDIR", "TEMP", "TMP"}) {
+		const char* dir = getenv(name);
+		if (dir && *dir && access(dir, W_OK | X_OK) == 0) {
+			tmp = dir;
+			break;
+		}
+	}
+	while (tmp.size() > 1 && tmp.back() == '/') {
+		tmp.pop_back();
+	}
+	return tmp + "/em-field-visualizer-" + std::to_string(getuid()) + ".sock";
+}
+
+// A closed connection must not kill the editor with SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+// Sends one request line and reads the reply line
+static bool exchange(const std::string& path, const nlohmann::json& request, nlohmann::json& reply,
+	std::string& error) {
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		error = "Socket path is too long: " + path;
+		return false;
+	}
+	strcpy(address.sun_path, path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		error = "Failed to create a socket";
+		return false;
+	}
+	#ifdef SO_NOSIGPIPE
+	int on = 1;
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+	#endif
+	if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+		close(fd);
+		error = "No visualizer service at " + path + " (start one with visualizer.py --serve)";
+		return false;
+	}
+	std::string line = request.dump() + "\n";
+	bool ok = true;
+	for (size_t sent = 0; ok && sent < line.size(); ) {
+		ssize_t n = send(fd, line.data() + sent, line.size() - sent, SEND_FLAGS);
+		ok = n > 0;
+		sent += ok ? n : 0;
+	}
+	std::string text;
+	char buffer[512];
+	while (ok && text.find('\n') == std::string::npos) {
+		ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+		ok = n > 0;
+		text.append(buffer, ok ? n : 0);
+	}
+	close(fd);
+	if (!ok) {
+		error = "The visualizer service closed the connection";
+		return false;
+	}
+	reply = nlohmann::json::parse(text.substr(0, text.find('\n')), nullptr, false);
+	if (!reply.is_object()) {
+		error = "Invalid reply from the visualizer service";
+		return false;
+	}
+	return true;
+}
+
+bool submitJob(const char* filename, std::string& message) {
+	// The service may run in another directory
+	char absolute[PATH_MAX];
+	if (!realpath(filename, absolute)) {
+		message = std::string("Failed to resolve ") + filename;
+		return false;
+	}
+	nlohmann::json request = {{"command", "submit"}, {"config", absolute}, {"wait", false}};
+	nlohmann::json reply;
+	if (!exchange(servicePath(), request, reply, message)) {
+		return false;
+	}
+	if (reply.value("status", "") != "queued") {
+		message = "Visualizer service: " + reply.value("error", std::string("job rejected"));
+		return false;
+	}
+	message = "Submitted " + std::string(filename) + " to the visualizer service as job "
+		+ std::to_string(reply.value("job", 0));
+	return true;
+}
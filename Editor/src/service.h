@@ -0,0 +1,35 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include <string>
+
+// Client for the visualizer's job service (Visualizer/service.py), which
+// renders configurations in a process that keeps its imports warm
+
+// Socket path shared with the visualizer: $EMFIELD_SERVICE if set, otherwise
+// em-field-visualizer.sock in $XDG_RUNTIME_DIR or em-field-visualizer-<uid>.sock
+// in the temporary directory ($TMPDIR, $TEMP or $TMP, otherwise /tmp)
+std::string servicePath();
+
+// Queues the configuration file with the service without waiting for it to
+// be rendered. Returns whether the job was accepted; `message` describes the
+// outcome (job number or the reason it failed) either way.
+bool submitJob(const char* filename, std::string& message);
+
+#endif
@@ -0,0 +1,410 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "output.h"
+#include "profile.h"
+#include "scheduler.h"
+#include "streamplot.h"
+
+const char* colormapNames[] = {
+	"cool", "viridis", "plasma", "inferno", "magma", "cividis", "jet", "hot",
+	"gray", "bwr", "coolwarm", "seismic", "spring", "summer", "autumn", "winter"
+};
+
+// Evenly spaced control points of each colormap
+static const unsigned char colormapStops[COLORMAP_COUNT][9][3] = {
+	{{0, 255, 255}, {32, 223, 255}, {64, 191, 255}, {96, 159, 255}, {128, 128, 255},
+		{159, 96, 255}, {191, 64, 255}, {223, 32, 255}, {255, 0, 255}},
+	{{68, 1, 84}, {71, 45, 123}, {59, 82, 139}, {44, 114, 142}, {33, 145, 140},
+		{40, 174, 128}, {94, 201, 98}, {173, 220, 48}, {253, 231, 37}},
+	{{13, 8, 135}, {76, 2, 161}, {126, 3, 168}, {169, 35, 149}, {204, 71, 120},
+		{229, 107, 93}, {248, 149, 64}, {253, 197, 39}, {240, 249, 33}},
+	{{0, 0, 4}, {31, 12, 72}, {85, 15, 109}, {136, 34, 106}, {186, 54, 85},
+		{227, 89, 51}, {249, 142, 9}, {249, 203, 53}, {252, 255, 164}},
+	{{0, 0, 4}, {28, 16, 68}, {79, 18, 123}, {129, 37, 129}, {181, 54, 122},
+		{229, 80, 100}, {251, 135, 97}, {254, 194, 135}, {252, 253, 191}},
+	{{0, 34, 78}, {18, 53, 112}, {59, 73, 108}, {87, 93, 109}, {112, 113, 115},
+		{138, 134, 120}, {165, 156, 116}, {195, 179, 105}, {254, 232, 56}},
+	{{0, 0, 128}, {0, 0, 255}, {0, 128, 255}, {0, 255, 255}, {128, 255, 128},
+		{255, 255, 0}, {255, 128, 0}, {255, 0, 0}, {128, 0, 0}},
+	{{11, 0, 0}, {97, 0, 0}, {183, 0, 0}, {255, 14, 0}, {255, 99, 0},
+		{255, 185, 0}, {255, 255, 21}, {255, 255, 138}, {255, 255, 255}},
+	{{0, 0, 0}, {32, 32, 32}, {64, 64, 64}, {96, 96, 96}, {128, 128, 128},
+		{159, 159, 159}, {191, 191, 191}, {223, 223, 223}, {255, 255, 255}},
+	{{0, 0, 255}, {64, 64, 255}, {128, 128, 255}, {191, 191, 255}, {255, 255, 255},
+		{255, 191, 191}, {255, 128, 128}, {255, 64, 64}, {255, 0, 0}},
+	{{59, 76, 192}, {98, 130, 234}, {141, 176, 254}, {184, 208, 249}, {221, 221, 221},
+		{245, 196, 173}, {244, 154, 123}, {222, 96, 77}, {180, 4, 38}},
+	{{0, 0, 77}, {0, 0, 166}, {0, 0, 255}, {128, 128, 255}, {255, 255, 255},
+		{255, 128, 128}, {255, 0, 0}, {191, 0, 0}, {128, 0, 0}},
+	{{255, 0, 255}, {255, 32, 223}, {255, 64, 191}, {255, 96, 159}, {255, 128, 128},
+		{255, 159, 96}, {255, 191, 64}, {255, 223, 32}, {255, 255, 0}},
+	{{0, 128, 102}, {32, 144, 102}, {64, 159, 102}, {96, 175, 102}, {128, 191, 102},
+		{159, 207, 102}, {191, 223, 102}, {223, 239, 102}, {255, 255, 102}},
+	{{255, 0, 0}, {255, 32, 0}, {255, 64, 0}, {255, 96, 0}, {255, 128, 0},
+		{255, 159, 0}, {255, 191, 0}, {255, 223, 0}, {255, 255, 0}},
+	{{0, 0, 255}, {0, 32, 239}, {0, 64, 223}, {0, 96, 207}, {0, 128, 191},
+		{0, 159, 175}, {0, 191, 159}, {0, 223, 143}, {0, 255, 128}}
+};
+
+int findColormap(const char* name) {
+	for (int i = 0; i < COLORMAP_COUNT; i++) {
+		if (!strcmp(name, colormapNames[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+void colormapColor(int map, float t, unsigned char* rgb) {
+	const unsigned char (*stops)[3] = colormapStops[map < 0 || map >= COLORMAP_COUNT ? 0 : map];
+	t = std::min(std::max(t, 0.f), 1.f) * 8;
+	if (!(t >= 0)) {
+		t = 0;
+	}
+	int k = std::min((int)t, 7);
+	float f = t - k;
+	for (int c = 0; c < 3; c++) {
+		rgb[c] = (unsigned char)(stops[k][c] + f * (stops[k + 1][c] - stops[k][c]) + 0.5f);
+	}
+}
+
+// Bilinear interpolation of a row-major grid at index coordinates inside it
+static float sample(const float* values, size_t width, size_t height, float x, float y) {
+	size_t i = std::min((size_t)x, width - 2), j = std::min((size_t)y, height - 2);
+	float s = x - i, t = y - j;
+	const float* r0 = values + j * width + i;
+	const float* r1 = r0 + width;
+	float a = r0[0] + s * (r0[1] - r0[0]);
+	float b = r1[0] + s * (r1[1] - r1[0]);
+	return a + t * (b - a);
+}
+
+namespace {
+
+// Integration happens in plot coordinates scaled to [0, 1] along both sides,
+// like matplotlib's axes coordinates
+struct Tracer {
+	size_t width, height;
+	float spanU, spanV;
+	const float* f1;
+	const float* f2;
+	float step;
+	size_t maxSteps;
+
+	// Unit direction of the field at (a, b), or false outside the grid or
+	// where the field vanishes
+	bool direction(float a, float b, float& da, float& db) const {
+		if (!(a >= 0 && a <= 1 && b >= 0 && b <= 1)) {
+			return false;
+		}
+		float x = a * (width - 1), y = b * (height - 1);
+		// The plot's sides differ in length, so the field is scaled to plot
+		// coordinates before normalizing
+		float u = sample(f1, width, height, x, y) / spanU;
+		float v = sample(f2, width, height, x, y) / spanV;
+		float norm = hypotf(u, v);
+		if (!(norm > 0) || !isfinite(norm)) {
+			return false;
+		}
+		da = u / norm;
+		db = v / norm;
+		return true;
+	}
+
+	// Points from the seed along (sign 1) or against (sign -1) the field
+	void trace(float a, float b, float sign, std::vector<float>& pa, std::vector<float>& pb) const {
+		float h = sign * step;
+		for (size_t n = 0; n < maxSteps; n++) {
+			float k1a, k1b, k2a, k2b, k3a, k3b, k4a, k4b;
+			if (!direction(a, b, k1a, k1b)
+				|| !direction(a + 0.5f * h * k1a, b + 0.5f * h * k1b, k2a, k2b)
+				|| !direction(a + 0.5f * h * k2a, b + 0.5f * h * k2b, k3a, k3b)
+				|| !direction(a + h * k3a, b + h * k3b, k4a, k4b)) {
+				return;
+			}
+			a += h / 6 * (k1a + 2 * k2a + 2 * k3a + k4a);
+			b += h / 6 * (k1b + 2 * k2b + 2 * k3b + k4b);
+			if (!(a >= 0 && a <= 1 && b >= 0 && b <= 1)) {
+				return;
+			}
+			pa.push_back(a);
+			pb.push_back(b);
+		}
+	}
+};
+
+}
+
+// Mask cells from the border inwards, like matplotlib's starting points
+static std::vector<size_t> spiralSeeds(size_t nx, size_t ny) {
+	std::vector<size_t> seeds;
+	long x0 = 0, y0 = 0, x1 = nx - 1, y1 = ny - 1;
+	while (x0 <= x1 && y0 <= y1) {
+		for (long x = x0; x <= x1; x++) {
+			seeds.push_back(y0 * nx + x);
+		}
+		for (long y = y0 + 1; y <= y1; y++) {
+			seeds.push_back(y * nx + x1);
+		}
+		if (y1 > y0) {
+			for (long x = x1 - 1; x >= x0; x--) {
+				seeds.push_back(y1 * nx + x);
+			}
+		}
+		if (x1 > x0) {
+			for (long y = y1 - 1; y > y0; y--) {
+				seeds.push_back(y * nx + x0);
+			}
+		}
+		x0++;
+		y0++;
+		x1--;
+		y1--;
+	}
+	return seeds;
+}
+
+std::vector<Streamline> traceStreamlines(size_t width, size_t height, float spanU, float spanV,
+	const float* f1, const float* f2, const StreamplotOptions& options, TaskPool& pool) {
+	ProfileScope stage("streamlines");
+	std::vector<Streamline> lines;
+	if (width < 2 || height < 2 || !(spanU > 0) || !(spanV > 0)) {
+		return lines;
+	}
+	size_t nx = std::max(1, (int)(30 * options.density));
+	size_t ny = nx;
+	Tracer tracer = {width, height, spanU, spanV, f1, f2, options.step / nx, 0};
+	tracer.maxSteps = (size_t)(options.maxLength / tracer.step);
+	std::vector<size_t> seeds = spiralSeeds(nx, ny);
+
+	// Both halves of every line, traced independently of the others
+	std::vector<std::vector<float>> pa(2 * seeds.size()), pb(2 * seeds.size());
+	pool.run(seeds.size(), [&](size_t s) {
+		float a = (seeds[s] % nx + 0.5f) / nx, b = (seeds[s] / nx + 0.5f) / ny;
+		for (int half = 0; half < 2; half++) {
+			std::vector<float>& la = pa[2 * s + half];
+			std::vector<float>& lb = pb[2 * s + half];
+			la.push_back(a);
+			lb.push_back(b);
+			tracer.trace(a, b, half ? -1.f : 1.f, la, lb);
+		}
+	});
+	profiler.count("seeds", (double)seeds.size());
+
+	std::vector<char> mask(nx * ny, 0);
+	auto cell = [&](float a, float b) {
+		size_t x = std::min((size_t)(a * nx), nx - 1), y = std::min((size_t)(b * ny), ny - 1);
+		return y * nx + x;
+	};
+	std::vector<size_t> marked;
+	for (size_t s = 0; s < seeds.size(); s++) {
+		if (mask[seeds[s]]) {
+			continue;
+		}
+		marked.clear();
+		mask[seeds[s]] = 1;
+		marked.push_back(seeds[s]);
+		// Number of points of each half before it runs into another line
+		size_t kept[2];
+		float length = 0;
+		for (int half = 0; half < 2; half++) {
+			const std::vector<float>& la = pa[2 * s + half];
+			const std::vector<float>& lb = pb[2 * s + half];
+			size_t current = seeds[s];
+			size_t k = 1;
+			for (; k < la.size(); k++) {
+				size_t next = cell(la[k], lb[k]);
+				if (next != current) {
+					if (mask[next]) {
+						break;
+					}
+					mask[next] = 1;
+					marked.push_back(next);
+					current = next;
+				}
+				length += hypotf(la[k] - la[k - 1], lb[k] - lb[k - 1]);
+			}
+			kept[half] = k;
+		}
+		if (length < options.minLength) {
+			for (size_t m : marked) {
+				mask[m] = 0;
+			}
+			continue;
+		}
+		Streamline line;
+		const std::vector<float>& ba = pa[2 * s + 1];
+		const std::vector<float>& bb = pb[2 * s + 1];
+		for (size_t k = kept[1]; k-- > 1;) {
+			line.x.push_back(ba[k] * (width - 1));
+			line.y.push_back(bb[k] * (height - 1));
+		}
+		const std::vector<float>& fa = pa[2 * s];
+		const std::vector<float>& fb = pb[2 * s];
+		for (size_t k = 0; k < kept[0]; k++) {
+			line.x.push_back(fa[k] * (width - 1));
+			line.y.push_back(fb[k] * (height - 1));
+		}
+		for (size_t k = 0; k < line.x.size(); k++) {
+			float f = hypotf(sample(f1, width, height, line.x[k], line.y[k]),
+				sample(f2, width, height, line.x[k], line.y[k]));
+			line.color.push_back(2 * logf(f + 1e-6f));
+		}
+		lines.push_back(std::move(line));
+	}
+	profiler.count("streamlines", (double)lines.size());
+	return lines;
+}
+
+FieldPlot::FieldPlot(float u0, float u1, float v0, float v1, size_t size) : u0(u0), v0(v0) {
+	float extent = std::max(u1 - u0, v1 - v0);
+	scale = extent > 0 ? (size - 1) / extent : 1;
+	w = std::max((size_t)1, (size_t)((u1 - u0) * scale + 1.5f));
+	h = std::max((size_t)1, (size_t)((v1 - v0) * scale + 1.5f));
+	pixels.assign(3 * w * h, 255);
+}
+
+void FieldPlot::blend(long x, long y, const unsigned char* color, float alpha) {
+	if (x < 0 || y < 0 || x >= (long)w || y >= (long)h || alpha <= 0) {
+		return;
+	}
+	// Image rows go from the top, i.e. the largest v
+	unsigned char* p = &pixels[3 * ((h - 1 - y) * w + x)];
+	alpha = std::min(alpha, 1.f);
+	for (int c = 0; c < 3; c++) {
+		p[c] = (unsigned char)(p[c] + alpha * (color[c] - p[c]) + 0.5f);
+	}
+}
+
+// Segment between pixel coordinates with coverage falling off over the last
+// pixel at its edges
+void FieldPlot::stroke(float x0, float y0, float x1, float y1, float width, const unsigned char* color) {
+	float r = 0.5f * width;
+	long xa = (long)floorf(std::min(x0, x1) - r - 1), xb = (long)ceilf(std::max(x0, x1) + r + 1);
+	long ya = (long)floorf(std::min(y0, y1) - r - 1), yb = (long)ceilf(std::max(y0, y1) + r + 1);
+	float dx = x1 - x0, dy = y1 - y0;
+	float len2 = dx * dx + dy * dy;
+	for (long y = std::max(ya, 0L); y <= std::min(yb, (long)h - 1); y++) {
+		for (long x = std::max(xa, 0L); x <= std::min(xb, (long)w - 1); x++) {
+			float t = len2 > 0 ? ((x - x0) * dx + (y - y0) * dy) / len2 : 0;
+			t = std::min(std::max(t, 0.f), 1.f);
+			float d = hypotf(x - (x0 + t * dx), y - (y0 + t * dy));
+			blend(x, y, color, r + 0.5f - d);
+		}
+	}
+}
+
+void FieldPlot::background(size_t width, size_t height, const float* values, int colormap) {
+	if (width == 0 || height == 0) {
+		return;
+	}
+	float lo = *std::min_element(values, values + width * height);
+	float hi = *std::max_element(values, values + width * height);
+	float range = hi > lo ? hi - lo : 1;
+	for (size_t y = 0; y < h; y++) {
+		size_t j = std::min((size_t)((float)y / std::max(h - 1, (size_t)1) * (height - 1) + 0.5f), height - 1);
+		for (size_t x = 0; x < w; x++) {
+			size_t i = std::min((size_t)((float)x / std::max(w - 1, (size_t)1) * (width - 1) + 0.5f), width - 1);
+			colormapColor(colormap, (values[j * width + i] - lo) / range, &pixels[3 * ((h - 1 - y) * w + x)]);
+		}
+	}
+}
+
+void FieldPlot::streamlines(const std::vector<Streamline>& lines, size_t width, size_t height,
+	float lo, float hi, int colormap) {
+	ProfileScope stage("rasterize");
+	float sx = (float)(w - 1) / std::max(width - 1, (size_t)1);
+	float sy = (float)(h - 1) / std::max(height - 1, (size_t)1);
+	float range = hi > lo ? hi - lo : 1;
+	unsigned char color[3];
+	for (const Streamline& line : lines) {
+		size_t n = line.x.size();
+		float length = 0;
+		for (size_t k = 1; k < n; k++) {
+			length += hypotf((line.x[k] - line.x[k - 1]) * sx, (line.y[k] - line.y[k - 1]) * sy);
+		}
+		float walked = 0;
+		bool arrow = false;
+		for (size_t k = 1; k < n; k++) {
+			float x0 = line.x[k - 1] * sx, y0 = line.y[k - 1] * sy;
+			float x1 = line.x[k] * sx, y1 = line.y[k] * sy;
+			colormapColor(colormap, (0.5f * (line.color[k - 1] + line.color[k]) - lo) / range, color);
+			stroke(x0, y0, x1, y1, 1.5f, color);
+			float d = hypotf(x1 - x0, y1 - y0);
+			walked += d;
+			if (!arrow && walked >= 0.5f * length && d > 0) {
+				// Arrowhead pointing along the line
+				float ux = (x1 - x0) / d, uy = (y1 - y0) / d;
+				const float size = 6;
+				for (int side = -1; side <= 1; side += 2) {
+					float bx = x1 - size * (ux * 0.866f - side * uy * 0.5f);
+					float by = y1 - size * (uy * 0.866f + side * ux * 0.5f);
+					stroke(x1, y1, bx, by, 1.5f, color);
+				}
+				arrow = true;
+			}
+		}
+	}
+}
+
+void FieldPlot::line(float ua, float va, float ub, float vb, const unsigned char* color) {
+	stroke((ua - u0) * scale, (va - v0) * scale, (ub - u0) * scale, (vb - v0) * scale, 1.5f, color);
+}
+
+void FieldPlot::marker(float u, float v, const unsigned char* color) {
+	float x = (u - u0) * scale, y = (v - v0) * scale;
+	stroke(x, y, x, y, 8, color);
+}
+
+bool writeStreamplot(const char* filename, float u0, float u1, float v0, float v1,
+	size_t width, size_t height, const float* f1, const float* f2, const float* density,
+	int colormap, const std::vector<float>& charges, const std::vector<float>& segments,
+	TaskPool& pool) {
+	size_t n = width * height;
+	if (width < 2 || height < 2) {
+		return false;
+	}
+	FieldPlot plot(u0, u1, v0, v1);
+	if (density) {
+		plot.background(width, height, density, findColormap("bwr"));
+	}
+	std::vector<Streamline> lines = traceStreamlines(width, height, u1 - u0, v1 - v0, f1, f2,
+		StreamplotOptions(), pool);
+	// Colors are scaled over the whole grid, like matplotlib's normalization
+	// of the color array
+	float lo = INFINITY, hi = -INFINITY;
+	for (size_t k = 0; k < n; k++) {
+		float c = 2 * logf(hypotf(f1[k], f2[k]) + 1e-6f);
+		lo = std::min(lo, c);
+		hi = std::max(hi, c);
+	}
+	plot.streamlines(lines, width, height, lo, hi, colormap);
+	const unsigned char green[] = {0, 128, 0};
+	for (size_t k = 0; k + 3 < segments.size(); k += 4) {
+		plot.line(segments[k], segments[k + 1], segments[k + 2], segments[k + 3], green);
+	}
+	const unsigned char red[] = {255, 0, 0}, blue[] = {0, 0, 255};
+	for (size_t k = 0; k + 2 < charges.size(); k += 3) {
+		plot.marker(charges[k + 1], charges[k + 2], charges[k] > 0 ? red : blue);
+	}
+	ProfileScope stage("write-png");
+	return writePng(filename, plot.width(), plot.height(), plot.rgb());
+}
@@ -0,0 +1,95 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+#ifndef STREAMPLOT_H
+#define STREAMPLOT_H
+
+#include <stddef.h>
+
+#include <vector>
+
+class TaskPool;
+
+#define COLORMAP_COUNT 16
+extern const char* colormapNames[];
+
+// Index of a matplotlib colormap by name, or -1 if it isn't available
+int findColormap(const char* name);
+// Color of t in [0, 1]
+void colormapColor(int map, float t, unsigned char* rgb);
+
+struct StreamplotOptions {
+	// Same meaning as matplotlib's streamplot density: lines are kept apart
+	// by a mask of 30 * density cells along each side of the plot
+	float density = 1;
+	// Integration step in mask cells and longest line relative to the plot
+	float step = 0.2f;
+	float maxLength = 4;
+	float minLength = 0.1f;
+};
+
+// Streamline in grid index coordinates (0 to width - 1 and height - 1) with
+// the color value 2 * log(|F|) at every point
+struct Streamline {
+	std::vector<float> x, y, color;
+};
+
+// Traces streamlines of the in-plane field, stored row-major on a grid
+// spanning the given extents, with fourth order Runge-Kutta steps through
+// the bilinearly interpolated direction field. Seeds are the cells of the
+// mask, from the border inwards; every seed is integrated both ways in
+// parallel, and the lines are then kept in seed order, each cut where it
+// enters a cell covered by an earlier line.
+std::vector<Streamline> traceStreamlines(size_t width, size_t height, float spanU, float spanV,
+	const float* f1, const float* f2, const StreamplotOptions& options, TaskPool& pool);
+
+// RGB image of the plane of interest between the given extents, drawn with
+// anti-aliased primitives in plot coordinates (v pointing up)
+class FieldPlot {
+	float u0 = 0, v0 = 0, scale = 1;
+	size_t w = 0, h = 0;
+	std::vector<unsigned char> pixels;
+
+	void blend(long x, long y, const unsigned char* color, float alpha);
+	void stroke(float x0, float y0, float x1, float y1, float width, const unsigned char* color);
+public:
+	// White image whose longer side has the given number of pixels
+	FieldPlot(float u0, float u1, float v0, float v1, size_t size = 800);
+
+	size_t width() const { return w; }
+	size_t height() const { return h; }
+	const unsigned char* rgb() const { return pixels.data(); }
+
+	// Fills the image with a value sampled on a grid covering the extents,
+	// e.g. the charge density, scaled to the full range of the colormap
+	void background(size_t width, size_t height, const float* values, int colormap);
+	// Streamlines of a grid covering the extents, colored by their color
+	// values scaled over the given range, with an arrow halfway along each
+	void streamlines(const std::vector<Streamline>& lines, size_t width, size_t height,
+		float lo, float hi, int colormap);
+	void line(float ua, float va, float ub, float vb, const unsigned char* color);
+	void marker(float u, float v, const unsigned char* color);
+};
+
+// Traces and draws the streamlines of the in-plane field into a PNG image
+// like the visualizer's streamplots, over the density (if not null) and
+// under the charges, given as (q, u, v) triples, and the current segments,
+// given as (u1, v1, u2, v2)
+bool writeStreamplot(const char* filename, float u0, float u1, float v0, float v1,
+	size_t width, size_t height, const float* f1, const float* f2, const float* density,
+	int colormap, const std::vector<float>& charges, const std::vector<float>& segments,
+	TaskPool& pool);
+
+#endif
@@ -0,0 +1,271 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "symmetry.h"
+
+const char* symmetryModes[] = {
+	"none", "auto", "declared"
+};
+
+// Relative tolerance of the positions and charges compared by the detection
+#define SYMMETRY_TOLERANCE 1e-5f
+
+void Symmetry::restrict(int axis) {
+	int a1 = axis == 0 ? 1 : 0;
+	int a2 = axis == 2 ? 1 : 2;
+	mirror[axis] = 0;
+	if (mirror[a1] && mirror[a2]) {
+		rotation = mirror[a1] * mirror[a2];
+	} else if (rotation && mirror[a1]) {
+		mirror[a2] = rotation * mirror[a1];
+	} else if (rotation && mirror[a2]) {
+		mirror[a1] = rotation * mirror[a2];
+	}
+}
+
+void Symmetry::describe(char* buf, size_t size) const {
+	int length = 0;
+	buf[0] = 0;
+	for (int a = 0; a < 3 && length >= 0 && (size_t)length < size; a++) {
+		if (mirror[a]) {
+			length += snprintf(buf + length, size - length, "%smirror %c (%s)", length ? ", " : "",
+				"xyz"[a], mirror[a] > 0 ? "even" : "odd");
+		}
+	}
+	if (rotation && length == 0) {
+		snprintf(buf, size, "half turn (%s)", rotation > 0 ? "even" : "odd");
+	} else if (length == 0) {
+		snprintf(buf, size, "none");
+	}
+}
+
+using Key = std::vector<long long>;
+
+static long long quantize(float value, float tolerance) {
+	return llroundf(value / tolerance);
+}
+
+// Image of a point under the mirrors across the given axes
+static Vec3 reflect(const Vec3& p, const Vec3& center, const bool flip[3]) {
+	Vec3 q = p;
+	for (int a = 0; a < 3; a++) {
+		if (flip[a]) {
+			q[a] = 2 * center[a] - p[a];
+		}
+	}
+	return q;
+}
+
+static bool sameCharges(const std::vector<Vec4>& charges, const Vec3& center, const bool flip[3],
+	int parity, float ptol, float qtol) {
+	std::vector<Key> original, image;
+	original.reserve(charges.size());
+	image.reserve(charges.size());
+	for (const Vec4& c : charges) {
+		Vec3 p = {{c[1], c[2], c[3]}};
+		Vec3 m = reflect(p, center, flip);
+		original.push_back({quantize(c[0], qtol), quantize(p[0], ptol), quantize(p[1], ptol), quantize(p[2], ptol)});
+		image.push_back({quantize(parity * c[0], qtol), quantize(m[0], ptol), quantize(m[1], ptol), quantize(m[2], ptol)});
+	}
+	std::sort(original.begin(), original.end());
+	std::sort(image.begin(), image.end());
+	return original == image;
+}
+
+// Coordinates a closed-form preset depends on
+static bool presetAxes(const ChargeDensityFunc& rho, bool used[3]) {
+	used[0] = used[1] = used[2] = false;
+	if (!rho.isPreset) {
+		return false;
+	} else if (!strcmp(rho.var, "r")) {
+		used[0] = used[1] = used[2] = true;
+	} else if (!strcmp(rho.var, "rc")) {
+		used[0] = used[1] = true;
+	} else if (strlen(rho.var) == 1 && rho.var[0] >= 'x' && rho.var[0] <= 'z') {
+		used[rho.var[0] - 'x'] = true;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// The user's box, mirrored
+static void appendSupportKey(const ChargeDensityFunc& rho, const Vec3& center, const bool flip[3],
+	float ptol, Key& key) {
+	key.push_back(rho.bounded);
+	if (rho.bounded) {
+		Vec3 lo = reflect(rho.supportMin, center, flip);
+		Vec3 hi = reflect(rho.supportMax, center, flip);
+		for (int a = 0; a < 3; a++) {
+			key.push_back(quantize(std::min(lo[a], hi[a]), ptol));
+			key.push_back(quantize(std::max(lo[a], hi[a]), ptol));
+		}
+	}
+}
+
+static Key presetKey(const ChargeDensityFunc& rho, const Vec3& center, const bool flip[3],
+	int parity, float ptol) {
+	bool used[3];
+	presetAxes(rho, used);
+	long long scale = quantize(parity * rho.scale, SYMMETRY_TOLERANCE * std::max(1.0f, fabsf(rho.scale)));
+	if (rho.var[1] == 0 && rho.var[0] >= 'x' && rho.var[0] <= 'z') {
+		// Comparisons of a coordinate are planes (or the sides of a plane) at
+		// value - offset, which are mirrored as a whole
+		int a = rho.var[0] - 'x';
+		float plane = rho.value - rho.offset[a];
+		int preset = rho.preset;
+		if (flip[a]) {
+			plane = 2 * center[a] - plane;
+			if (preset == PRESET_HEAVISIDE) {
+				preset = PRESET_REVERSE_HEAVISIDE;
+			} else if (preset == PRESET_REVERSE_HEAVISIDE) {
+				preset = PRESET_HEAVISIDE;
+			}
+		}
+		Key key = {preset, a, quantize(plane, ptol), scale};
+		appendSupportKey(rho, center, flip, ptol, key);
+		return key;
+	}
+	// Balls, shells and cylinders are centered on -offset
+	Vec3 c = reflect({{-rho.offset[0], -rho.offset[1], -rho.offset[2]}}, center, flip);
+	Key key = {rho.preset, rho.var[0], rho.var[1], quantize(rho.value, ptol), scale};
+	for (int a = 0; a < 3; a++) {
+		key.push_back(used[a] ? quantize(c[a], ptol) : 0);
+	}
+	appendSupportKey(rho, center, flip, ptol, key);
+	return key;
+}
+
+static bool samePresets(const std::vector<const ChargeDensityFunc*>& analytic, const Vec3& center,
+	const bool flip[3], int parity, float ptol) {
+	const bool none[3] = {false, false, false};
+	std::vector<Key> original, image;
+	for (const ChargeDensityFunc* rho : analytic) {
+		original.push_back(presetKey(*rho, center, none, 1, ptol));
+		image.push_back(presetKey(*rho, center, flip, parity, ptol));
+	}
+	std::sort(original.begin(), original.end());
+	std::sort(image.begin(), image.end());
+	return original == image;
+}
+
+Symmetry detectSymmetry(const std::vector<Vec4>& charges,
+	const std::vector<const ChargeDensityFunc*>& analytic, const Vec3& center, int axis) {
+	Symmetry symmetry;
+	if (charges.empty() && analytic.empty()) {
+		return symmetry;
+	}
+	for (const ChargeDensityFunc* rho : analytic) {
+		bool used[3];
+		if (!presetAxes(*rho, used)) {
+			return symmetry;
+		}
+	}
+	float extent = 1, charge = 0;
+	for (const Vec4& c : charges) {
+		charge = std::max(charge, fabsf(c[0]));
+		for (int a = 0; a < 3; a++) {
+			extent = std::max(extent, fabsf(c[a + 1] - center[a]));
+		}
+	}
+	float ptol = SYMMETRY_TOLERANCE * extent;
+	float qtol = SYMMETRY_TOLERANCE * std::max(charge, 1e-30f);
+	int a1 = axis == 0 ? 1 : 0;
+	int a2 = axis == 2 ? 1 : 2;
+	// Mirrors across each in-plane axis, then the half turn
+	bool flips[3][3] = {{false, false, false}, {false, false, false}, {false, false, false}};
+	flips[0][a1] = true;
+	flips[1][a2] = true;
+	flips[2][a1] = flips[2][a2] = true;
+	int* targets[] = {&symmetry.mirror[a1], &symmetry.mirror[a2], &symmetry.rotation};
+	for (int k = 0; k < 3; k++) {
+		for (int parity : {1, -1}) {
+			if (sameCharges(charges, center, flips[k], parity, ptol, qtol)
+				&& samePresets(analytic, center, flips[k], parity, ptol)) {
+				*targets[k] = parity;
+				break;
+			}
+		}
+	}
+	symmetry.restrict(axis);
+	return symmetry;
+}
+
+// Number of samples kept along an axis of n samples
+static size_t half(size_t n) {
+	return (n + 1) / 2;
+}
+
+void fundamentalGrid(const PlaneGrid& grid, const Symmetry& symmetry, PlaneGrid& reduced) {
+	reduced = grid;
+	bool mu = symmetry.mirror[grid.axis1] != 0;
+	bool mv = symmetry.mirror[grid.axis2] != 0;
+	if (mu) {
+		reduced.u.resize(half(grid.width()));
+	}
+	if (mv || (!mu && symmetry.rotation)) {
+		reduced.v.resize(half(grid.height()));
+	}
+}
+
+void unfoldField(const FieldBuffer& reduced, const PlaneGrid& grid, const Symmetry& symmetry,
+	FieldBuffer& field) {
+	size_t w = grid.width(), h = grid.height();
+	if (field.width != w || field.height != h) {
+		field.resize(w, h);
+	}
+	int mu = symmetry.mirror[grid.axis1];
+	int mv = symmetry.mirror[grid.axis2];
+	bool turn = !mu && !mv && symmetry.rotation;
+	std::vector<float>* out[3] = {&field.x, &field.y, &field.z};
+	const std::vector<float>* in[3] = {&reduced.x, &reduced.y, &reduced.z};
+	for (size_t j = 0; j < h; j++) {
+		for (size_t i = 0; i < w; i++) {
+			size_t ri = i, rj = j;
+			// Sign of the image and of its components along u and v
+			float s = 1, su = 1, sv = 1;
+			if (mu && i >= reduced.width) {
+				ri = w - 1 - i;
+				s *= mu;
+				su = -su;
+			}
+			if (mv && j >= reduced.height) {
+				rj = h - 1 - j;
+				s *= mv;
+				sv = -sv;
+			}
+			if (turn && j >= reduced.height) {
+				ri = w - 1 - i;
+				rj = h - 1 - j;
+				s *= symmetry.rotation;
+				su = -su;
+				sv = -sv;
+			}
+			size_t from = rj * reduced.width + ri;
+			size_t to = j * w + i;
+			for (int c = 0; c < 3; c++) {
+				float sign = c == grid.axis1 ? s * su : c == grid.axis2 ? s * sv : s;
+				(*out[c])[to] += sign * (*in[c])[from];
+			}
+		}
+	}
+}
@@ -0,0 +1,66 @@
+// Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation (version 3)
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+// See README and LICENSE for more details.
+
+
+#ifndef SYMMETRY_H
+#define SYMMETRY_H
+
+#include "density.h"
+#include "field.h"
+
+// Mirror and half turn symmetries of the charges about the center of the
+// plot box. The fields are then only evaluated on a fundamental domain of
+// the plane of interest and the rest of the grid is filled in by mirroring:
+// if every charge q at p has an image s q at M p, E(M p) = s M E(p).
+// Parities s are 1 for images of the same sign (e.g. two equal charges),
+// -1 for images of the opposite sign (a dipole) and 0 without symmetry.
+
+#define SYMMETRY_NONE 0
+#define SYMMETRY_AUTO 1
+#define SYMMETRY_DECLARED 2
+
+#define SYMMETRY_MODE_COUNT 3
+extern const char* symmetryModes[];
+
+struct Symmetry {
+	// Mirror across the plane through the center normal to each axis
+	int mirror[3] = {0, 0, 0};
+	// Half turn about the normal axis of the plane of interest
+	int rotation = 0;
+
+	// Only the symmetries that map the plane of interest (normal to `axis`)
+	// onto itself are kept, and the ones implied by the others are added:
+	// mirroring across both in-plane axes is a half turn, and a half turn
+	// with one mirror gives the other
+	void restrict(int axis);
+	bool any() const { return mirror[0] || mirror[1] || mirror[2] || rotation; }
+	// Formats the symmetries as e.g. "mirror x (odd), mirror y (even)"
+	void describe(char* buf, size_t size) const;
+};
+
+// Symmetries of the charges (including rasterized densities) and the
+// closed-form densities about the given center, up to a relative tolerance
+Symmetry detectSymmetry(const std::vector<Vec4>& charges,
+	const std::vector<const ChargeDensityFunc*>& analytic, const Vec3& center, int axis);
+
+// Part of the grid the fields are evaluated on: the first half (rounded up)
+// of each mirrored axis, or of the v axis for a half turn alone
+void fundamentalGrid(const PlaneGrid& grid, const Symmetry& symmetry, PlaneGrid& reduced);
+
+// Adds the field on the whole grid, given the field on its fundamental grid
+void unfoldField(const FieldBuffer& reduced, const PlaneGrid& grid, const Symmetry& symmetry,
+	FieldBuffer& field);
+
+#endif
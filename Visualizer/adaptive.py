@@ -0,0 +1,159 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+import numpy as np
+
+# Number of root cells along the longer side of the plane
+ROOT_CELLS = 8
+# Fraction of the median field strength below which the error is measured in
+# absolute terms, so cells around field nulls aren't refined forever
+FLOOR = 1e-3
+
+class AdaptivePlane:
+	"""Quadtree sampling of the plane of interest, matching the editor's
+	AdaptivePlane. Every cell is judged by comparing the fields at its center
+	with the mean of its corners; cells whose relative error exceeds the
+	tolerance are split into four. Sample points lie on a lattice at the
+	finest level so shared corners are evaluated once, and every refinement
+	level is evaluated in one batch.
+
+	Args:
+		u: Sample coordinates of the plot grid along the first in-plane axis
+		v: Sample coordinates of the plot grid along the second in-plane axis
+		tolerance: Largest relative error of the interpolation of a cell
+		max_depth: Number of times a root cell can be split
+	"""
+	def __init__(self, u, v, tolerance=0.01, max_depth=8):
+		self.u = np.asarray(u, dtype=float)
+		self.v = np.asarray(v, dtype=float)
+		self.tolerance = tolerance
+		self.u0, self.v0 = self.u[0], self.v[0]
+		extent_u, extent_v = self.u[-1] - self.u0, self.v[-1] - self.v0
+		root = max(extent_u, extent_v) / ROOT_CELLS
+		if root <= 0:
+			root = 1
+		# Cells smaller than the spacing of the plot grid can't add detail to it
+		spacing = max(extent_u / max(len(self.u) - 1, 1), extent_v / max(len(self.v) - 1, 1))
+		depth = max(0, min(max_depth, 20))
+		while depth > 0 and root / 2 ** depth < spacing:
+			depth -= 1
+		self.depth = depth
+		self.size = 2 ** depth
+		self.h = root / self.size
+		self.nu = max(1, int(np.ceil(extent_u / root)))
+		self.nv = max(1, int(np.ceil(extent_v / root)))
+		self.index = {}
+		self.values = np.zeros((6, 0))
+		self.leaves = []
+
+	def _points(self, iu, iv, pending):
+		"""Indices of lattice points, queueing the ones not sampled yet"""
+		ids = np.empty(len(iu), dtype=np.int64)
+		for k, key in enumerate(zip(iu.tolist(), iv.tolist())):
+			point = self.index.get(key)
+			if point is None:
+				point = self.index[key] = self.values.shape[1] + len(pending)
+				pending.append(key)
+			ids[k] = point
+		return ids
+
+	def build(self, evaluate):
+		"""Refines the plane
+
+		Args:
+			evaluate: Function mapping arrays of (u, v) coordinates with shape
+				(2, N) to the electric and magnetic fields at those points,
+				each with shape (3, N)
+		"""
+		iu, iv = np.meshgrid(np.arange(self.nu) * self.size, np.arange(self.nv) * self.size)
+		iu, iv = iu.ravel(), iv.ravel()
+		floor = None
+		for level in range(self.depth + 1):
+			if len(iu) == 0:
+				break
+			s = self.size >> level
+			pending = []
+			corners = [self._points(iu + du, iv + dv, pending) for du, dv in [(0, 0), (s, 0), (0, s), (s, s)]]
+			if level < self.depth:
+				center = self._points(iu + s // 2, iv + s // 2, pending)
+			if pending:
+				lattice = np.array(pending, dtype=float).T
+				uv = np.array([self.u0 + lattice[0] * self.h, self.v0 + lattice[1] * self.h])
+				E, B = evaluate(uv)
+				self.values = np.concatenate([self.values, np.concatenate([E, B])], axis=1)
+			if floor is None:
+				magnitude = np.linalg.norm(self.values.reshape(2, 3, -1), axis=1)
+				floor = FLOOR * np.median(magnitude, axis=1)
+			if level == self.depth:
+				self.leaves.append((level, iu, iv))
+				break
+			F = self.values.reshape(2, 3, -1)
+			mean = sum(F[:, :, c] for c in corners) / 4
+			diff = np.linalg.norm(F[:, :, center] - mean, axis=1)
+			scale = np.maximum(np.linalg.norm(F[:, :, center], axis=1), floor[:, None])
+			with np.errstate(divide="ignore", invalid="ignore"):
+				error = np.where(scale > 0, diff / scale, 0).max(axis=0)
+			refine = error > self.tolerance
+			self.leaves.append((level, iu[~refine], iv[~refine]))
+			iu, iv = iu[refine], iv[refine]
+			half = s // 2
+			iu = np.concatenate([iu, iu + half, iu, iu + half])
+			iv = np.concatenate([iv, iv, iv + half, iv + half])
+
+	def evaluations(self):
+		return self.values.shape[1]
+
+	def leaf_count(self):
+		return sum(len(iu) for _, iu, _ in self.leaves)
+
+	def resample(self):
+		"""Interpolates the sampled fields bilinearly onto the plot grid
+
+		Returns:
+			Electric and magnetic fields as (3, v, u) arrays
+		"""
+		a = (self.u - self.u0) / self.h
+		b = (self.v - self.v0) / self.h
+		A, B = np.meshgrid(a, b)
+		A, B = A.ravel(), B.ravel()
+		out = np.zeros((6, A.size))
+		for level, iu, iv in self.leaves:
+			if len(iu) == 0:
+				continue
+			s = self.size >> level
+			# Cell of every sample at this level, clamped so the far edge of
+			# the grid belongs to the last cell
+			cu = np.clip(np.floor(A / s) * s, 0, self.nu * self.size - s).astype(np.int64)
+			cv = np.clip(np.floor(B / s) * s, 0, self.nv * self.size - s).astype(np.int64)
+			span = self.nv * self.size + 1
+			keys = iu * span + iv
+			order = np.argsort(keys)
+			keys = keys[order]
+			sample_keys = cu * span + cv
+			pos = np.clip(np.searchsorted(keys, sample_keys), 0, len(keys) - 1)
+			inside = keys[pos] == sample_keys
+			if not inside.any():
+				continue
+			cu, cv = cu[inside], cv[inside]
+			t = (A[inside] - cu) / s
+			r = (B[inside] - cv) / s
+			corners = [
+				[self.index[key] for key in zip((cu + du).tolist(), (cv + dv).tolist())]
+				for du, dv in [(0, 0), (s, 0), (0, s), (s, s)]
+			]
+			weights = [(1 - t) * (1 - r), t * (1 - r), (1 - t) * r, t * r]
+			out[:, inside] = sum(w * self.values[:, c] for w, c in zip(weights, corners))
+		out = out.reshape(6, len(self.v), len(self.u))
+		return out[:3], out[3:]
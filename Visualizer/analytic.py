@@ -0,0 +1,107 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+import numpy as np
+import presets
+
+# Half width of the region where the delta preset is nonzero
+DELTA_TOLERANCE = 0.01
+
+def preset_interval(density_func):
+	"""Determines the interval of values of the preset's variable for which
+	the density is nonzero
+
+	Args:
+		density_func: Preset charge density configuration
+
+	Returns:
+		Lower and upper bounds of the interval (possibly infinite)
+	"""
+	func = density_func["func"]
+	val = density_func["value"]
+	if func == presets.PRESET_DELTA:
+		return val - DELTA_TOLERANCE, val + DELTA_TOLERANCE
+	elif func == presets.PRESET_HEAVISIDE:
+		return val, np.inf
+	elif func == presets.PRESET_REVERSE_HEAVISIDE:
+		return -np.inf, val
+
+def _radial(s, enclosed, power):
+	"""Field pointing along s whose magnitude is enclosed / |s|^power"""
+	r = np.linalg.norm(s, axis=0)
+	with np.errstate(divide="ignore", invalid="ignore"):
+		magnitude = np.where(r > 0, enclosed / r ** (power + 1), 0)
+	return magnitude * s
+
+def whole_preset(density_func):
+	"""Whether the optional "support" box of a preset leaves the shape of the
+	preset intact, i.e. contains the preset's own support. A box cutting into
+	it breaks the symmetry the closed forms rely on."""
+	if "support" not in density_func:
+		return True
+	own = presets.support({key: value for key, value in density_func.items() if key != "support"})
+	if own is None:
+		return True
+	box = density_func["support"]
+	return bool(np.all(np.asarray(box["min"]) <= own[0]) and np.all(own[1] <= np.asarray(box["max"])))
+
+def efield_preset(density_func, space):
+	"""Computes the electric field of a preset charge density in closed form
+	using Gauss's law. Comparisons on r describe balls, spherical shells and
+	the space outside a sphere; comparisons on rc the same for cylinders
+	around the z axis; deltas on x, y or z are thin slabs.
+
+	Regions that extend to infinity only have a well-defined field when the
+	enclosed charge is finite by symmetry (outside a sphere or cylinder), so
+	infinite slabs and the angular variables are left to numerical
+	integration.
+
+	Args:
+		density_func: Preset charge density configuration
+		space: Sampling grid
+
+	Returns:
+		Electric field at each sample point, or None if there is no closed form
+	"""
+	if not whole_preset(density_func):
+		return None
+	var = density_func["var"]
+	scale = density_func.get("scale", 1)
+	offset = density_func.get("offset", 0)
+	if offset == 0:
+		offset = [0, 0, 0]
+	lo, hi = preset_interval(density_func)
+	# The presets compare the variable at X + offset
+	s = np.array([space[i] + offset[i] for i in range(3)])
+
+	if var == "r":
+		lo = max(lo, 0)
+		r = np.linalg.norm(s, axis=0)
+		enclosed = scale * 4 / 3 * np.pi * (np.clip(r, lo, hi) ** 3 - lo ** 3)
+		return _radial(s, enclosed, 2)
+	elif var == "rc":
+		lo = max(lo, 0)
+		s[2] = 0
+		rc = np.linalg.norm(s, axis=0)
+		# Charge per unit length times 2
+		enclosed = scale * 2 * np.pi * (np.clip(rc, lo, hi) ** 2 - lo ** 2)
+		return _radial(s, enclosed, 1)
+	elif var in ["x", "y", "z"] and np.isfinite(lo) and np.isfinite(hi):
+		axis = "xyz".index(var)
+		E = np.zeros_like(space, dtype=float)
+		w = np.clip(s[axis], lo, hi)
+		# Slab charge below the point pushes along +axis, charge above along -axis
+		E[axis] = scale * 2 * np.pi * ((w - lo) - (hi - w))
+		return E
+	return None
@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+import argparse
+import json
+import os
+import resource
+import sys
+import tempfile
+import time
+import numpy as np
+
+import configfile
+import mixedprecision
+import native
+import presets
+import visualizer
+
+# Benchmark suite for the visualizer, the counterpart of the editor's
+# `make bench` (Editor/src/bench.cpp). Scenes are generated with splitmix64
+# from the same seeds, so both tools compute the same charges. Results are
+# written as JSON.
+
+MASK = (1 << 64) - 1
+
+class Random:
+	"""splitmix64 generator matching the native benchmark"""
+	def __init__(self, seed):
+		self.state = seed
+
+	def next(self):
+		self.state = (self.state + 0x9E3779B97F4A7C15) & MASK
+		z = self.state
+		z = ((z ^ (z >> 30)) * 0xBF58476D1CE4E5B9) & MASK
+		z = ((z ^ (z >> 27)) * 0x94D049BB133111EB) & MASK
+		return z ^ (z >> 31)
+
+	def uniform(self, lo, hi):
+		"""Uniform in [lo, hi), rounded like the native generator"""
+		u = np.float32((self.next() >> 11) * 2.0 ** -53)
+		return float(np.float32(lo) + np.float32(hi - lo) * u)
+
+def random_charges(count):
+	"""N charges of random sign and magnitude up to 1 in [-5, 5]^2 x [-1, 1]"""
+	random = Random(count)
+	charges = []
+	for _ in range(count):
+		q = random.uniform(-1, 1)
+		x = random.uniform(-5, 5)
+		y = random.uniform(-5, 5)
+		z = random.uniform(-1, 1)
+		charges.append([q, x, y, z])
+	return {"name": f"random-{count}", "charges": charges,
+		"plot-bounds": {"min": [-5, -5, -1], "max": [5, 5, 1]}}
+
+def dipole_array(k):
+	"""k x k dipoles along x with spacing 1 in the z = 0 plane"""
+	charges = []
+	for j in range(k):
+		for i in range(k):
+			x, y = i - (k - 1) / 2, j - (k - 1) / 2
+			charges += [[1, x - 0.25, y, 0], [-1, x + 0.25, y, 0]]
+	return {"name": f"dipoles-{k}x{k}", "charges": charges}
+
+def preset_density(name, var, func, value):
+	density = {"preset": True, "func": func, "var": var, "value": value, "scale": 1, "offset": [0, 0, 0]}
+	return {"name": f"preset-{name}", "charge-densities": [density],
+		"plot-bounds": {"min": [-5, -5, -1], "max": [5, 5, 1]}}
+
+def peak_memory():
+	"""Peak resident set size of the process in bytes"""
+	peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+	return peak if sys.platform == "darwin" else peak * 1024
+
+def field_case(scene, resolution, solver, precision, repeat):
+	"""Times the field computation of a scene
+
+	Args:
+		scene: Scene configuration with a "name"
+		resolution: Samples per unit
+		solver: Point charge solver
+		precision: Summation precision of the point charges
+		repeat: Number of runs; the fastest is reported
+
+	Returns:
+		Result record
+	"""
+	config = {key: value for key, value in scene.items() if key != "name"}
+	config.update({"plot-margins": [1, 1, 1], "resolution": resolution, "solver": solver,
+		"precision": precision, "b-field": {"plot": False}})
+	config = visualizer.complete_config(config)
+	axes, space = visualizer.build_grid(config)
+	best = setup = np.inf
+	for _ in range(repeat):
+		start = time.perf_counter()
+		sources = visualizer.FieldSources(config)
+		setup = min(setup, time.perf_counter() - start)
+		start = time.perf_counter()
+		visualizer.compute_fields(config, sources, axes, space, visualizer.new_cache())
+		best = min(best, time.perf_counter() - start)
+	charges = len(config.get("charges", []))
+	points = space[0].size
+	result = {
+		"scene": scene["name"],
+		"solver": solver,
+		"precision": precision,
+		"resolution": resolution,
+		"charges": charges,
+		"densities": len(config.get("charge-densities", [])),
+		"points": points,
+		"setup_seconds": setup,
+		"seconds": best,
+		"points_per_second": points / best,
+		"process_peak_rss_bytes": peak_memory()
+	}
+	if charges:
+		result["seconds_per_1k_charges"] = best / (charges / 1000)
+	if charges and solver == "direct":
+		points = mixedprecision.sample_points(space)
+		charge_array = np.array(config["charges"], dtype=float)
+		values = visualizer.efield_charges(charge_array, points, solver, 0, precision)
+		reference = mixedprecision.charge_field(charge_array, points, "double")
+		result["max_relative_error"] = mixedprecision.max_relative_error(values, reference)
+	return result
+
+def config_case(scene, extension, repeat):
+	"""Times writing and reading a scene's configuration file"""
+	config = {"resolution": 10, "plot-margins": [1, 1, 1], "charges": scene["charges"]}
+	fd, path = tempfile.mkstemp(suffix=extension)
+	os.close(fd)
+	write = read = np.inf
+	try:
+		for _ in range(repeat):
+			start = time.perf_counter()
+			configfile.write_config(path, config)
+			write = min(write, time.perf_counter() - start)
+			start = time.perf_counter()
+			loaded = configfile.read_config(path)
+			read = min(read, time.perf_counter() - start)
+			if len(loaded["charges"]) != len(scene["charges"]):
+				raise Exception(f"Read {len(loaded['charges'])} charges instead of {len(scene['charges'])}")
+		size = os.path.getsize(path)
+	finally:
+		os.remove(path)
+	return {
+		"format": extension[1:],
+		"charges": len(scene["charges"]),
+		"bytes": size,
+		"write_seconds": write,
+		"read_seconds": read,
+		"write_mb_per_second": size / write / 1e6,
+		"read_mb_per_second": size / read / 1e6,
+		"read_charges_per_second": len(scene["charges"]) / read
+	}
+
+def run(quick=False, repeat=3):
+	"""Runs the benchmark suite
+
+	Args:
+		quick: Use fewer and smaller cases
+		repeat: Number of runs per case
+
+	Returns:
+		Report with the results of every case
+	"""
+	resolutions = [10] if quick else [10, 20]
+	scenes = [
+		random_charges(1000), random_charges(4000 if quick else 10000), dipole_array(10),
+		preset_density("ball", "r", presets.PRESET_REVERSE_HEAVISIDE, 2),
+		preset_density("shell", "r", presets.PRESET_DELTA, 2),
+		preset_density("outside-sphere", "r", presets.PRESET_HEAVISIDE, 2),
+		preset_density("cylinder", "rc", presets.PRESET_REVERSE_HEAVISIDE, 1),
+		preset_density("slab", "z", presets.PRESET_DELTA, 0)
+	]
+	results = []
+	for scene in scenes:
+		for resolution in resolutions:
+			solvers = ["direct"]
+			if native.available() and len(scene.get("charges", [])) >= 1000:
+				solvers.append("barnes-hut")
+			for solver in solvers:
+				# Large direct sums are timed with every precision
+				precisions = ["double"]
+				if len(scene.get("charges", [])) >= 1000 and solver == "direct":
+					precisions = mixedprecision.PRECISIONS
+				for precision in precisions:
+					result = field_case(scene, resolution, solver, precision, repeat)
+					results.append(result)
+					print(f"{scene['name']:24} {solver:10} {precision:11} res {resolution:3}: {result['seconds']:.4f} s, {result['points_per_second']:.3g} points/s", file=sys.stderr)
+	large = random_charges(20000 if quick else 200000)
+	io = []
+	for extension in [".json", ".cbor"]:
+		io.append(config_case(large, extension, repeat))
+		print(f"config {extension[1:]}: {json.dumps(io[-1])}", file=sys.stderr)
+	return {
+		"version": 1,
+		"tool": "visualizer",
+		"backend": "native" if native.available() else "numpy",
+		"threads": os.cpu_count(),
+		"repeat": repeat,
+		"fields": results,
+		"config_io": io
+	}
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser("EM Field Visualizer benchmarks")
+	parser.add_argument("--quick", action="store_true", help="Run fewer and smaller cases")
+	parser.add_argument("--repeat", nargs=1, type=int, default=[3], help="Runs per case; the fastest is reported; default 3")
+	parser.add_argument("--out", nargs=1, type=str, default=[None], help="Output file for the JSON results; default standard output")
+	args = parser.parse_args()
+
+	report = json.dumps(run(args.quick, max(1, args.repeat[0])), indent=4)
+	if args.out[0] is None:
+		print(report)
+	else:
+		with open(args.out[0], "w") as out:
+			out.write(report + "\n")
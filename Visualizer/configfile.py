@@ -0,0 +1,181 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+import json
+import struct
+import numpy as np
+
+# Configurations are JSON, or CBOR for files with the .cbor extension. The
+# editor stores the charges of CBOR configurations as one byte string of
+# little-endian float32 (q, x, y, z) values, see Editor/src/configio.h.
+
+def _length(data, pos, info):
+	"""Reads the argument of a CBOR item header"""
+	if info < 24:
+		return info, pos
+	if info > 27:
+		raise ValueError(f"Unsupported CBOR length encoding {info} at byte {pos}")
+	size = 1 << (info - 24)
+	return int.from_bytes(data[pos:pos + size], "big"), pos + size
+
+def _decode(data, pos):
+	"""Decodes the CBOR item starting at pos
+
+	Returns:
+		Decoded value and the position after it
+	"""
+	head = data[pos]
+	major, info = head >> 5, head & 0x1f
+	pos += 1
+	if major == 7:
+		simple = {20: False, 21: True, 22: None, 23: None}
+		if info in simple:
+			return simple[info], pos
+		formats = {25: (">e", 2), 26: (">f", 4), 27: (">d", 8)}
+		if info not in formats:
+			raise ValueError(f"Unsupported CBOR simple value {info} at byte {pos - 1}")
+		fmt, size = formats[info]
+		return struct.unpack(fmt, data[pos:pos + size])[0], pos + size
+	n, pos = _length(data, pos, info)
+	if major == 0:
+		return n, pos
+	elif major == 1:
+		return -1 - n, pos
+	elif major == 2:
+		return bytes(data[pos:pos + n]), pos + n
+	elif major == 3:
+		return bytes(data[pos:pos + n]).decode("utf-8"), pos + n
+	elif major == 4:
+		items = []
+		for _ in range(n):
+			item, pos = _decode(data, pos)
+			items.append(item)
+		return items, pos
+	elif major == 5:
+		items = {}
+		for _ in range(n):
+			key, pos = _decode(data, pos)
+			items[key], pos = _decode(data, pos)
+		return items, pos
+	# Tags (major type 6) only annotate the following item
+	return _decode(data, pos)
+
+def decode_cbor(data):
+	"""Decodes a CBOR document with definite lengths, as written by the
+	editor
+
+	Args:
+		data: Encoded document
+
+	Returns:
+		Decoded value, with byte strings as bytes
+	"""
+	value, pos = _decode(memoryview(data), 0)
+	if pos != len(data):
+		raise ValueError("Trailing data after CBOR document")
+	return value
+
+def _header(major, n):
+	"""Encodes a CBOR item header with the shortest argument"""
+	if n < 24:
+		return bytes([major << 5 | n])
+	for info, size in [(24, 1), (25, 2), (26, 4), (27, 8)]:
+		if n < 1 << (8 * size):
+			return bytes([major << 5 | info]) + n.to_bytes(size, "big")
+	raise ValueError(f"CBOR argument {n} is too large")
+
+def _encode(value, out):
+	if isinstance(value, np.ndarray):
+		value = value.tolist()
+	elif isinstance(value, np.generic):
+		value = value.item()
+	if value is None:
+		out.append(b"\xf6")
+	elif isinstance(value, bool):
+		out.append(b"\xf5" if value else b"\xf4")
+	elif isinstance(value, int):
+		out.append(_header(0, value) if value >= 0 else _header(1, -1 - value))
+	elif isinstance(value, float):
+		out.append(b"\xfb" + struct.pack(">d", value))
+	elif isinstance(value, str):
+		data = value.encode("utf-8")
+		out.append(_header(3, len(data)) + data)
+	elif isinstance(value, (bytes, bytearray)):
+		out.append(_header(2, len(value)) + bytes(value))
+	elif isinstance(value, (list, tuple)):
+		out.append(_header(4, len(value)))
+		for item in value:
+			_encode(item, out)
+	elif isinstance(value, dict):
+		out.append(_header(5, len(value)))
+		for key, item in value.items():
+			_encode(key, out)
+			_encode(item, out)
+	else:
+		raise TypeError(f"Cannot encode {type(value).__name__} as CBOR")
+
+def encode_cbor(value):
+	"""Encodes a value as a CBOR document with definite lengths
+
+	Args:
+		value: Value made of dicts, lists, strings, numbers, bytes and None
+
+	Returns:
+		Encoded document
+	"""
+	out = []
+	_encode(value, out)
+	return b"".join(out)
+
+def write_config(filename, config):
+	"""Writes a JSON or CBOR configuration file
+
+	Args:
+		filename: Path to the configuration; files ending in .cbor are CBOR
+			with the charges packed as float32 values
+		config: Configuration data
+	"""
+	if not filename.endswith(".cbor"):
+		with open(filename, "w") as data:
+			json.dump(config, data, indent=4, default=lambda x: x.tolist())
+		return
+	config = dict(config)
+	if "charges" in config:
+		config["charges"] = np.asarray(config["charges"], dtype="<f4").reshape(-1, 4).tobytes()
+	with open(filename, "wb") as data:
+		data.write(encode_cbor(config))
+
+def read_config(filename):
+	"""Reads a JSON or CBOR configuration file
+
+	Args:
+		filename: Path to the configuration; files ending in .cbor are CBOR
+
+	Returns:
+		Configuration data, with packed charges as an (N, 4) array
+	"""
+	if not filename.endswith(".cbor"):
+		with open(filename) as data:
+			return json.load(data)
+	with open(filename, "rb") as data:
+		config = decode_cbor(data.read())
+	if not isinstance(config, dict):
+		raise ValueError("Configuration must be a map")
+	charges = config.get("charges")
+	if isinstance(charges, bytes):
+		if len(charges) % 16 != 0:
+			raise ValueError("Packed charges must hold 4 floats per charge")
+		config["charges"] = np.frombuffer(charges, dtype="<f4").reshape(-1, 4).astype(float)
+	return config
@@ -0,0 +1,98 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+import numpy as np
+
+# Canonical form of the configuration parameters that determine the computed
+# fields, shared with the editor (Editor/src/confighash.h) so that both tools
+# agree on result cache keys. Keys are sorted, preset densities always carry
+# their scale and offset (and current densities their direction), and every
+# number is written as its single precision value with %.9g so that both
+# tools produce the same text regardless of how the numbers were parsed.
+
+physics_keys = [
+	"b-field", "charge-densities", "charges", "current-densities", "current-loops", "currents",
+	"density-method", "e-field", "error-budget", "max-depth", "opening-angle", "plane", "plot-bounds",
+	"plot-margins", "precision", "resolution", "sampling", "solver", "symmetry", "voxel-resolution"
+]
+
+def canonical_value(value):
+	if isinstance(value, np.ndarray):
+		value = value.tolist()
+	elif isinstance(value, np.generic):
+		value = value.item()
+	if isinstance(value, dict):
+		items = sorted(value.items())
+		return "{" + ",".join(f"{canonical_value(k)}:{canonical_value(v)}" for k, v in items) + "}"
+	if isinstance(value, (list, tuple)):
+		return "[" + ",".join(canonical_value(v) for v in value) + "]"
+	if isinstance(value, str):
+		return '"' + value.replace("\\", "\\\\").replace('"', '\\"') + '"'
+	if isinstance(value, bool):
+		return "true" if value else "false"
+	if isinstance(value, (int, float)):
+		return "%.9g" % float(np.float32(value))
+	return "null"
+
+def canonical_density(density_func):
+	if not density_func.get("preset", False):
+		canonical = {"preset": False, "func": density_func["func"]}
+	else:
+		offset = density_func.get("offset", 0)
+		if not isinstance(offset, (list, tuple, np.ndarray)):
+			offset = [0, 0, 0]
+		canonical = {
+			"preset": True,
+			"func": density_func["func"],
+			"var": density_func["var"],
+			"value": density_func["value"],
+			"scale": density_func.get("scale", 1),
+			"offset": offset
+		}
+	if "support" in density_func:
+		canonical["support"] = density_func["support"]
+	return canonical
+
+def canonical_config(config):
+	"""Canonical text of the physics-relevant configuration parameters
+
+	Args:
+		config: Completed environment configuration
+
+	Returns:
+		Canonical form as a string
+	"""
+	physics = {}
+	for key in physics_keys:
+		if key not in config:
+			continue
+		if key in ["charge-densities", "current-densities"]:
+			physics[key] = [canonical_density(density_func) for density_func in config[key]]
+			if key == "current-densities":
+				for canonical, density_func in zip(physics[key], config[key]):
+					canonical["direction"] = density_func.get("direction", [0, 0, 1])
+		elif key in ["e-field", "b-field"]:
+			# Only the fields that are plotted are computed
+			physics[key] = {"plot": config[key].get("plot", True)}
+		else:
+			physics[key] = config[key]
+	return canonical_value(physics)
+
+def config_hash(config):
+	"""64-bit FNV-1a hash of the canonical configuration as 16 hex digits"""
+	h = 14695981039346656037
+	for c in canonical_config(config).encode():
+		h = ((h ^ c) * 1099511628211) & 0xffffffffffffffff
+	return f"{h:016x}"
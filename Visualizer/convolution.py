@@ -0,0 +1,133 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+import numpy as np
+from scipy.interpolate import RegularGridInterpolator
+
+import profiler
+
+def integration_box(config):
+	"""Determines the volume over which charge densities are integrated
+
+	Args:
+		config: Environment configuration
+
+	Returns:
+		Lower and upper corners of the box
+	"""
+	lo = np.array(config["plot-bounds"]["min"], dtype=float) - config["plot-margins"]
+	hi = np.array(config["plot-bounds"]["max"], dtype=float) + config["plot-margins"]
+	return lo, hi
+
+def rasterize(rho, z, y, x):
+	"""Samples a charge density function on a voxel lattice
+
+	Args:
+		rho: Charge density function
+		z, y, x: Voxel center coordinates
+
+	Returns:
+		Density at each voxel
+	"""
+	try:
+		values = np.asarray(rho(z, y, x), dtype=float)
+		if values.shape == x.shape:
+			return values
+	except Exception:
+		pass
+	# Functions that only accept scalars
+	return np.vectorize(rho, otypes=[float])(z, y, x)
+
+def efield_density(rho, config, axes, ax3, box=None):
+	"""Computes the electric field of a charge density on the plane of
+	interest by rasterizing it on a voxel lattice and convolving it with the
+	Coulomb kernel using FFTs.
+
+	The lattice spans the plot bounds plus margins on every axis with
+	`voxel-resolution` voxels per unit. For each layer of voxels along the
+	axis normal to the plane, the in-plane convolution with the kernel at
+	that layer's distance from the plane is accumulated in frequency space,
+	so a single inverse transform per field component is needed. The result
+	is interpolated onto the plot samples. With a support box, the density
+	is only sampled at the voxels inside it and empty layers are skipped.
+
+	Args:
+		rho: Charge density function
+		config: Environment configuration
+		axes: Sample coordinates of the plot along each axis
+		ax3: Axis normal to the plane of interest
+		box: Lower and upper corners of the density's support, if known
+
+	Returns:
+		Electric field with the shape of the plot's sampling grid
+	"""
+	ax1, ax2 = [i for i in range(3) if i != ax3]
+	Z = axes[ax3][0]
+	lo, hi = integration_box(config)
+	n = np.maximum(2, (config["voxel-resolution"] * (hi - lo)).astype(int) + 1)
+	u = np.linspace(lo[ax1], hi[ax1], n[ax1])
+	v = np.linspace(lo[ax2], hi[ax2], n[ax2])
+	h = (hi - lo) / (n - 1)
+	# Voxel centers along the normal axis, so the plane never hits a layer
+	# boundary exactly
+	h[ax3] = (hi[ax3] - lo[ax3]) / n[ax3]
+	w = lo[ax3] + (np.arange(n[ax3]) + 0.5) * h[ax3]
+	dV = np.prod(h)
+
+	n1, n2 = len(u), len(v)
+	du = (np.arange(-(n1 - 1), n1) * h[ax1])[:,None]
+	dv = (np.arange(-(n2 - 1), n2) * h[ax2])[None,:]
+	shape = (3 * n1 - 2, 3 * n2 - 2)
+	spectra = [np.zeros((shape[0], shape[1] // 2 + 1), dtype=complex) for _ in range(2)]
+
+	# Voxels within the support, widened by one voxel so rounding can't
+	# drop a nonzero one at its edge
+	inside = [np.ones(len(u), dtype=bool), np.ones(len(v), dtype=bool), np.ones(len(w), dtype=bool)]
+	if box is not None:
+		for mask, centers, axis in zip(inside, [u, v, w], [ax1, ax2, ax3]):
+			mask &= (centers >= box[0][axis] - h[axis]) & (centers <= box[1][axis] + h[axis])
+	su, sv = np.nonzero(inside[0])[0], np.nonzero(inside[1])[0]
+	profiler.count("density-evaluations", len(su) * len(sv) * int(np.count_nonzero(inside[2])))
+	if len(su) == 0 or len(sv) == 0:
+		return np.zeros((3,) + np.meshgrid(*axes)[0].shape)
+	block = np.ix_(su, sv)
+	U, V = np.meshgrid(u[su], v[sv], indexing="ij")
+	for k in np.nonzero(inside[2])[0]:
+		X = [None] * 3
+		X[ax1], X[ax2], X[ax3] = U, V, np.full_like(U, w[k])
+		values = rasterize(rho, X[2], X[1], X[0])
+		if not np.any(values):
+			continue
+		layer = np.zeros((len(u), len(v)))
+		layer[block] = values
+		layer_spectrum = np.fft.rfft2(layer, shape)
+		dw = Z - w[k]
+		denom = (du ** 2 + dv ** 2 + dw ** 2) ** 1.5 + 1e-6
+		for c, d in enumerate([du, dv]):
+			kernel = np.broadcast_to(d, denom.shape) / denom
+			spectra[c] += layer_spectrum * np.fft.rfft2(kernel, shape)
+
+	e_field = [np.zeros((n1, n2)) for _ in range(3)]
+	for c, axis in enumerate([ax1, ax2]):
+		full = np.fft.irfft2(spectra[c], shape)
+		e_field[axis] = full[n1 - 1:2 * n1 - 1, n2 - 1:2 * n2 - 1] * dV
+
+	# Interpolate onto the plot samples; meshgrid puts y first, then x, then z
+	grid = np.meshgrid(*axes)
+	points = np.stack([grid[ax1].ravel(), grid[ax2].ravel()], axis=-1)
+	result = np.zeros((3,) + grid[0].shape)
+	for axis in [ax1, ax2]:
+		interpolate = RegularGridInterpolator((u, v), e_field[axis], bounds_error=False, fill_value=None)
+		result[axis] = interpolate(points).reshape(grid[0].shape)
+	return result
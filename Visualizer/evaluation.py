@@ -21,7 +21,8 @@ numpy_functions = dict(
 	cos=np.cos,
 	tan=np.tan,
 	abs=np.abs,
-	norm=np.linalg.norm
+	# Elementwise, so that compiled expressions can be evaluated on arrays
+	norm=lambda *xi: np.sqrt(sum(np.square(x) for x in xi))
 )
 
 numpy_variables = dict(
@@ -65,3 +66,91 @@ def _safe_eval(node, variables, functions):
 def safe_eval(expr, variables={}, functions={}):
         node = ast.parse(expr, '<string>', 'eval').body
         return _safe_eval(node, variables, functions)
+
+# Compiled expressions are the whitelisted syntax tree flattened into postfix
+# instructions. Evaluating them runs each instruction once on whole arrays of
+# sample points instead of walking the tree again for every point.
+
+OP_CONST = 0
+OP_VAR = 1
+OP_BINARY = 2
+OP_POW = 3
+OP_NEG = 4
+OP_CALL = 5
+
+def _is_number(node):
+	return isinstance(node, ast.Constant) and type(node.value) in (int, float)
+
+def _compile(node, variables, constants, functions, code):
+	if _is_number(node):
+		code.append((OP_CONST, node.value))
+	elif isinstance(node, ast.Name):
+		if node.id in constants:
+			code.append((OP_CONST, constants[node.id]))
+		elif node.id in variables:
+			code.append((OP_VAR, node.id))
+		else:
+			raise KeyError(node.id) # Unsafe variable
+	elif isinstance(node, ast.BinOp):
+		op = ast_operations[node.op.__class__] # KeyError -> Unsafe operation
+		_compile(node.left, variables, constants, functions, code)
+		_compile(node.right, variables, constants, functions, code)
+		if isinstance(node.op, ast.Pow):
+			if _is_number(node.right):
+				assert node.right.value < 100
+				code.append((OP_BINARY, op))
+			else:
+				code.append((OP_POW, op))
+		else:
+			code.append((OP_BINARY, op))
+	elif isinstance(node, ast.UnaryOp) and isinstance(node.op, (ast.USub, ast.UAdd)):
+		_compile(node.operand, variables, constants, functions, code)
+		if isinstance(node.op, ast.USub):
+			code.append((OP_NEG, None))
+	elif isinstance(node, ast.Call):
+		assert not node.keywords
+		assert isinstance(node.func, ast.Name), 'Unsafe function derivation'
+		func = functions[node.func.id] # KeyError -> Unsafe function
+		for arg in node.args:
+			_compile(arg, variables, constants, functions, code)
+		code.append((OP_CALL, (func, len(node.args))))
+	else:
+		assert False, 'Unsafe operation'
+
+class CompiledExpression:
+	"""Whitelisted expression parsed once and evaluated on arrays
+
+	Attributes:
+		code: Postfix instructions
+		variables: Names of the variables the expression uses
+	"""
+	def __init__(self, expr, variables, constants={}, functions={}):
+		node = ast.parse(expr, '<string>', 'eval').body
+		self.code = []
+		_compile(node, variables, constants, functions, self.code)
+		self.variables = sorted({arg for op, arg in self.code if op == OP_VAR})
+
+	def __call__(self, **values):
+		stack = []
+		for op, arg in self.code:
+			if op == OP_CONST:
+				stack.append(arg)
+			elif op == OP_VAR:
+				stack.append(values[arg])
+			elif op == OP_NEG:
+				stack.append(-stack.pop())
+			elif op == OP_CALL:
+				func, argc = arg
+				args = stack[len(stack) - argc:]
+				del stack[len(stack) - argc:]
+				stack.append(func(*args))
+			else:
+				right = stack.pop()
+				left = stack.pop()
+				if op == OP_POW:
+					assert np.all(right < 100)
+				stack.append(arg(left, right))
+		return stack.pop()
+
+def compile_expression(expr, variables, constants={}, functions={}):
+	return CompiledExpression(expr, variables, constants, functions)
@@ -0,0 +1,176 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+import numpy as np
+
+# Binary field data shared with the editor (Editor/src/fieldfile.h). A fixed
+# little-endian header is followed by the sample coordinates along the two
+# in-plane axes and then the three field components, each stored
+# contiguously in row-major order (v, u). Volume files hold a stack of such
+# planes (slabs) along the normal axis: the slab coordinates follow the
+# in-plane axes and the slabs are stored one after the other, so they can be
+# written as they are computed.
+
+MAGIC = b"EMFD"
+VERSION = 1
+
+header_dtype = np.dtype([
+	("magic", "S4"),
+	("version", "<u4"),
+	("dtype", "<u4"),
+	("kind", "<u4"),
+	("axis", "<i4"),
+	("axis1", "<i4"),
+	("axis2", "<i4"),
+	("depth", "<u4"),
+	("width", "<u8"),
+	("height", "<u8"),
+	("coordinate", "<f8"),
+	("data_offset", "<u8")
+])
+
+dtypes = [np.dtype("<f4"), np.dtype("<f8")]
+
+def plane_axes(ax3):
+	"""In-plane axes for the given normal axis, in increasing order"""
+	return [i for i in range(3) if i != ax3]
+
+def to_plane(field, ax3):
+	"""Extracts the (v, u) arrays of each component from a field with the
+	shape of the visualizer's sampling grid, where meshgrid puts y first,
+	then x, then z"""
+	plane = np.squeeze(field, axis=1 + [1, 0, 2][ax3])
+	# For the XY plane the remaining grid axes are already (y, x) = (v, u)
+	return plane if ax3 == 2 else np.swapaxes(plane, 1, 2)
+
+def from_plane(plane, ax3):
+	"""Inverse of to_plane"""
+	field = plane if ax3 == 2 else np.swapaxes(plane, 1, 2)
+	return np.expand_dims(field, axis=1 + [1, 0, 2][ax3])
+
+class FieldWriter:
+	"""Writes a field file slab by slab so only one slab needs to be in memory
+
+	Args:
+		filename: Output path
+		axes: Sample coordinates along each axis
+		ax3: Axis normal to the plane of interest
+		kind: "E" or "B"
+		slabs: Coordinate of each slab along ax3, or None for a single plane
+		dtype: np.float32 or np.float64
+	"""
+	def __init__(self, filename, axes, ax3, kind="E", slabs=None, dtype=np.float64):
+		self.dtype = np.dtype(dtype).newbyteorder("<")
+		self.ax3 = ax3
+		ax1, ax2 = plane_axes(ax3)
+		u, v = np.asarray(axes[ax1]), np.asarray(axes[ax2])
+		header = np.zeros((), dtype=header_dtype)
+		header["magic"] = MAGIC
+		header["version"] = VERSION
+		header["dtype"] = dtypes.index(self.dtype)
+		header["kind"] = ord(kind)
+		header["axis"] = ax3
+		header["axis1"], header["axis2"] = ax1, ax2
+		header["depth"] = 0 if slabs is None else len(slabs)
+		header["width"], header["height"] = len(u), len(v)
+		header["coordinate"] = axes[ax3][0] if slabs is None else slabs[0]
+		header["data_offset"] = header_dtype.itemsize
+		self.remaining = 1 if slabs is None else len(slabs)
+		self.file = open(filename, "wb")
+		self.file.write(header.tobytes())
+		arrays = [u, v] + ([] if slabs is None else [np.asarray(slabs)])
+		for array in arrays:
+			self.file.write(np.ascontiguousarray(array, dtype=self.dtype).tobytes())
+
+	def write(self, field):
+		"""Appends the next slab given with the shape of the sampling grid"""
+		if self.remaining == 0:
+			raise ValueError("All slabs have already been written")
+		self.file.write(np.ascontiguousarray(to_plane(field, self.ax3), dtype=self.dtype).tobytes())
+		self.remaining -= 1
+
+	def close(self):
+		self.file.close()
+		if self.remaining != 0:
+			raise ValueError(f"{self.remaining} slabs were not written")
+
+def write_field(filename, field, axes, ax3, kind="E", dtype=np.float64):
+	"""Writes a field computed on the plane of interest
+
+	Args:
+		filename: Output path
+		field: Field with the shape of the sampling grid
+		axes: Sample coordinates along each axis
+		ax3: Axis normal to the plane of interest
+		kind: "E" or "B"
+		dtype: np.float32 or np.float64
+	"""
+	writer = FieldWriter(filename, axes, ax3, kind, dtype=dtype)
+	writer.write(field)
+	writer.close()
+
+class FieldData:
+	"""Memory-mapped field file. The arrays are views of the file, so
+	nothing is read until it is accessed.
+
+	Attributes:
+		kind: "E" or "B"
+		ax3: Axis normal to the plane of interest
+		coordinate: Coordinate of the plane (or first slab) along ax3
+		u, v: Sample coordinates along the in-plane axes
+		w: Slab coordinates along ax3 of a volume file, otherwise None
+		components: Array of shape (3, len(v), len(u)), or
+			(len(w), 3, len(v), len(u)) for a volume file
+	"""
+	def __init__(self, filename):
+		header = np.fromfile(filename, dtype=header_dtype, count=1)
+		if len(header) == 0 or header["magic"][0] != MAGIC or header["version"][0] != VERSION:
+			raise ValueError(f"{filename} is not a field data file")
+		header = header[0]
+		dtype = dtypes[header["dtype"]]
+		width, height = int(header["width"]), int(header["height"])
+		offset = int(header["data_offset"])
+		self.kind = chr(header["kind"])
+		self.ax3 = int(header["axis"])
+		self.coordinate = float(header["coordinate"])
+		self.u = np.memmap(filename, dtype=dtype, mode="r", offset=offset, shape=(width,))
+		offset += width * dtype.itemsize
+		self.v = np.memmap(filename, dtype=dtype, mode="r", offset=offset, shape=(height,))
+		offset += height * dtype.itemsize
+		depth = int(header["depth"])
+		self.w = None
+		shape = (3, height, width)
+		if depth > 0:
+			self.w = np.memmap(filename, dtype=dtype, mode="r", offset=offset, shape=(depth,))
+			offset += depth * dtype.itemsize
+			shape = (depth,) + shape
+		self.components = np.memmap(filename, dtype=dtype, mode="r", offset=offset, shape=shape)
+
+	def axes(self, slab=0):
+		"""Sample coordinates along each axis, as built by build_grid"""
+		axes = [None] * 3
+		ax1, ax2 = plane_axes(self.ax3)
+		coordinate = self.coordinate if self.w is None else self.w[slab]
+		axes[ax1], axes[ax2], axes[self.ax3] = self.u, self.v, [coordinate]
+		return axes
+
+	def field(self, slab=0):
+		"""View of the field (or one slab of a volume) with the shape of the
+		visualizer's sampling grid"""
+		components = self.components if self.w is None else self.components[slab]
+		return from_plane(components, self.ax3)
+
+def read_field(filename):
+	return FieldData(filename)
@@ -0,0 +1,86 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+from collections import Counter
+import json
+import numpy as np
+
+def density_key(density_func):
+	return json.dumps(density_func, sort_keys=True)
+
+class FieldCache:
+	"""Field contributions of the sources on one sampling grid. The field is
+	linear in its sources, so when the source list changes only the
+	contributions of added or modified sources are computed and those of
+	removed sources are subtracted.
+
+	Each charge density keeps its own contribution buffer since integrating
+	it again is expensive. Point charges are cheap to evaluate, so they share
+	a single buffer and a removed charge is subtracted by evaluating it with
+	the opposite sign.
+	"""
+	def __init__(self):
+		self.grid = None
+		self.charges = Counter()
+		self.charge_field = None
+		self.densities = {}
+
+	def reset(self):
+		self.__init__()
+
+	def update(self, grid, space, charges, densities, charge_field, density_field):
+		"""Brings the cached field up to date with the given sources
+
+		Args:
+			grid: Key identifying the sampling grid
+			space: Sampling grid
+			charges: List of (q, x, y, z) charges
+			densities: List of charge density configurations
+			charge_field: Function computing the field of an array of charges
+			density_field: Function computing the field of the density with the given index
+
+		Returns:
+			Total field of all sources
+		"""
+		if grid != self.grid:
+			self.reset()
+			self.grid = grid
+			self.charge_field = np.zeros_like(space)
+
+		current = Counter(tuple(charge) for charge in charges)
+		added = list((current - self.charges).elements())
+		removed = list((self.charges - current).elements())
+		if added:
+			self.charge_field += charge_field(np.array(added))
+		if removed:
+			flipped = np.array(removed)
+			flipped[:,0] *= -1
+			self.charge_field += charge_field(flipped)
+		self.charges = current
+
+		contributions = {}
+		for i, density_func in enumerate(densities):
+			key = density_key(density_func)
+			if key in contributions:
+				continue
+			if key in self.densities:
+				contributions[key] = self.densities[key]
+			else:
+				contributions[key] = density_field(i)
+		self.densities = contributions
+
+		total = self.charge_field.copy()
+		for density_func in densities:
+			total += self.densities[density_key(density_func)]
+		return total
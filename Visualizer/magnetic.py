@@ -0,0 +1,110 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+import numpy as np
+import convolution
+
+# Number of straight segments approximating a current loop
+LOOP_SEGMENTS = 64
+
+def loop_segments(loop):
+	"""Splits a current loop into straight segments, as the editor does
+
+	Args:
+		loop: (I, x, y, z, nx, ny, nz, radius) with the current circulating
+			counterclockwise about the normal
+
+	Returns:
+		Array of (I, x1, y1, z1, x2, y2, z2) segments
+	"""
+	I, center, n, R = loop[0], np.array(loop[1:4], dtype=float), np.array(loop[4:7], dtype=float), loop[7]
+	norm = np.linalg.norm(n)
+	if norm == 0 or R <= 0:
+		return np.zeros((0, 7))
+	n /= norm
+	# e1 = n x (x or y axis), e2 = n x e1 so that (e1, e2, n) is right-handed
+	e1 = np.array([0, n[2], -n[1]]) if abs(n[0]) < 0.9 else np.array([-n[2], 0, n[0]])
+	e1 /= np.linalg.norm(e1)
+	e2 = np.cross(n, e1)
+	t = 2 * np.pi * np.arange(LOOP_SEGMENTS + 1) / LOOP_SEGMENTS
+	points = center + R * (np.cos(t)[:,None] * e1 + np.sin(t)[:,None] * e2)
+	return np.column_stack([np.full(LOOP_SEGMENTS, I), points[:-1], points[1:]])
+
+def current_segments(config):
+	"""All line currents and current loops of a configuration as segments"""
+	segments = [np.array(config.get("currents", []), dtype=float).reshape(-1, 7)]
+	for loop in config.get("current-loops", []):
+		segments.append(loop_segments(loop))
+	return np.concatenate(segments)
+
+def segment_field(segments, space):
+	"""Computes the magnetic field of straight current segments with the
+	closed form of the Biot-Savart law for a finite wire, in the same units
+	as the electric field (mu0 / 4pi = 1)
+
+	Args:
+		segments: Array of (I, x1, y1, z1, x2, y2, z2) segments
+		space: Sampling grid
+
+	Returns:
+		Magnetic field at each sample point
+	"""
+	B = np.zeros_like(space)
+	for segment in segments:
+		a = (segment[1:4] - space.T).T
+		b = (segment[4:7] - space.T).T
+		la = np.linalg.norm(a, axis=0)
+		lb = np.linalg.norm(b, axis=0)
+		dot = np.sum(a * b, axis=0)
+		w = segment[0] * (la + lb) / (la * lb * (la * lb + dot) + 1e-6)
+		B += w * np.cross(a, b, axis=0)
+	return B
+
+def rasterize_current(J, direction, config, box=None):
+	"""Samples a current density on the voxel lattice used by the editor and
+	represents every nonzero voxel by a short segment along the current
+	carrying J dV
+
+	Args:
+		J: Density function giving the magnitude of the current density
+		direction: Direction of the current density
+		config: Environment configuration
+		box: Lower and upper corners of the density's support, if known;
+			only the voxels inside it are sampled
+
+	Returns:
+		Array of (I, x1, y1, z1, x2, y2, z2) segments
+	"""
+	d = np.array(direction, dtype=float)
+	norm = np.linalg.norm(d)
+	lo, hi = convolution.integration_box(config)
+	n = np.maximum(1, (config["voxel-resolution"] * (hi - lo)).astype(int))
+	h = (hi - lo) / n
+	centers = [lo[i] + (np.arange(n[i]) + 0.5) * h[i] for i in range(3)]
+	if box is not None:
+		# Widened by one voxel so rounding can't drop a nonzero one at the edge
+		centers = [c[(c >= box[0][i] - h[i]) & (c <= box[1][i] + h[i])] for i, c in enumerate(centers)]
+		if min(len(c) for c in centers) == 0:
+			return np.zeros((0, 7))
+	Z, Y, X = np.meshgrid(centers[2], centers[1], centers[0], indexing="ij")
+	values = convolution.rasterize(J, Z, Y, X)
+	mask = (values != 0) & ~np.isnan(values)
+	if norm == 0 or not np.any(mask):
+		return np.zeros((0, 7))
+	L = np.min(h)
+	I = values[mask] * norm * np.prod(h) / L
+	c = np.column_stack([X[mask], Y[mask], Z[mask]])
+	s = d * L / (2 * norm)
+	return np.column_stack([I, c - s, c + s])
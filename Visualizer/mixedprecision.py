@@ -0,0 +1,79 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+import numpy as np
+
+# Ways of summing the point charge terms, in the same order as the native
+# engine's precisionNames (Editor/src/field.h). Double precision is NumPy's
+# default and what the visualizer uses without a "precision" entry; single
+# precision computes and sums the terms in float32, which halves the memory
+# traffic, and compensated sums the float32 terms with Kahan summation so the
+# error stays close to that of a single term however many charges there are.
+PRECISIONS = ["single", "compensated", "double"]
+
+# Number of sample points compared against the float64 reference
+SAMPLES = 1024
+
+def dtype(precision):
+	return np.float64 if precision == "double" else np.float32
+
+def charge_field(charges, space, precision="double"):
+	"""Computes the electric field of point charges by direct summation
+
+	Args:
+		charges: Array of (q, x, y, z) charges
+		space: Sample coordinates with shape (3, ...)
+		precision: One of PRECISIONS
+
+	Returns:
+		Field with the same shape as space, in the precision's dtype
+	"""
+	t = dtype(precision)
+	points = np.asarray(space, dtype=t)
+	E = np.zeros_like(points)
+	compensation = np.zeros_like(points) if precision == "compensated" else None
+	for charge in np.asarray(charges, dtype=t):
+		s = (points.T - charge[1:]).T
+		term = charge[0] * s / (np.linalg.norm(s, axis=0) ** 3 + t(1e-6))
+		if compensation is None:
+			E += term
+		else:
+			y = term - compensation
+			total = E + y
+			compensation = (total - E) - y
+			E = total
+	return E
+
+def sample_points(space, samples=SAMPLES):
+	"""Up to the given number of sample points spread evenly over a grid, the
+	same subset as the editor's chargeFieldError
+
+	Returns:
+		Coordinates with shape (3, samples)
+	"""
+	points = np.reshape(space, (3, -1))
+	n = points.shape[1]
+	samples = min(samples, n)
+	return points[:, np.arange(samples) * n // samples]
+
+def max_relative_error(values, reference):
+	"""Largest relative error of field vectors with shape (3, N) against a
+	reference; points where the reference vanishes are skipped"""
+	reference = np.asarray(reference, dtype=np.float64)
+	norm = np.linalg.norm(reference, axis=0)
+	diff = np.linalg.norm(np.asarray(values, dtype=np.float64) - reference, axis=0)
+	nonzero = norm > 0
+	if not np.any(nonzero):
+		return 0.0
+	return float(np.max(diff[nonzero] / norm[nonzero]))
@@ -0,0 +1,151 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+import ctypes
+import os
+import threading
+import numpy as np
+
+from mixedprecision import PRECISIONS
+
+# Bindings for the native field engine (Editor/src/emfield.h), built with
+# `make lib` in the Editor directory. If the library can't be found, the
+# visualizer falls back to its NumPy implementation.
+
+_default_path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Editor", "bin", "libemfield.so")
+_lib = None
+_missing = False
+# The library's thread pool can only be used by one caller at a time, e.g.
+# when a sweep plots one frame while computing the next
+_lock = threading.Lock()
+
+_float_p = ctypes.POINTER(ctypes.c_float)
+
+def load(path=None):
+	"""Loads the native field engine
+
+	Args:
+		path: Path to libemfield; defaults to $EMFIELD_LIB or the Editor build directory
+
+	Returns:
+		Whether the library is available
+	"""
+	global _lib, _missing
+	if _lib is not None:
+		return True
+	if path is None:
+		path = os.environ.get("EMFIELD_LIB", _default_path)
+	try:
+		lib = ctypes.CDLL(path)
+	except OSError:
+		_missing = True
+		return False
+	lib.emf_threads.restype = ctypes.c_uint
+	lib.emf_charge_field.restype = None
+	lib.emf_charge_field.argtypes = [_float_p, ctypes.c_size_t, ctypes.c_int] + [_float_p] * 3 + [ctypes.c_size_t] + [_float_p] * 3
+	lib.emf_charge_field_tree.restype = None
+	lib.emf_charge_field_tree.argtypes = [_float_p, ctypes.c_size_t, ctypes.c_float] + [_float_p] * 3 + [ctypes.c_size_t] + [_float_p] * 3
+	lib.emf_current_field.restype = None
+	lib.emf_current_field.argtypes = [_float_p, ctypes.c_size_t] + [_float_p] * 3 + [ctypes.c_size_t] + [_float_p] * 3
+	lib.emf_streamplot.restype = ctypes.c_int
+	lib.emf_streamplot.argtypes = [ctypes.c_char_p] + [ctypes.c_float] * 4 + [ctypes.c_size_t] * 2 + [_float_p] * 3 + [ctypes.c_char_p, _float_p, ctypes.c_size_t, _float_p, ctypes.c_size_t]
+	_lib = lib
+	return True
+
+def available():
+	return _lib is not None or (not _missing and load())
+
+def _float_array(a):
+	return np.ascontiguousarray(a, dtype=np.float32)
+
+def _ptr(a):
+	return a.ctypes.data_as(_float_p)
+
+def charge_field(charges, space, theta=None, precision="single"):
+	"""Computes the electric field of point charges on a sampling grid
+
+	Args:
+		charges: Array of (q, x, y, z) charges
+		space: Sample coordinates with shape (3, ...)
+		theta: Barnes-Hut opening angle, or None for direct summation
+		precision: How the direct sum is accumulated (see mixedprecision.py);
+			the terms are always single precision
+
+	Returns:
+		Field with the same shape as space
+	"""
+	charges = _float_array(charges)
+	points = [_float_array(space[i].ravel()) for i in range(3)]
+	field = [np.zeros_like(points[0]) for _ in range(3)]
+	args = (
+		*[_ptr(p) for p in points], len(points[0]),
+		*[_ptr(f) for f in field]
+	)
+	with _lock:
+		if theta is None:
+			_lib.emf_charge_field(_ptr(charges), len(charges), PRECISIONS.index(precision), *args)
+		else:
+			_lib.emf_charge_field_tree(_ptr(charges), len(charges), theta, *args)
+	return np.array(field, dtype=space.dtype).reshape(space.shape)
+
+def current_field(segments, space):
+	"""Computes the magnetic field of straight current segments on a
+	sampling grid
+
+	Args:
+		segments: Array of (I, x1, y1, z1, x2, y2, z2) segments
+		space: Sample coordinates with shape (3, ...)
+
+	Returns:
+		Field with the same shape as space
+	"""
+	segments = _float_array(segments)
+	points = [_float_array(space[i].ravel()) for i in range(3)]
+	field = [np.zeros_like(points[0]) for _ in range(3)]
+	with _lock:
+		_lib.emf_current_field(_ptr(segments), len(segments),
+			*[_ptr(p) for p in points], len(points[0]),
+			*[_ptr(f) for f in field])
+	return np.array(field, dtype=space.dtype).reshape(space.shape)
+
+def streamplot(filename, u, v, fu, fv, colormap, density=None, charges=(), segments=()):
+	"""Draws a streamline plot of an in-plane field straight to a PNG image
+	with the native tracer and rasterizer
+
+	Args:
+		filename: Output path
+		u: Sample coordinates along the horizontal axis
+		v: Sample coordinates along the vertical axis
+		fu: Horizontal field component with shape (v, u)
+		fv: Vertical field component with shape (v, u)
+		colormap: Name of the matplotlib colormap to color the lines with
+		density: Charge density with shape (v, u) drawn underneath, if any
+		charges: (q, u, v) of the charges to mark
+		segments: (u1, v1, u2, v2) of the current segments to draw
+
+	Returns:
+		Whether the plot was drawn; False if the colormap isn't available
+		natively
+	"""
+	fu, fv = _float_array(fu), _float_array(fv)
+	density = None if density is None else _float_array(density)
+	charges = _float_array(np.reshape(charges, (-1, 3)))
+	segments = _float_array(np.reshape(segments, (-1, 4)))
+	with _lock:
+		status = _lib.emf_streamplot(os.fsencode(filename), u[0], u[-1], v[0], v[-1], len(u), len(v),
+			_ptr(fu), _ptr(fv), None if density is None else _ptr(density),
+			colormap.encode(), _ptr(charges), len(charges), _ptr(segments), len(segments))
+	if status == 0:
+		raise OSError(f"Failed to write {filename}")
+	return status > 0
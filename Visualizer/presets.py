@@ -12,14 +12,18 @@
 # You should have received a copy of the GNU General Public License
 # along with this program. If not, see <http://www.gnu.org/licenses/>.
 
-import numpy.linalg as nl
+import numpy as np
 
 PRESET_DELTA = 0
 PRESET_HEAVISIDE = 1
 PRESET_REVERSE_HEAVISIDE = 2
 
+# Half width of the region where the delta preset is nonzero
+DELTA_TOLERANCE = 0.01
+
+# Elementwise, so the presets can be evaluated on whole sampling grids
 def norm(*xi):
-	return nl.norm([*xi])
+	return np.sqrt(sum(np.square(x) for x in xi))
 
 def get_variable(var):
 	if var == "x":
@@ -33,9 +37,9 @@ def get_variable(var):
 	elif var == "rc":
 		return lambda z, y, x: norm(x, y)
 	elif var == "theta":
-		return lambda z, y, x: np.acos(z / norm(x, y, z))
+		return lambda z, y, x: np.arccos(z / norm(x, y, z))
 	elif var == "phi":
-		return lambda z, y, x: np.acos(x / norm(x, y))
+		return lambda z, y, x: np.arccos(x / norm(x, y))
 
 def offset_var(var, offset):
 	if offset != 0:
@@ -44,7 +48,7 @@ def offset_var(var, offset):
 
 def delta(variable, value, offset):
 	var = offset_var(get_variable(variable), offset)
-	return lambda z, y, x: nl.norm(var(z, y, x) - value) < 0.01
+	return lambda z, y, x: np.abs(var(z, y, x) - value) < DELTA_TOLERANCE
 
 def heaviside(variable, value, offset, reverse):
 	var = offset_var(get_variable(variable), offset)
@@ -65,3 +69,45 @@ def get_preset(density_func):
 	elif func in [PRESET_HEAVISIDE, PRESET_REVERSE_HEAVISIDE]:
 		h = heaviside(var, val, offset, func == PRESET_REVERSE_HEAVISIDE)
 		return lambda z, y, x: scale * h(z, y, x)
+
+def support(density_func):
+	"""Box outside of which a density is zero, from the shape of its preset
+	and the optional "support" box given by the user, matching the editor's
+	densitySupport
+
+	Args:
+		density_func: Charge or current density configuration
+
+	Returns:
+		Lower and upper corners of the box, infinite where unbounded, or None
+		if the density is zero everywhere
+	"""
+	lo = np.full(3, -np.inf)
+	hi = np.full(3, np.inf)
+	if density_func.get("preset", False):
+		if density_func.get("scale", 1) == 0:
+			return None
+		value = density_func["value"]
+		a, b = {
+			PRESET_DELTA: (value - DELTA_TOLERANCE, value + DELTA_TOLERANCE),
+			PRESET_HEAVISIDE: (value, np.inf),
+		}.get(density_func["func"], (-np.inf, value))
+		# The presets compare the variable at X + offset, so they are
+		# centered on -offset
+		offset = density_func.get("offset", 0)
+		offset = np.zeros(3) if np.isscalar(offset) else np.asarray(offset, dtype=float)
+		var = density_func["var"]
+		if var in ["x", "y", "z"]:
+			c = "xyz".index(var)
+			lo[c], hi[c] = a - offset[c], b - offset[c]
+		elif var in ["r", "rc"] and np.isfinite(b):
+			if b <= 0:
+				return None
+			n = 3 if var == "r" else 2
+			lo[:n], hi[:n] = -offset[:n] - b, -offset[:n] + b
+	if "support" in density_func:
+		lo = np.maximum(lo, density_func["support"]["min"])
+		hi = np.minimum(hi, density_func["support"]["max"])
+	if np.any(lo > hi):
+		return None
+	return lo, hi
@@ -0,0 +1,170 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+import contextlib
+import json
+import resource
+import sys
+import threading
+import time
+import tracemalloc
+
+# Per-stage wall time and counters, written in the same layout as the native
+# engine's profiler (Editor/src/profile.h) either as a report or as a Chrome
+# trace. Stages nest per thread and counters are added to the innermost open
+# stage of the calling thread; the "bytes" counter of a stage is the peak
+# growth of the memory traced by tracemalloc while it was open (which
+# includes allocations of other threads). While disabled, stages and counts
+# only cost a check.
+
+class Profiler:
+	def __init__(self):
+		self.enabled = False
+		self.clear()
+
+	def enable(self, enabled=True):
+		"""Starts or stops recording; enabling drops earlier stages"""
+		if enabled and not self.enabled:
+			self.clear()
+			if not tracemalloc.is_tracing():
+				tracemalloc.start()
+		self.enabled = enabled
+
+	def clear(self):
+		self.stages = []
+		self.local = threading.local()
+		self.threads = {}
+		self.origin = time.perf_counter()
+
+	@property
+	def open(self):
+		"""Stages opened on the calling thread that have not ended yet"""
+		if not hasattr(self.local, "open"):
+			self.local.open = []
+		return self.local.open
+
+	def _thread(self):
+		ident = threading.get_ident()
+		if ident not in self.threads:
+			self.threads[ident] = len(self.threads)
+		return self.threads[ident]
+
+	def _track_peak(self):
+		"""Folds the traced peak since the last call into every open stage"""
+		if not tracemalloc.is_tracing() or not hasattr(tracemalloc, "reset_peak"):
+			return None
+		current, peak = tracemalloc.get_traced_memory()
+		for entry in self.open:
+			entry["peak"] = max(entry["peak"], peak)
+		tracemalloc.reset_peak()
+		return current
+
+	@contextlib.contextmanager
+	def stage(self, name):
+		"""Records the wall time and counters of the enclosed block"""
+		if not self.enabled:
+			yield
+			return
+		record = {"name": name, "thread": self._thread(), "depth": len(self.open),
+			"start": time.perf_counter() - self.origin, "seconds": 0, "counters": {}}
+		self.stages.append(record)
+		current = self._track_peak()
+		entry = {"counters": record["counters"], "base": current, "peak": current}
+		self.open.append(entry)
+		try:
+			yield
+		finally:
+			record["seconds"] = time.perf_counter() - self.origin - record["start"]
+			self._track_peak()
+			self.open.pop()
+			if entry["base"] is not None:
+				self.count("bytes", entry["peak"] - entry["base"], record["counters"])
+
+	def count(self, counter, amount=1, counters=None):
+		"""Adds to a counter of the innermost open stage"""
+		if not self.enabled:
+			return
+		if counters is None:
+			if not self.open:
+				return
+			counters = self.open[-1]["counters"]
+		counters[counter] = counters.get(counter, 0) + amount
+
+	@contextlib.contextmanager
+	def collect(self):
+		"""Gathers the counts made in the enclosed block, e.g. in a worker
+		process, into a dictionary instead of the open stage so they can be
+		passed to merge"""
+		counters = {}
+		if not self.enabled:
+			yield counters
+			return
+		self.open.append({"counters": counters, "base": None, "peak": 0})
+		try:
+			yield counters
+		finally:
+			self.open.pop()
+
+	def merge(self, counters):
+		"""Adds counts gathered by collect to the innermost open stage"""
+		for counter, amount in counters.items():
+			self.count(counter, amount)
+
+	def report(self, tool):
+		"""Every stage in the order they were opened plus inclusive totals
+		per stage name"""
+		peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+		totals = {}
+		for stage in self.stages:
+			total = totals.setdefault(stage["name"], {"calls": 0, "seconds": 0, "counters": {}})
+			total["calls"] += 1
+			total["seconds"] += stage["seconds"]
+			for counter, amount in stage["counters"].items():
+				total["counters"][counter] = total["counters"].get(counter, 0) + amount
+		return {
+			"version": 1,
+			"tool": tool,
+			"peak_rss_bytes": peak if sys.platform == "darwin" else peak * 1024,
+			"stages": self.stages,
+			"totals": dict(sorted(totals.items()))
+		}
+
+	def trace(self, tool):
+		"""Stages in the Chrome trace event format, for chrome://tracing or
+		Perfetto"""
+		events = [{"name": "process_name", "ph": "M", "pid": 1, "tid": 0, "args": {"name": tool}}]
+		for stage in self.stages:
+			events.append({"name": stage["name"], "cat": "emfield", "ph": "X", "pid": 1,
+				"tid": stage["thread"], "ts": stage["start"] * 1e6, "dur": stage["seconds"] * 1e6,
+				"args": stage["counters"]})
+		return {"displayTimeUnit": "ms", "traceEvents": events}
+
+	def write_report(self, filename, tool):
+		with open(filename, "w") as file:
+			json.dump(self.report(tool), file, indent=4)
+
+	def write_trace(self, filename, tool):
+		with open(filename, "w") as file:
+			json.dump(self.trace(tool), file)
+
+# Shared by the modules of the visualizer
+default = Profiler()
+enable = default.enable
+stage = default.stage
+count = default.count
+collect = default.collect
+merge = default.merge
+write_report = default.write_report
+write_trace = default.write_trace
@@ -0,0 +1,62 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+import numpy as np
+
+# Number of refinement levels; the first samples every eighth row and column
+LEVELS = 4
+
+def on_lattice(n, stride):
+	"""Mask of the samples along an axis of length n on the lattice of the
+	given stride, which always includes the last sample"""
+	mask = np.arange(n) % stride == 0
+	mask[-1] = True
+	return mask
+
+class ProgressivePlane:
+	"""Coarse-to-fine sampling of the plane of interest, matching the
+	editor's ProgressivePlane. Level k covers every 2 ** (levels - 1 - k)-th
+	row and column of the plot grid (plus the last ones), so each level's
+	lattice contains the previous one and only the points new to a level are
+	evaluated: over all levels every point is evaluated exactly once.
+
+	Args:
+		nu: Number of samples along the first in-plane axis
+		nv: Number of samples along the second in-plane axis
+		levels: Number of refinement levels
+	"""
+	def __init__(self, nu, nv, levels=LEVELS):
+		self.nu, self.nv = nu, nv
+		self.strides = [2 ** (levels - 1 - k) for k in range(max(levels, 1))]
+
+	def levels(self):
+		return len(self.strides)
+
+	def stride(self, level):
+		return self.strides[level]
+
+	def points(self, level):
+		"""Indices (iu, iv) of the points new to the level, row by row"""
+		s = self.strides[level]
+		mask = on_lattice(self.nv, s)[:, None] & on_lattice(self.nu, s)[None, :]
+		if level > 0:
+			mask &= ~(on_lattice(self.nv, 2 * s)[:, None] & on_lattice(self.nu, 2 * s)[None, :])
+		iv, iu = np.nonzero(mask)
+		return iu, iv
+
+	def lattice(self, level):
+		"""Evenly spaced rows and columns of the level (the multiples of its
+		stride), for plotting a level on its own"""
+		s = self.strides[level]
+		return np.arange(0, self.nu, s), np.arange(0, self.nv, s)
@@ -0,0 +1,74 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+import os
+import tempfile
+import confighash
+import fieldfile
+
+def default_directory():
+	base = os.environ.get("XDG_CACHE_HOME", os.path.join(os.path.expanduser("~"), ".cache"))
+	return os.path.join(base, "em-field-visualizer")
+
+class ResultCache:
+	"""Computed fields stored on disk as field data files named after the
+	hash of the physics-relevant configuration parameters, so that runs
+	which only change cosmetic options (colormap, show, output files) reuse
+	the earlier result instead of computing it again.
+	"""
+	def __init__(self, directory=None):
+		self.directory = directory or default_directory()
+
+	def paths(self, key):
+		return [os.path.join(self.directory, f"{key}-{kind}.emf") for kind in ["E", "B"]]
+
+	def key(self, config):
+		return confighash.config_hash(config)
+
+	def load(self, key, shape):
+		"""Looks up the fields for a cache key
+
+		Args:
+			key: Configuration hash
+			shape: Shape of the sampling grid the fields must have
+
+		Returns:
+			Memory-mapped electric and magnetic fields, or None on a miss
+		"""
+		fields = []
+		for path in self.paths(key):
+			try:
+				field = fieldfile.read_field(path).field()
+			except (OSError, ValueError):
+				return None
+			if field.shape != shape:
+				return None
+			fields.append(field)
+		return fields
+
+	def store(self, key, axes, ax3, e_field, b_field):
+		"""Saves the fields for a cache key. Files are written under a
+		temporary name and renamed so that concurrent runs never see a
+		partial entry."""
+		os.makedirs(self.directory, exist_ok=True)
+		for path, field, kind in zip(self.paths(key), [e_field, b_field], ["E", "B"]):
+			fd, tmp = tempfile.mkstemp(dir=self.directory, suffix=".tmp")
+			os.close(fd)
+			try:
+				fieldfile.write_field(tmp, field, axes, ax3, kind)
+				os.replace(tmp, path)
+			except OSError:
+				os.remove(tmp)
+				raise
@@ -0,0 +1,278 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+import contextlib
+import io
+import itertools
+import json
+import multiprocessing as mp
+import os
+import queue
+import socket
+import socketserver
+import tempfile
+import threading
+import time
+import traceback
+
+# Long-running job service that keeps the visualizer's imports warm. Clients
+# (such as the editor's "Save and submit" button, see Editor/src/service.h)
+# connect to a Unix socket and send one JSON request per line, each answered
+# by one JSON line:
+#
+#   {"command": "submit", "config": path, "wait": false}
+#       Queues the configuration file ("eout" and "bout" may name the output
+#       files). Answers {"status": "queued", "job": id} right away, or with
+#       "wait" the finished job as for "status". A full queue answers
+#       {"status": "busy"}.
+#   {"command": "status", "job": id}
+#       {"status": "queued" | "running" | "done" | "failed", "job": id,
+#       "seconds": wall time, "log": printed output, "error": message}
+#   {"command": "shutdown"}
+#       Stops accepting jobs and exits once the running jobs are done.
+#
+# Each job runs in a process forked from the service, so it starts with every
+# module already imported and can't leave state behind for the next job.
+
+# Jobs waiting to run beyond which submissions are turned away
+QUEUE_SIZE = 16
+# Finished jobs whose status is kept for clients to look up
+HISTORY = 256
+
+def default_path():
+	"""Socket path shared with the editor: $EMFIELD_SERVICE if set, otherwise
+	em-field-visualizer.sock in $XDG_RUNTIME_DIR or the temporary directory"""
+	if os.environ.get("EMFIELD_SERVICE"):
+		return os.environ["EMFIELD_SERVICE"]
+	runtime = os.environ.get("XDG_RUNTIME_DIR")
+	if runtime:
+		return os.path.join(runtime, "em-field-visualizer.sock")
+	return os.path.join(tempfile.gettempdir(), f"em-field-visualizer-{os.getuid()}.sock")
+
+def _run_job(run, request, conn):
+	"""Runs a job in the forked process and sends back its output"""
+	log = io.StringIO()
+	result = {"status": "done"}
+	try:
+		with contextlib.redirect_stdout(log):
+			if run(request) is False:
+				result = {"status": "failed", "error": "The configuration could not be read"}
+	except Exception as e:
+		traceback.print_exc(file=log)
+		result = {"status": "failed", "error": str(e)}
+	result["log"] = log.getvalue()
+	conn.send(result)
+	conn.close()
+
+class JobService:
+	"""Bounded queue of jobs run by a fixed number of workers
+
+	Args:
+		run: Function rendering a submit request in the forked process;
+			returning False marks the job as failed
+		workers: Number of jobs run at the same time
+		queue_size: Number of jobs that may wait to run
+	"""
+	def __init__(self, run, workers=1, queue_size=QUEUE_SIZE):
+		self.run = run
+		self.pending = queue.Queue(max(queue_size, 1))
+		self.jobs = {}
+		self.finished = []
+		self.ids = itertools.count(1)
+		self.lock = threading.Lock()
+		self.changed = threading.Condition(self.lock)
+		self.stopping = False
+		self.context = mp.get_context("fork")
+		self.workers = [threading.Thread(target=self._work, daemon=True) for _ in range(max(workers, 1))]
+		for worker in self.workers:
+			worker.start()
+
+	def submit(self, request):
+		"""Queues a job; returns its status record, or None if the queue is full"""
+		with self.lock:
+			if self.stopping:
+				return None
+			job = {"job": next(self.ids), "status": "queued", "request": request}
+			try:
+				self.pending.put_nowait(job)
+			except queue.Full:
+				return None
+			self.jobs[job["job"]] = job
+			return self.record(job)
+
+	def record(self, job):
+		return {key: value for key, value in job.items() if key != "request"}
+
+	def status(self, job_id):
+		with self.lock:
+			job = self.jobs.get(job_id)
+			return None if job is None else self.record(job)
+
+	def wait(self, job_id):
+		"""Blocks until the job has finished and returns its status record"""
+		with self.lock:
+			job = self.jobs[job_id]
+			while job["status"] in ["queued", "running"]:
+				self.changed.wait()
+			return self.record(job)
+
+	def stop(self):
+		"""Turns away new jobs and waits for the queued ones to finish"""
+		with self.lock:
+			self.stopping = True
+		for _ in self.workers:
+			self.pending.put(None)
+		for worker in self.workers:
+			worker.join()
+
+	def _update(self, job, **values):
+		with self.lock:
+			job.update(values)
+			if job["status"] in ["done", "failed"]:
+				self.finished.append(job["job"])
+				while len(self.finished) > HISTORY:
+					self.jobs.pop(self.finished.pop(0), None)
+			self.changed.notify_all()
+
+	def _work(self):
+		while True:
+			job = self.pending.get()
+			if job is None:
+				return
+			self._update(job, status="running")
+			start = time.perf_counter()
+			receiver, sender = self.context.Pipe(False)
+			process = self.context.Process(target=_run_job, args=(self.run, job["request"], sender))
+			process.start()
+			sender.close()
+			try:
+				result = receiver.recv()
+			except EOFError:
+				result = {"status": "failed", "error": "The job process exited unexpectedly"}
+			receiver.close()
+			process.join()
+			self._update(job, seconds=time.perf_counter() - start, **result)
+
+class _Handler(socketserver.StreamRequestHandler):
+	def handle(self):
+		for line in self.rfile:
+			try:
+				request = json.loads(line)
+				reply = self.server.dispatch(request)
+			except (ValueError, KeyError, TypeError) as e:
+				reply = {"status": "error", "error": f"Invalid request: {e}"}
+			self.wfile.write((json.dumps(reply) + "\n").encode())
+			self.wfile.flush()
+			# Only stop once the client has its answer
+			if reply["status"] == "stopping":
+				threading.Thread(target=self.server.shutdown, daemon=True).start()
+
+class _Server(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+	daemon_threads = True
+
+	def dispatch(self, request):
+		command = request.get("command", "submit")
+		if command == "submit":
+			if not isinstance(request.get("config"), str):
+				return {"status": "error", "error": "Missing configuration file"}
+			record = self.service.submit(request)
+			if record is None:
+				return {"status": "busy", "error": "The job queue is full"}
+			if request.get("wait", False):
+				return self.service.wait(record["job"])
+			return record
+		if command == "status":
+			record = self.service.status(request["job"])
+			if record is None:
+				return {"status": "error", "error": f"Unknown job {request['job']}"}
+			return record
+		if command == "shutdown":
+			return {"status": "stopping"}
+		return {"status": "error", "error": f"Unknown command {command}"}
+
+def serve(run, path=None, workers=1, queue_size=QUEUE_SIZE):
+	"""Accepts jobs on a Unix socket until a client asks the service to shut
+	down; see the top of this file for the protocol
+
+	Args:
+		run: Function rendering a submit request (in a forked process)
+		path: Socket path; defaults to default_path()
+		workers: Number of jobs run at the same time
+		queue_size: Number of jobs that may wait to run
+	"""
+	if "fork" not in mp.get_all_start_methods():
+		raise Exception("The job service needs the fork start method")
+	path = path or default_path()
+	if os.path.exists(path):
+		# Take over the socket of a service that is no longer running
+		probe = socket.socket(socket.AF_UNIX)
+		try:
+			probe.connect(path)
+		except OSError:
+			os.remove(path)
+		else:
+			raise Exception(f"A job service is already running at {path}")
+		finally:
+			probe.close()
+	service = JobService(run, workers, queue_size)
+	with _Server(path, _Handler) as server:
+		server.service = service
+		print(f"Job service listening on {path} ({len(service.workers)} workers, queue of {service.pending.maxsize})")
+		try:
+			server.serve_forever()
+		except KeyboardInterrupt:
+			pass
+		finally:
+			service.stop()
+			os.remove(path)
+
+def request(message, path=None):
+	"""Sends one request to a running service and returns its reply"""
+	with socket.socket(socket.AF_UNIX) as client:
+		client.connect(path or default_path())
+		client.sendall((json.dumps(message) + "\n").encode())
+		with client.makefile("r") as reply:
+			return json.loads(reply.readline())
+
+if __name__ == '__main__':
+	# Lightweight client: only the standard library is imported, so
+	# submitting a job costs no more than the socket round trip
+	import argparse
+	import sys
+	parser = argparse.ArgumentParser("EM Field Visualizer job service client")
+	parser.add_argument("configs", nargs="*", help="Configuration files to submit")
+	parser.add_argument("--socket", nargs=1, type=str, default=[None], help=f"Service socket; default {default_path()}", dest="socket")
+	parser.add_argument("--wait", action="store_true", help="Wait for each job and print its output", dest="wait")
+	parser.add_argument("--status", nargs=1, type=int, default=[None], help="Print the status of a job", dest="status")
+	parser.add_argument("--shutdown", action="store_true", help="Stop the service once its jobs are done", dest="shutdown")
+	args = parser.parse_args()
+
+	path = args.socket[0]
+	messages = [{"command": "submit", "config": os.path.abspath(config), "wait": args.wait} for config in args.configs]
+	if args.status[0] is not None:
+		messages.append({"command": "status", "job": args.status[0]})
+	if args.shutdown:
+		messages.append({"command": "shutdown"})
+	failed = False
+	for message in messages:
+		try:
+			reply = request(message, path)
+		except OSError as e:
+			print(f"Failed to reach the job service at {path or default_path()}: {e}")
+			sys.exit(1)
+		if "log" in reply:
+			print(reply.pop("log"), end="")
+		print(json.dumps(reply))
+		failed = failed or reply["status"] in ["busy", "failed", "error"]
+	sys.exit(1 if failed else 0)
@@ -0,0 +1,69 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+import copy
+import os
+import numpy as np
+
+# Parameter sweeps render one frame per value of a single configuration
+# parameter, given by its path in the configuration ("plane/coordinate",
+# "charges/0/1", "charge-densities/0/value") like a JSON pointer without the
+# leading slash.
+
+# Top-level keys whose changes require the field sources to be rebuilt;
+# changes to anything else (charges, the plane) leave them untouched
+SOURCE_KEYS = ["charge-densities", "current-densities", "currents", "current-loops"]
+
+def sweep_values(sweep):
+	"""Values of the swept parameter, either listed in "values" or spaced
+	evenly from "from" to "to" over "frames" frames (default 10)"""
+	if "values" in sweep:
+		return [float(value) for value in sweep["values"]]
+	return [float(value) for value in np.linspace(sweep["from"], sweep["to"], sweep.get("frames", 10))]
+
+def changes_sources(path):
+	return path.split("/")[0] in SOURCE_KEYS
+
+def set_parameter(config, path, value):
+	"""Sets the parameter at the given path, indexing lists and arrays by
+	number and dictionaries by key"""
+	keys = path.split("/")
+	target = config
+	for key in keys[:-1]:
+		target = target[key] if isinstance(target, dict) else target[int(key)]
+	key = keys[-1]
+	if isinstance(target, dict):
+		target[key] = value
+	else:
+		target[int(key)] = value
+
+def frame_config(config, path, value):
+	"""Copy of the configuration with the parameter set to the given value"""
+	frame = copy.deepcopy(config)
+	del frame["sweep"]
+	set_parameter(frame, path, value)
+	return frame
+
+def frame_filename(filename, k):
+	"""Output file name of frame k, numbered before the extension"""
+	base, extension = os.path.splitext(filename)
+	return f"{base} {k:04d}{extension}"
+
+def union_bounds(bounds):
+	"""Smallest plot bounds containing all of the given bounds"""
+	return {
+		"min": np.min([b["min"] for b in bounds], axis=0),
+		"max": np.max([b["max"] for b in bounds], axis=0)
+	}
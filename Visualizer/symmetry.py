@@ -0,0 +1,219 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+# Mirror and half turn symmetries of the charges about the center of the plot
+# box, matching the editor's symmetry.h. If every charge q at p has an image
+# s q at M p, E(M p) = s M E(p): the electric field is then only computed on
+# a fundamental domain of the plane of interest and the rest of the grid is
+# filled in by mirroring. Parities s are 1 for images of the same sign, -1
+# for images of the opposite sign and 0 without symmetry. The magnetic field
+# is always computed on the whole grid.
+
+import numpy as np
+from collections import Counter
+
+import presets
+
+# Relative tolerance of the positions and charges compared by the detection
+TOLERANCE = 1e-5
+
+def none():
+	return {"mirror": [0, 0, 0], "rotation": 0}
+
+def in_plane(ax3):
+	"""In-plane axes of the plane normal to ax3, in the editor's order"""
+	return (1 if ax3 == 0 else 0), (1 if ax3 == 2 else 2)
+
+def restrict(symmetry, ax3):
+	"""Keeps the symmetries that map the plane of interest onto itself and
+	adds the ones implied by the others: mirroring across both in-plane axes
+	is a half turn, and a half turn with one mirror gives the other"""
+	a1, a2 = in_plane(ax3)
+	mirror = list(symmetry["mirror"])
+	rotation = symmetry["rotation"]
+	mirror[ax3] = 0
+	if mirror[a1] and mirror[a2]:
+		rotation = mirror[a1] * mirror[a2]
+	elif rotation and mirror[a1]:
+		mirror[a2] = rotation * mirror[a1]
+	elif rotation and mirror[a2]:
+		mirror[a1] = rotation * mirror[a2]
+	return {"mirror": mirror, "rotation": rotation}
+
+def describe(symmetry):
+	parity = lambda s: " (even)" if s > 0 else " (odd)"
+	text = [f"mirror {'xyz'[a]}{parity(s)}" for a, s in enumerate(symmetry["mirror"]) if s]
+	if not text and symmetry["rotation"]:
+		text = ["half turn" + parity(symmetry["rotation"])]
+	return ", ".join(text) or "none"
+
+def any_symmetry(symmetry):
+	return any(symmetry["mirror"]) or symmetry["rotation"] != 0
+
+def same_charges(charges, center, flip, parity, ptol):
+	if len(charges) == 0:
+		return True
+	scale = np.array([max(np.max(np.abs(charges[:, 0])), 1e-30) * TOLERANCE] + [ptol] * 3)
+	image = charges.copy()
+	image[:, 0] *= parity
+	image[:, 1:][:, flip] = 2 * center[flip] - charges[:, 1:][:, flip]
+	key = lambda c: Counter(map(tuple, np.rint(c / scale).astype(np.int64)))
+	return key(charges) == key(image)
+
+# Coordinates the center of each preset variable depends on
+PRESET_AXES = {"r": [0, 1, 2], "rc": [0, 1], "x": [0], "y": [1], "z": [2]}
+
+def preset_key(density_func, center, flip, parity, ptol):
+	"""Parameters of the image of a preset density, as compared by the
+	editor's symmetry detection"""
+	quantize = lambda value, tolerance: int(np.rint(value / tolerance))
+	var = density_func["var"]
+	preset = density_func["func"]
+	scale = parity * density_func.get("scale", 1)
+	offset = density_func.get("offset", 0)
+	offset = np.zeros(3) if np.isscalar(offset) else np.asarray(offset, dtype=float)
+	key = [quantize(scale, TOLERANCE * max(1, abs(scale)))]
+	if var in ["x", "y", "z"]:
+		# Comparisons of a coordinate are planes (or the sides of a plane) at
+		# value - offset, which are mirrored as a whole
+		a = "xyz".index(var)
+		plane = density_func["value"] - offset[a]
+		if flip[a]:
+			plane = 2 * center[a] - plane
+			preset = {presets.PRESET_HEAVISIDE: presets.PRESET_REVERSE_HEAVISIDE,
+				presets.PRESET_REVERSE_HEAVISIDE: presets.PRESET_HEAVISIDE}.get(preset, preset)
+		key += [preset, a, quantize(plane, ptol)]
+	else:
+		# Balls, shells and cylinders are centered on -offset
+		c = np.where(flip, 2 * center + offset, -offset)
+		key += [preset, var, quantize(density_func["value"], ptol)]
+		key += [quantize(c[a], ptol) if a in PRESET_AXES[var] else 0 for a in range(3)]
+	if "support" in density_func:
+		lo = np.where(flip, 2 * center - np.asarray(density_func["support"]["max"]), density_func["support"]["min"])
+		hi = np.where(flip, 2 * center - np.asarray(density_func["support"]["min"]), density_func["support"]["max"])
+		key += [quantize(v, ptol) for v in np.concatenate([lo, hi])]
+	return tuple(key)
+
+def same_presets(densities, center, flip, parity, ptol):
+	no_flip = np.zeros(3, dtype=bool)
+	original = Counter(preset_key(d, center, no_flip, 1, ptol) for d in densities)
+	return original == Counter(preset_key(d, center, flip, parity, ptol) for d in densities)
+
+def detect(config, sources):
+	"""Symmetries of the charges and preset charge densities of a
+	configuration about the center of the plot box, for the plane of
+	interest. Densities are compared by their parameters like in the editor,
+	so configurations with densities given by arbitrary functions (or
+	presets of the angular variables) have no detected symmetry; one can
+	still be declared in the configuration.
+
+	Args:
+		config: Environment configuration
+		sources: FieldSources of the configuration
+
+	Returns:
+		Parity of the mirror across each axis and of the half turn
+	"""
+	ax3 = config["plane"]["axis"]
+	symmetry = none()
+	charges = np.array(config.get("charges", []), dtype=float).reshape(-1, 4)
+	densities = [density_func for density_func, box in zip(sources.charge_densities, sources.charge_supports)
+		if box is not None]
+	if len(charges) == 0 and len(densities) == 0:
+		return symmetry
+	if any(not d["preset"] or d["var"] not in PRESET_AXES for d in densities):
+		return symmetry
+	lo = np.asarray(config["plot-bounds"]["min"], dtype=float) - config["plot-margins"]
+	hi = np.asarray(config["plot-bounds"]["max"], dtype=float) + config["plot-margins"]
+	center = (lo + hi) / 2
+	extent = max(1, np.max(np.abs(charges[:, 1:] - center))) if len(charges) > 0 else 1
+	ptol = TOLERANCE * extent
+	a1, a2 = in_plane(ax3)
+	flips = [np.arange(3) == a1, np.arange(3) == a2, (np.arange(3) == a1) | (np.arange(3) == a2)]
+	found = []
+	for flip in flips:
+		found.append(0)
+		for parity in [1, -1]:
+			if same_charges(charges, center, flip, parity, ptol) and same_presets(densities, center, flip, parity, ptol):
+				found[-1] = parity
+				break
+	symmetry["mirror"][a1], symmetry["mirror"][a2], symmetry["rotation"] = found
+	return restrict(symmetry, ax3)
+
+def from_config(config, sources):
+	"""Symmetry to use for a configuration: detected unless "symmetry" is
+	"none" or declares the parities ("x", "y", "z" and "rotation")"""
+	declared = config.get("symmetry", "auto")
+	if declared == "none":
+		return none()
+	if isinstance(declared, dict):
+		symmetry = {
+			"mirror": [int(np.sign(declared.get(axis, 0))) for axis in "xyz"],
+			"rotation": int(np.sign(declared.get("rotation", 0)))
+		}
+		return restrict(symmetry, config["plane"]["axis"])
+	return detect(config, sources)
+
+# Array dimension of the sample grid along each world axis (the meshgrid
+# uses 'xy' indexing)
+GRID_DIM = {0: 1, 1: 0, 2: 2}
+
+def reduced_axes(axes, symmetry, ax3):
+	"""Sample coordinates of the fundamental domain: the first half (rounded
+	up) of each mirrored axis, or of the second in-plane axis for a half turn
+	alone"""
+	a1, a2 = in_plane(ax3)
+	mirror = symmetry["mirror"]
+	axes = list(axes)
+	for a in [a1, a2]:
+		if mirror[a] or (a == a2 and not mirror[a1] and symmetry["rotation"]):
+			axes[a] = axes[a][:(len(axes[a]) + 1) // 2]
+	return axes
+
+def extend(values, full, flip, signs):
+	"""Appends the image of the samples along the array dimension of the
+	first axis in flip, flipped along every axis in flip and multiplied by
+	signs, up to full samples"""
+	dim = GRID_DIM[flip[0]]
+	offset = values.ndim - 3
+	image = np.flip(values, axis=tuple(GRID_DIM[a] + offset for a in flip))
+	index = [slice(None)] * values.ndim
+	index[dim + offset] = slice(2 * values.shape[dim + offset] - full, None)
+	return np.concatenate([values, image[tuple(index)] * signs], axis=dim + offset)
+
+def unfold(values, axes, symmetry, ax3, vector=True):
+	"""Field (or with vector False a scalar density) on the whole grid, given
+	its values on the grid of reduced_axes
+
+	Args:
+		values: Components of the field (or density) at each reduced sample
+		axes: Sample coordinates of the whole grid
+		symmetry: Symmetry the reduced grid was built with
+		ax3: Normal axis of the plane
+
+	Returns:
+		Values at each sample point of the whole grid
+	"""
+	a1, a2 = in_plane(ax3)
+	mirror = symmetry["mirror"]
+	def signs(s, flipped):
+		if not vector:
+			return s
+		return np.array([-s if a in flipped else s for a in range(3)]).reshape(3, 1, 1, 1)
+	for a in [a1, a2]:
+		if mirror[a]:
+			values = extend(values, len(axes[a]), [a], signs(mirror[a], [a]))
+	if not mirror[a1] and not mirror[a2] and symmetry["rotation"]:
+		values = extend(values, len(axes[a2]), [a2, a1], signs(symmetry["rotation"], [a1, a2]))
+	return values
@@ -0,0 +1,70 @@
+# Copyright (C) 2021 Arc676/Alessandro Vinciguerra <alesvinciguerra@gmail.com>
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation (version 3).
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+import multiprocessing as mp
+import os
+import numpy as np
+
+import profiler
+
+# Same number of samples per tile as the native engine (FIELD_TILE squared)
+TILE_POINTS = 32 * 32
+
+# Work shared with forked workers; closures such as the integrands in
+# visualize_fields can't be pickled, but they survive a fork
+_tile_job = None
+
+def _run_tile(tile):
+	start, end = tile
+	func, args = _tile_job
+	with profiler.collect() as counts:
+		values = func(*[a[start:end] for a in args])
+	return start, values, counts
+
+def evaluate_tiled(func, *args, workers=None, tile_points=TILE_POINTS):
+	"""Evaluates a vectorized function over sampling grid arrays in tiles
+	spread over worker processes. Idle workers take the next tile from a
+	shared queue, so tiles near dense charge regions (whose integrals are
+	much more expensive) don't hold up the others.
+
+	Args:
+		func: Function taking and returning arrays of samples
+		args: Grid arrays of identical shape
+		workers: Number of worker processes; defaults to one per core
+		tile_points: Number of samples per tile
+
+	Returns:
+		Array of func values with the shape of the grid
+	"""
+	global _tile_job
+	shape = args[0].shape
+	flat = [np.ravel(a) for a in args]
+	n = flat[0].size
+	out = np.empty(n)
+	tiles = [(start, min(start + tile_points, n)) for start in range(0, n, tile_points)]
+	if workers is None:
+		workers = os.cpu_count() or 1
+	if workers <= 1 or len(tiles) <= 1 or "fork" not in mp.get_all_start_methods():
+		for start, end in tiles:
+			out[start:end] = func(*[a[start:end] for a in flat])
+		return out.reshape(shape)
+	_tile_job = (func, flat)
+	try:
+		with mp.get_context("fork").Pool(workers) as pool:
+			for start, values, counts in pool.imap_unordered(_run_tile, tiles):
+				out[start:start + len(values)] = values
+				profiler.merge(counts)
+	finally:
+		_tile_job = None
+	return out.reshape(shape)
@@ -14,17 +14,40 @@
 # along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 import numpy as np
-from scipy.integrate import tplquad, dblquad, quad
+from scipy.integrate import tplquad
 import matplotlib.pyplot as plt
 import argparse
-import json
+import concurrent.futures
+import os
 
 import evaluation as safe_eval
 import presets
+import adaptive
+import analytic
+import configfile
+import convolution
+import fieldfile
+import incremental
+import magnetic
+import mixedprecision
+import native
+import profiler
+import progressive
+import resultcache
+import service
+import sweep
+import symmetry
+import tiling
 
 # Command line parameters
 output_files = {"e-field": None, "b-field": None}
 eval_safety = 0
+worker_count = None
+save_fields = False
+load_fields = False
+native_plots = False
+precision_check = False
+result_cache = None
 
 def complete_config(config):
 	"""Generates a configuration dictionary with all the necessary parameters for
@@ -54,40 +77,73 @@ def complete_config(config):
 		config["show"] = False
 	# Determine the boundaries of the plot
 	if "plot-bounds" not in config:
-		if "charges" in config:
-			charges = np.array(config["charges"])
-			coords_min = np.min(charges[:,1:], axis=0)
-			coords_max = np.max(charges[:,1:], axis=0)
-		try:
-			config["plot-bounds"] = {"min": coords_min, "max": coords_max}
-		except NameError:
+		profiler.count("inferred-bounds")
+		# Positions of charges, current segment endpoints and loop centers
+		points = [np.array(config.get("charges", []), dtype=float).reshape(-1, 4)[:,1:]]
+		currents = np.array(config.get("currents", []), dtype=float).reshape(-1, 7)
+		points += [currents[:,1:4], currents[:,4:7]]
+		points.append(np.array(config.get("current-loops", []), dtype=float).reshape(-1, 8)[:,1:4])
+		points = np.concatenate(points)
+		if len(points) == 0:
 			raise Exception("Failed to infer plot bounds")
+		config["plot-bounds"] = {"min": np.min(points, axis=0), "max": np.max(points, axis=0)}
 	# Default resolution
 	if "resolution" not in config:
 		config["resolution"] = 100
+	# Point charge summation method
+	if "solver" not in config:
+		config["solver"] = "direct"
+	if "opening-angle" not in config:
+		config["opening-angle"] = 0.5
+	# Charge density integration method
+	if "density-method" not in config:
+		config["density-method"] = "quadrature"
+	if "voxel-resolution" not in config:
+		config["voxel-resolution"] = 10
 	# Streamplot colormap
 	if "colormap" not in config:
 		config["colormap"] = "cool"
 	return config
 
+# Variables available to custom density functions
+density_variables = ["x", "y", "z", "r", "rc", "theta", "phi"]
+
 def construct_function(safety, function):
+	"""Constructs a custom charge density function
+
+	Args:
+		safety: Evaluation safety level
+		function: Python expression for the density
+
+	Returns:
+		Density function of (z, y, x) accepting scalars or arrays
+	"""
 	if safety == 0:
 		raise Exception("Cannot construct function at safety level 0")
 	elif safety == 1:
-		pass
+		expr = safe_eval.compile_expression(function, density_variables,
+			safe_eval.numpy_variables, safe_eval.numpy_functions)
+		def func(z, y, x):
+			values = {var: presets.get_variable(var)(z, y, x) for var in expr.variables}
+			return expr(**values)
+		return func
 	else:
-		def func(x, y, z):
-			r = presets.get_variable("r")(x, y, z)
-			rc = presets.get_variable("rc")(x, y, z)
-			theta = presets.get_variable("theta")(x, y, z)
-			phi = presets.get_variable("phi")(x, y, z)
+		def func(z, y, x):
+			r = presets.get_variable("r")(z, y, x)
+			rc = presets.get_variable("rc")(z, y, x)
+			theta = presets.get_variable("theta")(z, y, x)
+			phi = presets.get_variable("phi")(z, y, x)
 			return eval(function)
+		return func
 
-def visualize_fields(config):
-	"""Plot electric and magnetic fields for given configuration
+def build_grid(config):
+	"""Constructs the sampling grid on the plane of interest
 
 	Args:
 		config: Environment configuration
+
+	Returns:
+		Sample coordinates along each axis and the corresponding meshgrid
 	"""
 	ax3 = config["plane"]["axis"]
 	Z = config["plane"]["coordinate"]
@@ -102,144 +158,659 @@ def visualize_fields(config):
 			axis = np.linspace(x_min, x_max, config["resolution"] * int(x_max - x_min))
 			axes.append(axis)
 	space = np.array(np.meshgrid(*axes))
+	profiler.count("points", space[0].size)
+	return axes, space
+
+def grid_key(config, axes):
+	"""Identifies a sampling grid and the methods used to compute the fields
+	on it for caching field contributions"""
+	methods = tuple(config[key] for key in ["solver", "opening-angle", "density-method", "voxel-resolution"])
+	return tuple((axis[0], axis[-1], len(axis)) for axis in axes) + methods
+
+def efield_charges(charges, space, solver="direct", theta=0.5, precision="double"):
+	"""Computes the electric field of a set of point charges
+
+	Args:
+		charges: Array of (q, x, y, z) charges
+		space: Sampling grid
+		solver: "direct" summation or "barnes-hut" octree approximation
+		theta: Opening angle for the Barnes-Hut approximation
+		precision: How the direct sum is computed (see mixedprecision.py)
+
+	Returns:
+		Electric field at each sample point
+	"""
+	with profiler.stage("charges"):
+		points = space[0].size
+		profiler.count("points", points)
+		if native.available():
+			if solver != "barnes-hut":
+				profiler.count("interactions", points * len(charges))
+			E = native.charge_field(charges, space, theta if solver == "barnes-hut" else None, precision)
+			return E.astype(mixedprecision.dtype(precision), copy=False)
+		if solver == "barnes-hut":
+			print("Barnes-Hut solver requires the native field engine; using direct summation")
+		profiler.count("interactions", points * len(charges))
+		return mixedprecision.charge_field(charges, space, precision)
+
+def bfield_currents(segments, space):
+	"""Computes the magnetic field of a set of straight current segments
+
+	Args:
+		segments: Array of (I, x1, y1, z1, x2, y2, z2) segments
+		space: Sampling grid
+
+	Returns:
+		Magnetic field at each sample point
+	"""
+	with profiler.stage("currents"):
+		profiler.count("points", space[0].size)
+		profiler.count("interactions", space[0].size * len(segments))
+		if native.available():
+			return native.current_field(segments, space)
+		return magnetic.segment_field(segments, space)
+
+def efield_density(density_func, rho, config, axes, space, ax3):
+	"""Computes the electric field of a continuous charge density, in closed
+	form for presets where possible and otherwise by numerical integration
+	over the plot volume
+
+	Args:
+		density_func: Charge density configuration
+		rho: Charge density function
+		config: Environment configuration
+		axes: Sample coordinates along each axis
+		space: Sampling grid
+		ax3: Axis normal to the plane of interest
+
+	Returns:
+		Electric field at each sample point
+	"""
+	if density_func["preset"]:
+		with profiler.stage("preset-density"):
+			E = analytic.efield_preset(density_func, space)
+			if E is not None:
+				profiler.count("points", space[0].size)
+				profiler.count("density-evaluations", space[0].size)
+				return E
+	box = presets.support(density_func)
+	if box is None:
+		return np.zeros_like(space)
+	if config["density-method"] == "voxel":
+		with profiler.stage("voxel-density"):
+			profiler.count("points", space[0].size)
+			return convolution.efield_density(rho, config, axes, ax3, box)
+	with profiler.stage("density-integral"):
+		profiler.count("points", space[0].size)
+		return integrate_density(rho, axes, space, ax3, box)
+
+def integrate_density(rho, axes, space, ax3, box=None):
+	"""Integrates the field of a charge density numerically at every sample
+	point, spreading the grid over worker processes. The integration volume
+	is the box spanned by the sample coordinates, cut down to the density's
+	support box if given."""
+	e_field = np.zeros_like(space)
+	def integrand(z, y, x, Xz, Xy, Xx, axis):
+		profiler.count("integrand-evaluations")
+		X = np.array([Xx, Xy, Xz])
+		Y = np.array([x, y, z])
+		v = X - Y
+		return rho(z, y, x) * v[axis] / (np.linalg.norm(v) ** 3 + 1e-6)
+	def grid_integral(f, *bounds, args=()):
+		return np.vectorize(
+			lambda z, y, x: tplquad(
+				f, *bounds,
+				args=(z, y, x, *args)
+			)[0] if rho(z, y, x) == 0 else 0
+		)
+	ax, ay, az = axes[0][0], axes[1][0], axes[2][0]
+	bx, by, bz = axes[0][-1], axes[1][-1], axes[2][-1]
+	if ax == bx:
+		ax, bx = ay, by
+	elif ay == by:
+		ay, by = ax, bx
+	elif az == bz:
+		az, bz = ax, bx
+	if box is not None:
+		lo, hi = box
+		ax, ay, az = max(ax, lo[0]), max(ay, lo[1]), max(az, lo[2])
+		bx, by, bz = min(bx, hi[0]), min(by, hi[1]), min(bz, hi[2])
+		if ax >= bx or ay >= by or az >= bz:
+			return e_field
+	for axis in range(3):
+		if axis == ax3:
+			continue
+		e_field[axis] += tiling.evaluate_tiled(grid_integral(
+			integrand,
+			ax, bx, ay, by, az, bz,
+			args=(axis,)
+		), space[2], space[1], space[0], workers=worker_count)
+	return e_field
+
+
+def density_function(density_func):
+	if density_func["preset"]:
+		func = presets.get_preset(density_func)
+	else:
+		func = construct_function(eval_safety, density_func["func"])
+	if "support" not in density_func:
+		return func
+	# The density is zero outside the user's box
+	lo = density_func["support"]["min"]
+	hi = density_func["support"]["max"]
+	def bounded(z, y, x):
+		inside = (x >= lo[0]) & (x <= hi[0]) & (y >= lo[1]) & (y <= hi[1]) & (z >= lo[2]) & (z <= hi[2])
+		return np.where(inside, func(z, y, x), 0)
+	return bounded
+
+class FieldSources:
+	"""Density functions of a configuration, constructed once and shared by
+	every grid the fields are computed on"""
+	def __init__(self, config):
+		self.charge_densities = config.get("charge-densities", [])
+		self.charge_funcs = [density_function(density_func) for density_func in self.charge_densities]
+		self.current_densities = config.get("current-densities", [])
+		self.current_funcs = [density_function(density_func) for density_func in self.current_densities]
+		self.charge_supports = [presets.support(density_func) for density_func in self.charge_densities]
+		self.segments = magnetic.current_segments(config)
+		self.rasterized = {}
+
+	def current_density_segments(self, i, config):
+		"""Voxel current elements of a current density, rasterized on first use"""
+		if i not in self.rasterized:
+			direction = self.current_densities[i].get("direction", [0, 0, 1])
+			box = presets.support(self.current_densities[i])
+			if box is None:
+				self.rasterized[i] = np.zeros((0, 7))
+			else:
+				self.rasterized[i] = magnetic.rasterize_current(self.current_funcs[i], direction, config, box)
+		return self.rasterized[i]
+
+def compute_fields(config, sources, axes, space, cache):
+	"""Computes the electric and magnetic fields on a sampling grid
+
+	Args:
+		config: Environment configuration
+		sources: FieldSources of the configuration
+		axes: Sample coordinates along each axis
+		space: Sampling grid
+		cache: Dictionary of FieldCache objects for each field
+
+	Returns:
+		Electric and magnetic fields at each sample point
+	"""
+	ax3 = config["plane"]["axis"]
+	densities = sources.charge_densities
+	e_field = cache["e-field"].update(
+		grid_key(config, axes), space,
+		config.get("charges", []),
+		densities,
+		lambda charges: efield_charges(charges, space, config["solver"], config["opening-angle"], config.get("precision", "double")),
+		lambda i: efield_density(densities[i], sources.charge_funcs[i], config, axes, space, ax3)
+	)
+	# Current densities are always rasterized into voxel current elements
+	current_densities = sources.current_densities
+	b_field = cache["b-field"].update(
+		grid_key(config, axes), space,
+		sources.segments,
+		current_densities,
+		lambda segments: bfield_currents(segments, space),
+		lambda i: bfield_currents(sources.current_density_segments(i, config), space)
+	)
+	return e_field, b_field
+
+def compute_fields_fused(config, sources, axes, space, density_map=False, want_e=True, want_b=True):
+	"""Computes the electric and magnetic fields on a sampling grid in a
+	single sweep over tiles of sample points. Every source that is cheap to
+	evaluate per point (point charges, closed-form densities and current
+	segments) and the charge density map are added to a tile while it is in
+	cache, instead of making a pass over the whole grid for each of them.
+	Densities that need integrating are computed on the grid afterwards, as
+	are the charges and currents when the native engine (which tiles the
+	grid itself) is available. There are no per-source contributions to
+	keep, so this is only used when nothing is reused from earlier grids.
+
+	Args:
+		config: Environment configuration
+		sources: FieldSources of the configuration
+		axes: Sample coordinates along each axis
+		space: Sampling grid
+		density_map: Whether to compute the charge density map as well
+		want_e: Whether to compute the electric field (from the charges and
+			charge densities)
+		want_b: Whether to compute the magnetic field (from the currents)
+
+	Returns:
+		Electric and magnetic fields at each sample point and the charge
+		density map (None unless requested and there are charge densities)
+	"""
+	ax3 = config["plane"]["axis"]
+	charges = np.array(config.get("charges", []), dtype=float).reshape(-1, 4)
+	densities = sources.charge_densities if want_e else []
+	closed = [i for i, density_func in enumerate(densities)
+		if density_func["preset"] and analytic.efield_preset(density_func, np.zeros((3, 1))) is not None]
+	segments = np.concatenate([sources.segments] + [
+		sources.current_density_segments(i, config) for i in range(len(sources.current_densities))
+	]) if want_b else np.zeros((0, 7))
+	if not want_e:
+		charges = np.zeros((0, 4))
+	density_map = density_map and want_e and len(sources.charge_funcs) > 0
+	precision = config.get("precision", "double")
+	if config["solver"] == "barnes-hut" and len(charges) > 0 and not native.available():
+		print("Barnes-Hut solver requires the native field engine; using direct summation")
+
+	n = space[0].size
+	points = space.reshape(3, n)
+	values = np.zeros((7 if density_map else 6, n), dtype=mixedprecision.dtype(precision))
+	tile_charges, tile_segments = charges, segments
+	if native.available():
+		if len(charges) > 0:
+			values[:3] = efield_charges(charges, points, config["solver"], config["opening-angle"], precision)
+		if len(segments) > 0:
+			values[3:6] = bfield_currents(segments, points)
+		tile_charges, tile_segments = np.zeros((0, 4)), np.zeros((0, 7))
+
+	with profiler.stage("fused"):
+		profiler.count("points", n)
+		profiler.count("interactions", n * (len(tile_charges) + len(tile_segments)))
+		profiler.count("density-evaluations", n * len(closed))
+		for start in range(0, n, tiling.TILE_POINTS):
+			end = min(start + tiling.TILE_POINTS, n)
+			p = points[:, start:end]
+			E = values[0:3, start:end]
+			if len(tile_charges) > 0:
+				E += mixedprecision.charge_field(tile_charges, p, precision)
+			for i in closed:
+				E += analytic.efield_preset(densities[i], p)
+			if len(tile_segments) > 0:
+				values[3:6, start:end] += magnetic.segment_field(tile_segments, p)
+			if density_map:
+				values[6, start:end] = density_values(sources, p)
+
+	e_field = values[:3].reshape(space.shape)
+	b_field = values[3:6].reshape(space.shape)
+	for i in range(len(densities)):
+		if i not in closed:
+			e_field += efield_density(densities[i], sources.charge_funcs[i], config, axes, space, ax3)
+	return e_field, b_field, values[6].reshape(space[0].shape) if density_map else None
+
+def point_evaluator(config, sources, axes):
+	"""Evaluates the fields at arbitrary points of the plane of interest, for
+	sampling schemes that don't cover the whole grid at once
+
+	Args:
+		config: Environment configuration
+		sources: FieldSources of the configuration
+		axes: Sample coordinates along each axis
+
+	Returns:
+		Function mapping (u, v) coordinates with shape (2, N) to the electric
+		and magnetic fields at those points, and the indices of the charge
+		densities it includes; the others are integrated on the voxel
+		lattice and only available on the whole grid
+	"""
+	ax3 = config["plane"]["axis"]
+	ax1, ax2 = fieldfile.plane_axes(ax3)
+	Z = config["plane"]["coordinate"]
+	charges = np.array(config.get("charges", []), dtype=float).reshape(-1, 4)
+	densities = sources.charge_densities
+	voxel = config["density-method"] == "voxel"
+	pointwise = [i for i, density_func in enumerate(densities)
+		if not voxel or (density_func["preset"] and analytic.efield_preset(density_func, np.zeros((3, 1))) is not None)]
+	segments = np.concatenate([sources.segments] + [
+		sources.current_density_segments(i, config) for i in range(len(sources.current_densities))
+	])
+	plot_e, plot_b = config["e-field"]["plot"], config["b-field"]["plot"]
+
+	def evaluate(uv):
+		points = np.empty((3, uv.shape[1]))
+		points[ax1], points[ax2], points[ax3] = uv[0], uv[1], Z
+		E = np.zeros_like(points)
+		B = np.zeros_like(points)
+		if plot_e:
+			if len(charges) > 0:
+				E += efield_charges(charges, points, config["solver"], config["opening-angle"], config.get("precision", "double"))
+			for i in pointwise:
+				E += efield_density(densities[i], sources.charge_funcs[i], config, axes, points, ax3)
+		if plot_b and len(segments) > 0:
+			B += bfield_currents(segments, points)
+		return E, B
+
+	return evaluate, pointwise
+
+def add_voxel_densities(config, sources, axes, space, e_field, pointwise):
+	"""Adds the field of the charge densities left out by point_evaluator"""
+	if config["e-field"]["plot"]:
+		densities = sources.charge_densities
+		for i in range(len(densities)):
+			if i not in pointwise:
+				e_field = e_field + efield_density(densities[i], sources.charge_funcs[i], config, axes, space, config["plane"]["axis"])
+	return e_field
+
+def compute_fields_adaptive(config, sources, axes, space):
+	"""Computes the electric and magnetic fields on a sampling grid by
+	refining a quadtree near the sources and interpolating the grid from it.
+	Densities integrated on the voxel lattice are computed on the grid itself.
+
+	Args:
+		config: Environment configuration with the "error-budget" and
+			"max-depth" of the refinement
+		sources: FieldSources of the configuration
+		axes: Sample coordinates along each axis
+		space: Sampling grid
+
+	Returns:
+		Electric and magnetic fields at each sample point
+	"""
+	ax3 = config["plane"]["axis"]
+	ax1, ax2 = fieldfile.plane_axes(ax3)
+	Z = config["plane"]["coordinate"]
+	evaluate, pointwise = point_evaluator(config, sources, axes)
+	plane = adaptive.AdaptivePlane(axes[ax1], axes[ax2], config.get("error-budget", 0.01), config.get("max-depth", 8))
+	with profiler.stage("adaptive"):
+		plane.build(evaluate)
+		profiler.count("evaluations", plane.evaluations())
+		profiler.count("leaves", plane.leaf_count())
+	with profiler.stage("adaptive-resample"):
+		profiler.count("points", space[0].size)
+		e_plane, b_plane = plane.resample()
+	print(f"Adaptive sampling at {'xyz'[ax3]} = {Z:g}: {plane.evaluations()} evaluations in {plane.leaf_count()} cells (uniform grid has {space[0].size} points)")
+	e_field = fieldfile.from_plane(e_plane, ax3)
+	b_field = fieldfile.from_plane(b_plane, ax3)
+	return add_voxel_densities(config, sources, axes, space, e_field, pointwise), b_field
+
+def compute_fields_progressive(config, sources, axes, space, on_level=None):
+	"""Computes the electric and magnetic fields on a sampling grid coarse to
+	fine, evaluating only the points new to each level. Densities integrated
+	on the voxel lattice are added once the last level is done.
+
+	Args:
+		config: Environment configuration
+		sources: FieldSources of the configuration
+		axes: Sample coordinates along each axis
+		space: Sampling grid
+		on_level: Called after every level but the last with the sample
+			coordinates of the level's evenly spaced lattice and the
+			electric and magnetic fields on it, shaped like a sampling grid
+
+	Returns:
+		Electric and magnetic fields at each sample point
+	"""
+	ax3 = config["plane"]["axis"]
+	ax1, ax2 = fieldfile.plane_axes(ax3)
+	Z = config["plane"]["coordinate"]
+	evaluate, pointwise = point_evaluator(config, sources, axes)
+	u, v = np.asarray(axes[ax1]), np.asarray(axes[ax2])
+	plane = progressive.ProgressivePlane(len(u), len(v))
+	values = np.zeros((6, len(v), len(u)))
+	for level in range(plane.levels()):
+		with profiler.stage("progressive"):
+			iu, iv = plane.points(level)
+			profiler.count("evaluations", len(iu))
+			E, B = evaluate(np.array([u[iu], v[iv]]))
+			values[:, iv, iu] = np.concatenate([E, B])
+		print(f"Progressive sampling at {'xyz'[ax3]} = {Z:g}: level {level + 1} of {plane.levels()} (stride {plane.stride(level)}), {len(iu)} evaluations")
+		if on_level is not None and level < plane.levels() - 1:
+			lu, lv = plane.lattice(level)
+			coarse = values[:, lv][:, :, lu]
+			level_axes = list(axes)
+			level_axes[ax1], level_axes[ax2] = u[lu], v[lv]
+			on_level(level_axes, fieldfile.from_plane(coarse[:3], ax3), fieldfile.from_plane(coarse[3:], ax3))
+	e_field = fieldfile.from_plane(values[:3], ax3)
+	b_field = fieldfile.from_plane(values[3:], ax3)
+	return add_voxel_densities(config, sources, axes, space, e_field, pointwise), b_field
+
+def sample_fields(config, sources, axes, space, cache, on_level=None, density_map=False):
+	"""Computes the fields on a sampling grid with the configured sampling;
+	on_level is passed on to compute_fields_progressive. Uniform sampling
+	without a cache evaluates the sources in a single fused pass, which also
+	computes the charge density map if requested, and only computes the
+	electric field on the fundamental domain of the symmetry of the charges.
+
+	Returns:
+		Electric and magnetic fields at each sample point and the charge
+		density map if it was computed along with them, otherwise None
+	"""
+	with profiler.stage("fields"):
+		sampling = config.get("sampling", "uniform")
+		if sampling == "adaptive":
+			return (*compute_fields_adaptive(config, sources, axes, space), None)
+		if sampling == "progressive":
+			return (*compute_fields_progressive(config, sources, axes, space, on_level), None)
+		if cache is None:
+			return compute_fields_symmetric(config, sources, axes, space, density_map)
+		return (*compute_fields(config, sources, axes, space, cache), None)
+
+def compute_fields_symmetric(config, sources, axes, space, density_map=False):
+	"""Computes the fields with compute_fields_fused, evaluating the electric
+	field and the charge density map only on the fundamental domain of the
+	symmetry of the configuration (see symmetry.py) and the magnetic field
+	on the whole grid"""
+	ax3 = config["plane"]["axis"]
+	found = symmetry.from_config(config, sources) if config["e-field"]["plot"] else symmetry.none()
+	if not symmetry.any_symmetry(found):
+		return compute_fields_fused(config, sources, axes, space, density_map)
+	print(f"Symmetry: {symmetry.describe(found)}")
+	reduced = symmetry.reduced_axes(axes, found, ax3)
+	reduced_space = np.array(np.meshgrid(*reduced))
+	profiler.count("symmetry-points", space[0].size - reduced_space[0].size)
+	e_field, _, density = compute_fields_fused(config, sources, reduced, reduced_space, density_map, want_b=False)
+	_, b_field, _ = compute_fields_fused(config, sources, axes, space, want_e=False)
+	with profiler.stage("unfold"):
+		e_field = symmetry.unfold(e_field, axes, found, ax3)
+		if density is not None:
+			density = symmetry.unfold(density, axes, found, ax3, vector=False)
+	return e_field, b_field, density
+
+def new_cache():
+	return {"e-field": incremental.FieldCache(), "b-field": incremental.FieldCache()}
+
+def volume_slabs(config):
+	"""Coordinates of the slabs of a volume along the plane's normal axis,
+	spanning the plot bounds and margins
+
+	Args:
+		config: Environment configuration with a "volume" entry giving
+			either the number of "slices" or their "spacing"
+
+	Returns:
+		Slab coordinates
+	"""
+	ax3 = config["plane"]["axis"]
+	lo = config["plot-bounds"]["min"][ax3] - config["plot-margins"][ax3]
+	hi = config["plot-bounds"]["max"][ax3] + config["plot-margins"][ax3]
+	volume = config["volume"]
+	spacing = volume.get("spacing", 0)
+	if spacing > 0:
+		return lo + np.arange(int((hi - lo) / spacing) + 1) * spacing
+	return np.linspace(lo, hi, volume.get("slices", 10))
+
+def visualize_volume(config):
+	"""Computes the fields on a stack of planes covering the plot volume and
+	streams them slab by slab to volume field data files, so only one slab
+	is held in memory
+
+	Args:
+		config: Environment configuration
+	"""
+	with profiler.stage("sources"):
+		sources = FieldSources(config)
+	ax3 = config["plane"]["axis"]
+	slabs = volume_slabs(config)
+	writers = {}
+	for k, Z in enumerate(slabs):
+		with profiler.stage("slab"):
+			config["plane"]["coordinate"] = float(Z)
+			with profiler.stage("grid"):
+				axes, space = build_grid(config)
+			# Every slab is a different grid, so there is nothing to cache
+			e_field, b_field, _ = sample_fields(config, sources, axes, space, None)
+			with profiler.stage("write-output"):
+				for field_name, field in zip(["e", "b"], [e_field, b_field]):
+					config_name = f"{field_name}-field"
+					if not config[config_name]["plot"]:
+						continue
+					if k == 0:
+						kind = field_name.upper()
+						filename = output_files[config_name] or f"{config['name']} {kind}-Volume.emf"
+						writers[config_name] = fieldfile.FieldWriter(filename, axes, ax3, kind, slabs)
+					writers[config_name].write(field)
+		print(f"Slab {k + 1}/{len(slabs)} ({'xyz'[ax3]} = {Z:g})")
+	for writer in writers.values():
+		writer.close()
+
+def compute_frame(config, sources, axes, space, cache, field_files, on_level=None):
+	"""Loads or computes the fields of a configuration on its sampling grid,
+	going through the saved field data files and the result cache if enabled
+
+	Args:
+		config: Environment configuration
+		sources: FieldSources of the configuration
+		axes: Sample coordinates along each axis
+		space: Sampling grid
+		cache: Dictionary of FieldCache objects for each field, or None to
+			compute the fields in a single fused pass
+		field_files: Field data file name for each field ("E" and "B")
+		on_level: Called with the coarse levels of progressive sampling
+
+	Returns:
+		Electric and magnetic fields at each sample point and the charge
+		density map if the fused pass computed it, otherwise None
+	"""
+	ax3 = config["plane"]["axis"]
+	b_field = np.zeros_like(space)
+	overall_charge_density = None
+	# Fields memory-mapped from their data files, which must not be written
+	# back over themselves
+	loaded = set()
+	if load_fields:
+		e_field = fieldfile.read_field(field_files["E"]).field()
+		if e_field.shape != space.shape:
+			raise Exception(f"{field_files['E']} was computed on a different grid")
+		loaded.add("E")
+		if os.path.exists(field_files["B"]):
+			b_field = fieldfile.read_field(field_files["B"]).field()
+			loaded.add("B")
+	else:
+		cached = None
+		if result_cache is not None:
+			with profiler.stage("cache-load"):
+				key = result_cache.key(config)
+				cached = result_cache.load(key, space.shape)
+		if cached is not None:
+			e_field, b_field = cached
+		else:
+			e_field, b_field, overall_charge_density = sample_fields(config, sources, axes, space, cache, on_level, True)
+			if result_cache is not None:
+				with profiler.stage("cache-store"):
+					result_cache.store(key, axes, ax3, e_field, b_field)
+	if save_fields:
+		with profiler.stage("write-output"):
+			for kind, field in zip(["E", "B"], [e_field, b_field]):
+				if kind not in loaded:
+					fieldfile.write_field(field_files[kind], field, axes, ax3, kind)
+	return e_field, b_field, overall_charge_density
+
+def density_values(sources, space):
+	"""Overall charge density of the sources at the given sample points"""
+	overall_charge_density = np.zeros_like(space[0])
+	for rho, box in zip(sources.charge_funcs, sources.charge_supports):
+		if box is None:
+			continue
+		# Only the samples within the density's support are evaluated
+		inside = np.all([(space[i] >= box[0][i]) & (space[i] <= box[1][i]) for i in range(3)], axis=0)
+		profiler.count("density-evaluations", int(np.count_nonzero(inside)))
+		if np.any(inside):
+			overall_charge_density[inside] += np.vectorize(rho)(space[2][inside], space[1][inside], space[0][inside])
+	return overall_charge_density
+
+def report_precision(config, space):
+	"""Prints the largest relative error of the point charge field computed
+	with the configured precision on a subset of the grid against a float64
+	reference"""
+	charges = np.array(config.get("charges", []), dtype=float).reshape(-1, 4)
+	if len(charges) == 0:
+		return
+	if config["solver"] == "barnes-hut":
+		print("The precision check needs direct summation")
+		return
+	with profiler.stage("precision-check"):
+		precision = config.get("precision", "double")
+		points = mixedprecision.sample_points(space)
+		values = efield_charges(charges, points, "direct", 0, precision)
+		reference = mixedprecision.charge_field(charges, points, "double")
+		error = mixedprecision.max_relative_error(values, reference)
+	engine = "native" if native.available() else "NumPy"
+	print(f"Precision {precision} ({engine}): max relative error {error:.3g} of the point charge field at {points.shape[1]} samples (float64 reference)")
+
+def charge_density_map(sources, space):
+	"""Overall charge density at each sample point, or None without charge
+	densities"""
+	if len(sources.charge_funcs) == 0:
+		return None
+	with profiler.stage("charge-density-map"):
+		return density_values(sources, space)
+
+def plot_native(config, sources, axes, field, overall_charge_density, field_name, ax1, ax2, filename):
+	"""Draws the streamplot of one field with the native tracer and
+	rasterizer instead of matplotlib. The plot has no title or axis labels.
+
+	Returns:
+		Whether the plot was drawn; False if the colormap isn't available
+		natively
+	"""
+	charges = [(charge[0], charge[1 + ax1], charge[1 + ax2]) for charge in config.get("charges", [])]
+	segments = []
+	if field_name == "b":
+		segments = [segment[[1 + ax1, 1 + ax2, 4 + ax1, 4 + ax2]] for segment in sources.segments]
+	density = None if overall_charge_density is None else overall_charge_density.T[0].T
+	drawn = native.streamplot(filename, axes[ax1], axes[ax2], field[ax1].T[0].T, field[ax2].T[0].T,
+		config["colormap"], density, charges, segments)
+	if not drawn:
+		print(f"Colormap {config['colormap']} is not available natively; plotting with matplotlib")
+	return drawn
+
+def plot_fields(config, sources, axes, e_field, b_field, overall_charge_density, outputs):
+	"""Plots the fields on the plane of interest and saves the plots. Each
+	field is drawn into a figure named after it, which is cleared first so
+	the figures are reused by successive calls.
 
+	Args:
+		config: Environment configuration
+		sources: FieldSources of the configuration
+		axes: Sample coordinates along each axis
+		e_field: Electric field at each sample point
+		b_field: Magnetic field at each sample point
+		overall_charge_density: Charge density at each sample point, if any
+		outputs: Plot file name for each field ("e-field" and "b-field")
+	"""
+	ax3 = config["plane"]["axis"]
+	Z = config["plane"]["coordinate"]
 	axis_names = ["x", "y", "z"]
 	ax1, ax2 = {
 		0: (1, 2),
 		1: (0, 2),
 		2: (0, 1)
 	}[ax3]
-	e_field, b_field = np.zeros_like(space), np.zeros_like(space)
-
-	if "charges" in config:
-		charges = np.array(config["charges"])
-		def efield_charges(x):
-			E = np.zeros_like(x)
-			for charge in charges:
-				s = (x.T - charge[1:]).T
-				E += charge[0] * s / (np.linalg.norm(s, axis=0) ** 3 + 1e-6)
-			return E
-		e_field += efield_charges(space)
-
-	list_charge_densities = []
-	if "charge-densities" in config:
-		densities = config["charge-densities"]
-		for density_func in densities:
-			if density_func["preset"]:
-				rho = presets.get_preset(density_func)
-			else:
-				rho = construct_function(eval_safety, density_func["func"])
-			list_charge_densities.append(rho)
-			def integrand(z, y, x, Xz, Xy, Xx, axis):
-				X = np.array([Xx, Xy, Xz])
-				Y = np.array([x, y, z])
-				v = X - Y
-				return rho(z, y, x) * v[axis] / (np.linalg.norm(v) ** 3 + 1e-6)
-			def integrand2(y, x, Xz, Xy, Xx, axis, z, axis1, axis2, axis3):
-				Y = np.empty(3)
-				Y[axis1] = x
-				Y[axis2] = y
-				Y[axis3] = z
-				return integrand(Y[2], Y[1], Y[0], Xz, Xy, Xx, axis)
-			def integrand1(x, Xz, Xy, Xx, axis, y, z, axis1, axis2, axis3):
-				Y = np.empty(3)
-				Y[axis1] = x
-				Y[axis2] = y
-				Y[axis3] = z
-				return integrand(Y[2], Y[1], Y[0], Xz, Xy, Xx, axis)
-			def grid_integral(f, *bounds, args=(), dim=3):
-				if dim == 3:
-					return np.vectorize(
-						lambda z, y, x: tplquad(
-							f, *bounds,
-							args=(z, y, x, *args)
-						)[0] if rho(z, y, x) == 0 else 0
-					)
-				elif dim == 2:
-					return np.vectorize(
-						lambda z, y, x: dblquad(
-							f, *bounds,
-							args=(z, y, x, *args)
-						)[0]
-					)
-				elif dim == 1:
-					return np.vectorize(
-						lambda z, y, x: quad(
-							f, *bounds,
-							args=(z, y, x, *args)
-						)[0]
-					)
-			if density_func["func"] == presets.PRESET_DELTA and \
-					density_func["var"] in ["x", "y", "z"]:
-				val = density_func["value"]
-				axis1, axis2, delAxis = {
-					("x", 0): (1,2,0),
-					("x", 1): (2,1,0),
-					("x", 2): (1,2,0),
-					("y", 0): (2,0,1),
-					("y", 1): (0,2,1),
-					("y", 2): (0,2,1),
-					("z", 0): (1,0,2),
-					("z", 1): (0,1,2),
-					("z", 2): (0,1,2)
-				}[(density_func["var"], ax3)]
-				ax, ay = axes[axis1][0], axes[axis2][0]
-				bx, by = axes[axis1][-1], axes[axis2][-1]
-				for axis in range(3):
-					if axis == ax3:
-						continue
-					if delAxis == ax3:
-						# Technically this should never come up
-						# because the field is parallel to the
-						# ignored axis
-						e_field[axis] += grid_integral(
-							integrand2,
-							ax, bx, ay, by,
-							args=(axis, val, axis1, axis2, delAxis), dim=2
-						)(space[2], space[1], space[0])
-					else:
-						e_field[axis] += grid_integral(
-							integrand1,
-							ax, bx,
-							args=(axis, val, Z, axis1, delAxis, axis2),
-							dim=1
-						)(space[2], space[1], space[0])
-			else:
-				ax, ay, az = axes[0][0], axes[1][0], axes[2][0]
-				bx, by, bz = axes[0][-1], axes[1][-1], axes[2][-1]
-				if ax == bx:
-					ax, bx = ay, by
-				elif ay == by:
-					ay, by = ax, bx
-				elif az == bz:
-					az, bz = ax, bx
-				for axis in range(3):
-					if axis == ax3:
-						continue
-					e_field[axis] += grid_integral(
-						integrand,
-						ax, bx, ay, by, az, bz,
-						args=(axis,)
-					)(space[2], space[1], space[0])
-
-	# Determine overall charge density distribution
-	if len(list_charge_densities) > 0:
-		overall_charge_density = np.zeros_like(space[0])
-	for rho in list_charge_densities:
-		overall_charge_density += np.vectorize(rho)(space[2], space[1], space[0])
 
 	if ax3 != 2:
 		ax1, ax2 = ax2, ax1
 		e_field = np.moveaxis(e_field, 2 - ax3, -1)
 		b_field = np.moveaxis(b_field, 2 - ax3, -1)
-		overall_charge_density = np.moveaxis(overall_charge_density, 1 - ax3, -1)
+		if overall_charge_density is not None:
+			overall_charge_density = np.moveaxis(overall_charge_density, 1 - ax3, -1)
 
 	# Generate field plots
 	for field_name, field in zip(["e", "b"], [e_field, b_field]):
 		config_name = f"{field_name}-field"
 		if config[config_name]["plot"]:
+			if native_plots and not config["show"] and native.available():
+				with profiler.stage("native-plot"):
+					if plot_native(config, sources, axes, field, overall_charge_density, field_name, ax1, ax2, outputs[config_name]):
+						continue
 			render_name = f"{field_name.upper()}-Field"
 			plt.figure(render_name)
+			plt.clf()
 
 			# Plot charges
 			if "charges" in config:
@@ -248,17 +819,25 @@ def visualize_fields(config):
 					plt.plot(*xy, 'ro', color=("red" if charge[0] > 0 else "blue"))
 					plt.annotate(f"{charge[0]} C", xy=xy, xytext=(10,5), ha='right', textcoords='offset points')
 
+			# Plot current segments projected onto the plane
+			if field_name == "b":
+				for segment in sources.segments:
+					plt.plot(segment[[1 + ax1, 4 + ax1]], segment[[1 + ax2, 4 + ax2]], color="green")
+
 			# Plot charge densities
-			if len(list_charge_densities) > 0:
-				plt.contourf(axes[ax1], axes[ax2], overall_charge_density.T[0].T, cmap=plt.cm.bwr)
+			if overall_charge_density is not None:
+				with profiler.stage("contourf"):
+					plt.contourf(axes[ax1], axes[ax2], overall_charge_density.T[0].T, cmap=plt.cm.bwr)
 
 			# Plot field
 			fx, fy = field[ax1].T[0].T, field[ax2].T[0].T
 			color = 2 * np.log(np.hypot(fx, fy) + 1e-6)
-			try:
-				plt.streamplot(axes[ax1], axes[ax2], fx, fy, color=color, cmap=plt.get_cmap(config["colormap"]))
-			except ValueError as e:
-				print(f"Failed to plot {render_name}: {e}")
+			with profiler.stage("streamplot"):
+				profiler.count("points", fx.size)
+				try:
+					plt.streamplot(axes[ax1], axes[ax2], fx, fy, color=color, cmap=plt.get_cmap(config["colormap"]))
+				except ValueError as e:
+					print(f"Failed to plot {render_name}: {e}")
 
 			# Plot labels
 			plt.title(f"{render_name} ({axis_names[ax3]} = {Z})")
@@ -266,37 +845,175 @@ def visualize_fields(config):
 			plt.ylabel(axis_names[ax2])
 
 			# Output
-			if output_files[config_name] is not None:
-				plt.savefig(output_files[config_name])
-			else:
-				plt.savefig(f"{config['name']} {render_name}.png")
+			with profiler.stage("savefig"):
+				plt.savefig(outputs[config_name])
 			if config["show"]:
 				plt.show()
 
+def visualize_fields(config, cache=None):
+	"""Plot electric and magnetic fields for given configuration
+
+	Args:
+		config: Environment configuration
+		cache: Dictionary of field contributions kept from earlier calls for
+			each field ("e-field" and "b-field"), if any
+	"""
+	with profiler.stage("grid"):
+		axes, space = build_grid(config)
+	with profiler.stage("sources"):
+		sources = FieldSources(config)
+	field_files = {name: f"{config['name']} {name}-Field.emf" for name in ["E", "B"]}
+	outputs = {}
+	for field_name in ["e", "b"]:
+		config_name = f"{field_name}-field"
+		outputs[config_name] = output_files[config_name] or f"{config['name']} {field_name.upper()}-Field.png"
+
+	# With progressive sampling the plots are first drawn from each coarse
+	# level so a picture is available long before the full grid is done
+	def plot_level(level_axes, e_level, b_level):
+		plot_fields(dict(config, show=False), sources, level_axes, e_level, b_level, None, outputs)
+
+	e_field, b_field, overall_charge_density = compute_frame(config, sources, axes, space, cache, field_files, plot_level)
+	if overall_charge_density is None:
+		overall_charge_density = charge_density_map(sources, space)
+	if precision_check:
+		report_precision(config, space)
+	plot_fields(config, sources, axes, e_field, b_field, overall_charge_density, outputs)
+
+def visualize_sweep(config):
+	"""Renders one frame per value of the swept parameter in a single
+	process. The sampling grid, the sources and the field contributions of
+	unchanged sources are kept from frame to frame, and the fields of the
+	next frame are computed in a background thread while the current frame
+	is plotted. Inferred plot bounds cover the first and last frames.
+
+	Args:
+		config: Environment configuration with a "sweep" entry giving the
+			"parameter" path and its values
+	"""
+	path = config["sweep"]["parameter"]
+	values = sweep.sweep_values(config["sweep"])
+	if len(values) == 0:
+		raise Exception("Sweep has no frames")
+	if "plot-bounds" not in config:
+		ends = [complete_config(sweep.frame_config(config, path, values[k])) for k in [0, -1]]
+		config["plot-bounds"] = sweep.union_bounds([frame["plot-bounds"] for frame in ends])
+	rebuild = sweep.changes_sources(path)
+	cache = new_cache()
+	state = {"grid": None, "sources": None, "density": None}
+
+	def compute(k):
+		frame = complete_config(sweep.frame_config(config, path, values[k]))
+		frame["show"] = False
+		with profiler.stage("frame"):
+			with profiler.stage("grid"):
+				axes, space = build_grid(frame)
+			grid = grid_key(frame, axes)
+			if state["sources"] is None or rebuild:
+				with profiler.stage("sources"):
+					state["sources"] = FieldSources(frame)
+				state["density"] = None
+			sources = state["sources"]
+			field_files = {name: sweep.frame_filename(f"{config['name']} {name}-Field.emf", k) for name in ["E", "B"]}
+			e_field, b_field, _ = compute_frame(frame, sources, axes, space, cache, field_files)
+			if state["density"] is None or grid != state["grid"]:
+				state["density"] = charge_density_map(sources, space)
+			state["grid"] = grid
+		return frame, sources, axes, e_field, b_field, state["density"]
+
+	# A single worker keeps the frames (and the field cache) in order
+	with concurrent.futures.ThreadPoolExecutor(max_workers=1) as executor:
+		pending = executor.submit(compute, 0)
+		for k, value in enumerate(values):
+			frame, sources, axes, e_field, b_field, density = pending.result()
+			if k + 1 < len(values):
+				pending = executor.submit(compute, k + 1)
+			outputs = {}
+			for field_name in ["e", "b"]:
+				config_name = f"{field_name}-field"
+				filename = output_files[config_name] or f"{config['name']} {field_name.upper()}-Field.png"
+				outputs[config_name] = sweep.frame_filename(filename, k)
+			with profiler.stage("plot"):
+				plot_fields(frame, sources, axes, e_field, b_field, density, outputs)
+			print(f"Frame {k + 1}/{len(values)} ({path} = {value:g})")
+
+def render_config(config_file):
+	"""Reads a configuration file and renders it as a sweep, a volume or a
+	single plane
+
+	Returns:
+		Whether the configuration could be read
+	"""
+	config = None
+	try:
+		with profiler.stage("read-config"):
+			config = configfile.read_config(config_file)
+			profiler.count("charges", len(config.get("charges", [])))
+	except Exception as e:
+		print(f"Failed to read configuration file.\nError: {e}\nTerminating.")
+		return False
+	config["name"] = config_file[:config_file.rfind('.')]
+	if "sweep" in config:
+		visualize_sweep(config)
+	else:
+		with profiler.stage("complete-config"):
+			config = complete_config(config)
+		if "volume" in config:
+			visualize_volume(config)
+		else:
+			visualize_fields(config)
+	return True
+
+def render_job(request):
+	"""Renders a job submitted to the service. The request may name the
+	output files but not the eval safety level, which stays the one the
+	service was started with."""
+	output_files["e-field"] = request.get("eout")
+	output_files["b-field"] = request.get("bout")
+	return render_config(request["config"])
+
 if __name__ == '__main__':
 	parser = argparse.ArgumentParser("EM Field Visualizer")
 	parser.add_argument("--conf", "-f", nargs=1, type=str, default=[None], help="Configuration file", dest="config")
 	parser.add_argument("--safety", "-s", nargs=1, type=int, default=[0], help="Eval safety level: 0 prevents all evaluation, 1 allows evaluation of functions in a whitelist, 2 allows for evaluation of arbitrary functions; default 0", dest="safety")
-	parser.add_argument("--eout", nargs=1, type=str, default=[None], help="Output file for electric field plot", dest="eout")
-	parser.add_argument("--bout", nargs=1, type=str, default=[None], help="Output file for magnetic field plot", dest="bout")
+	parser.add_argument("--eout", nargs=1, type=str, default=[None], help="Output file for electric field plot (or volume data)", dest="eout")
+	parser.add_argument("--bout", nargs=1, type=str, default=[None], help="Output file for magnetic field plot (or volume data)", dest="bout")
+	parser.add_argument("--save-fields", action="store_true", help="Write the computed fields to binary field data files next to the plots", dest="save_fields")
+	parser.add_argument("--load-fields", action="store_true", help="Plot the fields from previously saved field data files instead of computing them", dest="load_fields")
+	parser.add_argument("--cache-dir", nargs=1, type=str, default=[None], help="Directory for cached field results; default $XDG_CACHE_HOME/em-field-visualizer", dest="cache_dir")
+	parser.add_argument("--no-cache", action="store_true", help="Always compute the fields instead of using cached results", dest="no_cache")
+	parser.add_argument("--workers", "-j", nargs=1, type=int, default=[None], help="Number of worker processes for density integration; default one per core", dest="workers")
+	parser.add_argument("--native-plots", action="store_true", help="Draw the streamplots with the native engine instead of matplotlib (needs libemfield)", dest="native_plots")
+	parser.add_argument("--precision-check", action="store_true", help="Report the error of the point charge field in the configured precision against a float64 reference", dest="precision_check")
+	parser.add_argument("--serve", nargs="?", type=str, const="", default=None, help=f"Run as a job service on a Unix socket, by default {service.default_path()}", dest="serve")
+	parser.add_argument("--serve-workers", nargs=1, type=int, default=[1], help="Number of jobs the service runs at the same time; default 1", dest="serve_workers")
+	parser.add_argument("--queue", nargs=1, type=int, default=[service.QUEUE_SIZE], help=f"Number of jobs that may wait in the service's queue; default {service.QUEUE_SIZE}", dest="queue")
+	parser.add_argument("--profile", nargs=1, type=str, default=[None], help="Write the time and counters of each stage to a JSON report", dest="profile")
+	parser.add_argument("--trace", nargs=1, type=str, default=[None], help="Write the stages to a Chrome trace file (chrome://tracing or Perfetto)", dest="trace")
 
 	args = parser.parse_args()
 
 	eval_safety = args.safety[0]
+	worker_count = args.workers[0]
+	save_fields = args.save_fields
+	load_fields = args.load_fields
+	native_plots = args.native_plots
+	precision_check = args.precision_check
+	if not args.no_cache:
+		result_cache = resultcache.ResultCache(args.cache_dir[0])
 	output_files["e-field"] = args.eout[0]
 	output_files["b-field"] = args.bout[0]
 
+	profiler.enable(args.profile[0] is not None or args.trace[0] is not None)
+
 	config_file = args.config[0]
-	if config_file is None:
+	if args.serve is not None:
+		service.serve(render_job, args.serve or None, args.serve_workers[0], args.queue[0])
+	elif config_file is None:
 		print("No configuration file provided. Terminating.")
 	else:
-		config = None
-		try:
-			with open(config_file) as data:
-				config = json.load(data)
-		except Exception as e:
-			print(f"Failed to read configuration file.\nError: {e}\nTerminating.")
-		else:
-			config["name"] = config_file[:config_file.rfind('.')]
-			config = complete_config(config)
-			visualize_fields(config)
+		render_config(config_file)
+	if args.profile[0] is not None:
+		profiler.write_report(args.profile[0], "visualizer")
+	if args.trace[0] is not None:
+		profiler.write_trace(args.trace[0], "visualizer")